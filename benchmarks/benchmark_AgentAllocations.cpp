@@ -0,0 +1,111 @@
+#include "Agent.h"
+#include "AgentManager.h"
+#include "AgentStrategy.h"
+#include "AgentStrategyFactory.h"
+#include "LatencyProbes.h"
+#include "OrderPool.h"
+#include "Orderbook.h"
+#include "TradeDispatcher.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <thread>
+
+// Counts heap allocations made by the agent (outgoing) thread once the
+// simulation has warmed up. Agents act into buffers owned by the manager so
+// a steady state action should never reach the allocator. Market makers cap
+// their resting quotes within the active orders reserve, so all three
+// strategies are covered.
+
+static thread_local std::uint64_t threadAllocations{0};
+
+void *operator new(std::size_t size) {
+  ++threadAllocations;
+  if (void *ptr = std::malloc(size ? size : 1)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) { return operator new(size); }
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, std::size_t) noexcept { std::free(ptr); }
+
+int main() {
+  const std::size_t n{16};
+  const std::uint64_t warmUpTime{2'000};
+  const std::uint64_t maxTime{10'000};
+
+  TradeDispatcher tradeDispatcher;
+  OrderPool orderPool;
+  Orderbook orderbook(&orderPool, tradeDispatcher);
+  MatchingEngine matchingEngine(orderbook, &orderPool);
+  AgentManager agentManager_(warmUpTime, orderbook);
+
+  for (size_t i = 0; i < n; ++i) {
+    agentManager_.AddAgent(Agent(tradeDispatcher, matchingEngine, i, 1),
+                           MakeStrategyRandom(&orderPool, 1));
+  }
+  for (size_t i = 0; i < n; ++i) {
+    agentManager_.AddAgent(Agent(tradeDispatcher, matchingEngine, i + n, 1),
+                           MakeStrategyMarketMaker(&orderPool, 0.02));
+  }
+  for (size_t i = 0; i < n; ++i) {
+    agentManager_.AddAgent(
+        Agent(tradeDispatcher, matchingEngine, i + 2 * n, 1),
+        MakeStrategyMomentumTrader(&orderPool, 0.005));
+  }
+
+  agentManager_.WarmUp();
+  agentManager_.SetRunning(true);
+
+  tradeDispatcher.Start();
+  std::thread t1(&MatchingEngine::Start, &matchingEngine);
+  std::thread t2(&AgentManager::RunIncomingLoop, &agentManager_);
+
+  agentManager_.RunOutgoingLoop();
+  const std::uint64_t warmUpActions = agentManager_.GetNAgentActions();
+  const std::uint64_t warmUpAllocations = threadAllocations;
+
+  agentManager_.maxTime_ = maxTime;
+  agentManager_.RunOutgoingLoop();
+  const std::uint64_t actions =
+      agentManager_.GetNAgentActions() - warmUpActions;
+  const std::uint64_t allocations = threadAllocations - warmUpAllocations;
+
+  matchingEngine.Stop();
+  if (t1.joinable()) {
+    t1.join();
+  }
+  tradeDispatcher.Stop();
+  agentManager_.SetRunning(false);
+  if (t2.joinable()) {
+    t2.join();
+  }
+
+  std::cout << "+---------------------------------------+" << std::endl;
+  std::cout << "| Number of agents: 3x" << std::setw(10) << n << std::endl;
+  std::cout << "| Steady state actions: " << std::setw(10) << actions
+            << std::endl;
+  std::cout << "| Heap allocations: " << std::setw(14) << allocations
+            << std::endl;
+  std::cout << "| Allocations per action: " << std::setw(8) << std::fixed
+            << std::setprecision(4)
+            << (actions ? static_cast<double>(allocations) / actions : 0.0)
+            << std::endl;
+  agentManager_.PrintRoundTripReport();
+  PrintLatencyReport();
+
+  if (allocations != 0) {
+    std::cout << "| FAILED: the action path allocated" << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -2,10 +2,14 @@
 #include "AgentManager.h"
 #include "AgentStrategy.h"
 #include "AgentStrategyFactory.h"
+#include "LatencyProbes.h"
 #include "OrderPool.h"
+#include "PerfCounters.h"
 #include "Orderbook.h"
+#include "ThreadPlacement.h"
 #include "TradeDispatcher.h"
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <iomanip>
@@ -15,77 +19,133 @@
 #include <sched.h>
 #include <stdio.h>
 
-int main() {
-  for (size_t n = 16; n <= 256; n *= 2) {
-    TradeDispatcher tradeDispatcher;
-    OrderPool orderPool;
-    Orderbook orderbook(&orderPool, tradeDispatcher);
-    MatchingEngine matchingEngine(orderbook, &orderPool);
-    std::uint64_t maxTime{100'000};
-    AgentManager agentManager_(maxTime);
-    size_t nRandom = n;
-    size_t nMarketMaker = n;
-    size_t nMomentumTrader = n;
-
-    double randomRate{1}, marketMakerRate{1}, momentumTraderRate{1};
-
-    for (size_t i = 0; i < nRandom; ++i) {
-      agentManager_.AddAgent(std::make_unique<Agent>(
-          tradeDispatcher, matchingEngine,
-          MakeStrategyRandom(&orderbook, &orderPool, 1),
-          i + (nRandom + nMarketMaker), momentumTraderRate));
-    }
+enum class SteppingMode { SERIAL, BATCH_SYNCHRONOUS, LOCKSTEP };
 
-    for (size_t i = 0; i < nMarketMaker; ++i) {
-      agentManager_.AddAgent(std::make_unique<Agent>(
-          tradeDispatcher, matchingEngine,
-          MakeStrategyMarketMaker(&orderbook, &orderPool, 0.02),
-          i + (nRandom + nMarketMaker), momentumTraderRate));
+// Takes an optional thread placement, e.g. engine:2,outgoing:4,incoming:6
+int main(int argc, char **argv) {
+  if (argc > 1) {
+    auto placement = ParseThreadPlacement(argv[1]);
+    if (!placement) {
+      std::cerr << "Invalid thread placement: " << argv[1] << '\n';
+      return 1;
     }
+    SetThreadPlacement(*placement);
+  }
+  const double timeSlice{1};
+  const std::size_t nAgentThreads =
+      std::max(1u, std::thread::hardware_concurrency());
 
-    for (size_t i = 0; i < nMomentumTrader; ++i) {
-      agentManager_.AddAgent(std::make_unique<Agent>(
-          tradeDispatcher, matchingEngine,
-          MakeStrategyMomentumTrader(&orderbook, &orderPool, 0.005),
-          i + (nRandom + nMarketMaker), momentumTraderRate));
-    }
+  for (size_t n = 16; n <= 256; n *= 2) {
+    for (SteppingMode mode :
+         {SteppingMode::SERIAL, SteppingMode::BATCH_SYNCHRONOUS,
+          SteppingMode::LOCKSTEP}) {
+      FirstTouchPlacement firstTouch(PipelineRole::ENGINE);
+      TradeDispatcher tradeDispatcher;
+      OrderPool orderPool;
+      Orderbook orderbook(&orderPool, tradeDispatcher);
+      MatchingEngine matchingEngine(orderbook, &orderPool);
+      firstTouch.Restore();
+      RecordMemoryPlacement("Order pool orders", orderPool.get_order(0),
+                            orderPool.capacity() * sizeof(Order));
+      RecordMemoryPlacement("Order pool infos", orderPool.get_info(0),
+                            orderPool.capacity() * sizeof(OrderInfo));
+      RecordMemoryPlacement("Orderbook memory", &orderbook,
+                            sizeof(orderbook));
+      std::uint64_t maxTime{100'000};
+      AgentManager agentManager_(maxTime, orderbook);
+      size_t nRandom = n;
+      size_t nMarketMaker = n;
+      size_t nMomentumTrader = n;
 
-    agentManager_.WarmUp();
-    agentManager_.SetRunning(true);
+      double randomRate{1}, marketMakerRate{1}, momentumTraderRate{1};
 
-    std::thread t1(&MatchingEngine::Start, &matchingEngine);
-    std::thread t2(&AgentManager::RunIncomingLoop, &agentManager_);
-    auto loop_start = std::chrono::steady_clock::now();
-    agentManager_.RunOutgoingLoop();
+      for (size_t i = 0; i < nRandom; ++i) {
+        agentManager_.AddAgent(
+            Agent(tradeDispatcher, matchingEngine, i, randomRate),
+            MakeStrategyRandom(&orderPool, 1));
+      }
 
-    agentManager_.SetRunning(false);
-    matchingEngine.Stop();
-    auto loop_end = std::chrono::steady_clock::now();
+      for (size_t i = 0; i < nMarketMaker; ++i) {
+        agentManager_.AddAgent(
+            Agent(tradeDispatcher, matchingEngine,
+                  i + nRandom, marketMakerRate),
+            MakeStrategyMarketMaker(&orderPool, 0.02));
+      }
 
-    if (t1.joinable()) {
-      t1.join();
-    }
+      for (size_t i = 0; i < nMomentumTrader; ++i) {
+        agentManager_.AddAgent(
+            Agent(tradeDispatcher, matchingEngine,
+                  i + (nRandom + nMarketMaker), momentumTraderRate),
+            MakeStrategyMomentumTrader(&orderPool, 0.005));
+      }
 
-    if (t2.joinable()) {
-      t2.join();
-    }
+      agentManager_.WarmUp();
+      agentManager_.SetRunning(true);
 
-    double duration_ms =
-        std::chrono::duration<double, std::milli>(loop_end - loop_start)
-            .count();
-    double throughput_orders_per_sec =
-        (agentManager_.GetNAgentActions() / duration_ms) * 1000.0;
-
-    std::cout << "+---------------------------------------+" << std::endl;
-    std::cout << "| Number of agents: 3x" << std::setw(10) << n << std::endl;
-    std::cout << "| Actions processed: " << std::setw(10)
-              << agentManager_.GetNAgentActions() << std::endl;
-    std::cout << "| Orders processed: " << std::setw(10)
-              << matchingEngine.GetProcessedOrders() << std::endl;
-    std::cout << "| Duration: " << std::setw(12) << std::fixed
-              << std::setprecision(2) << duration_ms << " ms" << std::endl;
-    std::cout << "| Throughput (actions/s): " << std::setw(10) << std::fixed
-              << std::setprecision(0) << throughput_orders_per_sec << " ops/sec"
-              << std::endl;
+      // Opened before any pipeline thread starts so they are all counted
+      PerfCounters counters(true);
+      counters.Start();
+      std::thread t1;
+      std::thread t2;
+      auto loop_start = std::chrono::steady_clock::now();
+      if (mode == SteppingMode::LOCKSTEP) {
+        agentManager_.RunLockstepLoop(matchingEngine, tradeDispatcher);
+      } else {
+        tradeDispatcher.Start();
+        t1 = std::thread(&MatchingEngine::Start, &matchingEngine);
+        t2 = std::thread(&AgentManager::RunIncomingLoop, &agentManager_);
+        loop_start = std::chrono::steady_clock::now();
+        if (mode == SteppingMode::BATCH_SYNCHRONOUS) {
+          agentManager_.RunBatchedOutgoingLoop(timeSlice, nAgentThreads);
+        } else {
+          agentManager_.RunOutgoingLoop();
+        }
+        matchingEngine.Stop();
+      }
+      auto loop_end = std::chrono::steady_clock::now();
+
+      if (t1.joinable()) {
+        t1.join();
+      }
+
+      tradeDispatcher.Stop();
+      agentManager_.SetRunning(false);
+
+      if (t2.joinable()) {
+        t2.join();
+      }
+      counters.Stop();
+
+      double duration_ms =
+          std::chrono::duration<double, std::milli>(loop_end - loop_start)
+              .count();
+      double throughput_orders_per_sec =
+          (agentManager_.GetNAgentActions() / duration_ms) * 1000.0;
+
+      std::cout << "+---------------------------------------+" << std::endl;
+      std::cout << "| Stepping mode: "
+                << (mode == SteppingMode::SERIAL   ? "serial"
+                    : mode == SteppingMode::LOCKSTEP ? "lockstep"
+                                                     : "batch-synchronous")
+                << std::endl;
+      std::cout << "| Number of agents: 3x" << std::setw(10) << n << std::endl;
+      std::cout << "| Actions processed: " << std::setw(10)
+                << agentManager_.GetNAgentActions() << std::endl;
+      std::cout << "| Orders processed: " << std::setw(10)
+                << matchingEngine.GetProcessedOrders() << std::endl;
+      std::cout << "| Orders rejected: " << std::setw(11)
+                << matchingEngine.GetRejectedOrders() << std::endl;
+      std::cout << "| Duration: " << std::setw(12) << std::fixed
+                << std::setprecision(2) << duration_ms << " ms" << std::endl;
+      std::cout << "| Throughput (actions/s): " << std::setw(10) << std::fixed
+                << std::setprecision(0) << throughput_orders_per_sec
+                << " ops/sec" << std::endl;
+      agentManager_.PrintRoundTripReport();
+      PrintPerfReport("all threads, per action", counters.Read(),
+                      agentManager_.GetNAgentActions());
+      PrintPlacementReport();
+      ResetPlacementRecords();
+    }
   }
+  PrintLatencyReport();
 }
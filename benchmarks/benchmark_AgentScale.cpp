@@ -0,0 +1,106 @@
+#include "Agent.h"
+#include "AgentManager.h"
+#include "AgentStrategy.h"
+#include "MatchingEngine.h"
+#include "OrderPool.h"
+#include "Orderbook.h"
+#include "TradeDispatcher.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+
+#include <unistd.h>
+
+// Builds populations of 10k, 100k and 1M agents and steps each in lockstep
+// for the same number of actions, the agents' rates shrinking as their
+// number grows. Reports how long the population took to build, the resident
+// memory it added and what stepping it costs once most agents sit idle.
+// Active orders are reserved on first use, as most agents never rest one.
+
+// Actions per time unit across the whole population
+static constexpr double POPULATION_RATE = 2'000;
+static constexpr std::uint64_t RUN_TIME = 100;
+static constexpr std::size_t SCALE_POOL_CAPACITY = std::size_t{1} << 21;
+
+static std::size_t ResidentBytes() {
+  std::ifstream statm("/proc/self/statm");
+  std::size_t pages = 0;
+  std::size_t resident = 0;
+  statm >> pages >> resident;
+  return resident * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+}
+
+int main() {
+  std::cout << "sizeof(Agent): " << sizeof(Agent) << " bytes" << std::endl;
+  for (std::size_t n : {10'000, 100'000, 1'000'000}) {
+    TradeDispatcher tradeDispatcher;
+    auto orderPool = std::make_unique<OrderPool>(SCALE_POOL_CAPACITY);
+    auto orderbook = std::make_unique<Orderbook>(
+        orderPool.get(), tradeDispatcher, SCALE_POOL_CAPACITY * 2);
+    MatchingEngine matchingEngine(*orderbook, orderPool.get());
+    auto agentManager = std::make_unique<AgentManager>(RUN_TIME, *orderbook);
+
+    // Mostly random agents, as in the default scenario
+    AgentPopulation population;
+    population.nRandom = n - n / 5;
+    population.nMarketMaker = n / 10;
+    population.nMomentumTrader = n / 10;
+    const double rate = POPULATION_RATE / static_cast<double>(n);
+    population.randomRate = rate;
+    population.marketMakerRate = rate;
+    population.momentumTraderRate = rate;
+    population.reserveActiveOrders = false;
+
+    const std::size_t residentBefore = ResidentBytes();
+    const auto buildStart = std::chrono::steady_clock::now();
+    agentManager->Populate(population, tradeDispatcher, matchingEngine,
+                           orderPool.get());
+    agentManager->WarmUp();
+    const auto buildEnd = std::chrono::steady_clock::now();
+    const std::size_t residentBuilt = ResidentBytes();
+
+    agentManager->SetRunning(true);
+    const auto runStart = std::chrono::steady_clock::now();
+    agentManager->RunLockstepLoop(matchingEngine, tradeDispatcher);
+    const auto runEnd = std::chrono::steady_clock::now();
+    agentManager->SetRunning(false);
+    const std::size_t residentRun = ResidentBytes();
+
+    const double buildMs =
+        std::chrono::duration<double, std::milli>(buildEnd - buildStart)
+            .count();
+    const double runMs =
+        std::chrono::duration<double, std::milli>(runEnd - runStart).count();
+    const std::uint64_t actions = agentManager->GetNAgentActions();
+    const double bytesPerAgent =
+        static_cast<double>(residentBuilt - residentBefore) /
+        static_cast<double>(n);
+
+    std::cout << "+---------------------------------------+" << std::endl;
+    std::cout << "| Number of agents: " << std::setw(12) << n << std::endl;
+    std::cout << "| Construction: " << std::setw(14) << std::fixed
+              << std::setprecision(2) << buildMs << " ms" << std::endl;
+    std::cout << "| RSS added by agents: " << std::setw(8)
+              << (residentBuilt - residentBefore) / (1 << 20) << " MiB"
+              << std::endl;
+    std::cout << "| RSS per agent: " << std::setw(13) << std::setprecision(0)
+              << bytesPerAgent << " bytes" << std::endl;
+    std::cout << "| RSS added by the run: " << std::setw(7)
+              << (residentRun - residentBuilt) / (1 << 20) << " MiB"
+              << std::endl;
+    std::cout << "| Mailboxes allocated: " << std::setw(8)
+              << tradeDispatcher.GetNMailboxes() << std::endl;
+    std::cout << "| Actions processed: " << std::setw(10) << actions
+              << std::endl;
+    std::cout << "| Throughput (actions/s): " << std::setw(10)
+              << std::setprecision(0)
+              << static_cast<double>(actions) / runMs * 1000.0 << std::endl;
+  }
+  std::cout << "+---------------------------------------+" << std::endl;
+  return 0;
+}
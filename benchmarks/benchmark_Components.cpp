@@ -0,0 +1,570 @@
+#include "CalenderQueue.h"
+#include "CounterRng.h"
+#include "FlatHashMap.h"
+#include "Indicators.h"
+#include "Order.h"
+#include "OrderPool.h"
+#include "Orderbook.h"
+#include "PerfCounters.h"
+#include "RingBuffer.h"
+#include "SingleThreadRingBuffer.h"
+#include "TradeDispatcher.h"
+#include "Tsc.h"
+
+#include <algorithm>
+#include <atomic>
+#include <benchmark/benchmark.h>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Microbenchmarks for the building blocks of the pipeline, so a change to one
+// of them can be measured without running the whole simulation.
+
+static constexpr std::uint64_t COMPONENT_SEED = 1;
+// Random draws made before timing starts are cycled through in this many
+static constexpr std::size_t DRAW_COUNT = 4096;
+
+// The pool reserves MAX_ORDERS slots up front, every benchmark shares one
+static OrderPool &SharedOrderPool() {
+  static OrderPool orderPool;
+  return orderPool;
+}
+
+// Adds cache misses per item to a benchmark's counters, when the machine
+// lets us count them
+static void ReportCacheMisses(benchmark::State &state,
+                              const PerfSample &sample, double items) {
+  if (sample.Has(PerfEvent::L1D_MISSES)) {
+    state.counters["L1D_misses"] = sample.Get(PerfEvent::L1D_MISSES) / items;
+  }
+  if (sample.Has(PerfEvent::LLC_MISSES)) {
+    state.counters["LLC_misses"] = sample.Get(PerfEvent::LLC_MISSES) / items;
+  }
+}
+
+// FlatHashMap
+
+static constexpr std::size_t MAP_CAPACITY = std::size_t{1} << 16;
+
+// Fills a map to range(0) percent live keys, after inserting and erasing
+// another range(1) percent so those slots are left as tombstones
+struct MapFixture {
+  FlatHashMap<std::uint64_t, std::int64_t> map{MAP_CAPACITY};
+  std::vector<std::uint64_t> live;
+  std::vector<std::uint64_t> absent;
+
+  MapFixture(std::size_t loadPercent, std::size_t tombstonePercent) {
+    CounterRng rng(COMPONENT_SEED, 0, 0);
+    const std::size_t nLive = MAP_CAPACITY * loadPercent / 100;
+    const std::size_t nDeleted = MAP_CAPACITY * tombstonePercent / 100;
+    std::vector<std::uint64_t> deleted;
+    for (std::size_t i = 0; i < nDeleted; ++i) {
+      deleted.push_back(rng.Next());
+      map.insert({deleted.back(), 0});
+    }
+    for (std::size_t i = 0; i < nLive; ++i) {
+      live.push_back(rng.Next());
+      map.insert({live.back(), static_cast<std::int64_t>(i)});
+    }
+    for (const std::uint64_t key : deleted) {
+      map.erase(key);
+    }
+    for (std::size_t i = 0; i < nLive; ++i) {
+      absent.push_back(rng.Next());
+    }
+  }
+};
+
+static void MapArguments(benchmark::internal::Benchmark *benchmark) {
+  benchmark->ArgNames({"load%", "tombstone%"});
+  for (const int load : {25, 50, 75, 90}) {
+    benchmark->Args({load, 0});
+  }
+  for (const int load : {25, 50, 75}) {
+    benchmark->Args({load, 20});
+  }
+}
+
+static void BM_FlatHashMapFindHit(benchmark::State &state) {
+  MapFixture fixture(state.range(0), state.range(1));
+  std::size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(fixture.map.find(fixture.live[i]));
+    i = (i + 1 == fixture.live.size()) ? 0 : i + 1;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FlatHashMapFindHit)->Apply(MapArguments);
+
+static void BM_FlatHashMapFindMiss(benchmark::State &state) {
+  MapFixture fixture(state.range(0), state.range(1));
+  std::size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(fixture.map.find(fixture.absent[i]));
+    i = (i + 1 == fixture.absent.size()) ? 0 : i + 1;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FlatHashMapFindMiss)->Apply(MapArguments);
+
+// Inserts a new key and erases it again, as the book does for an order that
+// rests and is later cancelled, so the load stays where the fixture left it
+static void BM_FlatHashMapInsertErase(benchmark::State &state) {
+  MapFixture fixture(state.range(0), state.range(1));
+  std::size_t i = 0;
+  for (auto _ : state) {
+    const std::uint64_t key = fixture.absent[i];
+    benchmark::DoNotOptimize(fixture.map.insert({key, 0}));
+    benchmark::DoNotOptimize(fixture.map.erase(key));
+    i = (i + 1 == fixture.absent.size()) ? 0 : i + 1;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FlatHashMapInsertErase)->Apply(MapArguments);
+
+// OrderPool
+
+static void BM_OrderPoolAllocateFree(benchmark::State &state) {
+  OrderPool &orderPool = SharedOrderPool();
+  for (auto _ : state) {
+    const PoolIndex index = orderPool.allocate();
+    benchmark::DoNotOptimize(index);
+    orderPool.deallocate(index);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_OrderPoolAllocateFree);
+
+// Block allocation as used by batched strategies, one lock per range(0) slots
+static void BM_OrderPoolAllocateBlock(benchmark::State &state) {
+  OrderPool &orderPool = SharedOrderPool();
+  const std::size_t count = state.range(0);
+  std::vector<PoolIndex> indices(count);
+  for (auto _ : state) {
+    orderPool.allocate(indices.data(), count);
+    benchmark::DoNotOptimize(indices.data());
+    for (const PoolIndex index : indices) {
+      orderPool.deallocate(index);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_OrderPoolAllocateBlock)->RangeMultiplier(4)->Range(4, 256);
+
+// Agents allocate and the matching thread frees, so the pool's lock moves
+// between cores. Slots are handed to a second thread which frees them.
+static void BM_OrderPoolCrossThread(benchmark::State &state) {
+  OrderPool &orderPool = SharedOrderPool();
+  auto freed = std::make_unique<RingBuffer<PoolIndex, 1024>>();
+  std::atomic<bool> running{true};
+  std::thread freer([&]() {
+    PoolIndex index;
+    while (running.load(std::memory_order_acquire) || !freed->empty()) {
+      if (freed->Pop(index)) {
+        orderPool.deallocate(index);
+      } else {
+        std::this_thread::yield();
+      }
+    }
+  });
+  for (auto _ : state) {
+    const PoolIndex index = orderPool.allocate();
+    while (!freed->Push(index)) {
+      std::this_thread::yield();
+    }
+  }
+  running.store(false, std::memory_order_release);
+  freer.join();
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_OrderPoolCrossThread)->UseRealTime();
+
+// Ring buffers
+
+static constexpr std::size_t RING_SIZE = 4096;
+
+// Pushes then pops range(0) items on one thread
+static void BM_SingleThreadRingBuffer(benchmark::State &state) {
+  auto ring = std::make_unique<SingleThreadRingBuffer<std::uint64_t,
+                                                      RING_SIZE>>();
+  const std::size_t count = state.range(0);
+  std::uint64_t item = 0;
+  for (auto _ : state) {
+    for (std::size_t i = 0; i < count; ++i) {
+      ring->Push(i);
+    }
+    for (std::size_t i = 0; i < count; ++i) {
+      ring->Pop(item);
+    }
+    benchmark::DoNotOptimize(item);
+  }
+  state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_SingleThreadRingBuffer)->RangeMultiplier(8)->Range(1, 1024);
+
+// Pushes then pops range(0) items on one thread, the cost of the atomics
+// without any cache line moving between cores
+static void BM_RingBufferUncontended(benchmark::State &state) {
+  auto ring = std::make_unique<RingBuffer<std::uint64_t, RING_SIZE>>();
+  const std::size_t count = state.range(0);
+  std::uint64_t item = 0;
+  for (auto _ : state) {
+    for (std::size_t i = 0; i < count; ++i) {
+      ring->Push(i);
+    }
+    for (std::size_t i = 0; i < count; ++i) {
+      ring->Pop(item);
+    }
+    benchmark::DoNotOptimize(item);
+  }
+  state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_RingBufferUncontended)->RangeMultiplier(8)->Range(1, 1024);
+
+// Producer to consumer throughput across threads, pushing range(0) items at
+// a time with the bulk push
+static void BM_RingBufferThroughput(benchmark::State &state) {
+  auto ring = std::make_unique<RingBuffer<std::uint64_t, RING_SIZE>>();
+  const std::size_t count = state.range(0);
+  std::vector<std::uint64_t> items(count, 1);
+  std::atomic<bool> running{true};
+  std::thread consumer([&]() {
+    std::uint64_t item;
+    std::uint64_t sum = 0;
+    while (running.load(std::memory_order_acquire) || !ring->empty()) {
+      if (ring->Pop(item)) {
+        sum += item;
+      } else {
+        std::this_thread::yield();
+      }
+    }
+    benchmark::DoNotOptimize(sum);
+  });
+  for (auto _ : state) {
+    std::size_t pushed = 0;
+    while (pushed < count) {
+      const std::size_t n = ring->Push(items.data() + pushed, count - pushed);
+      if (n == 0) {
+        std::this_thread::yield();
+      }
+      pushed += n;
+    }
+  }
+  running.store(false, std::memory_order_release);
+  consumer.join();
+  state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_RingBufferThroughput)
+    ->RangeMultiplier(8)
+    ->Range(1, 512)
+    ->UseRealTime();
+
+// Round trip through a pair of rings and an echo thread, the time for an
+// item to be seen by another core and answered
+static void BM_RingBufferPingPong(benchmark::State &state) {
+  auto ping = std::make_unique<RingBuffer<std::uint64_t, RING_SIZE>>();
+  auto pong = std::make_unique<RingBuffer<std::uint64_t, RING_SIZE>>();
+  std::atomic<bool> running{true};
+  std::thread echo([&]() {
+    std::uint64_t item;
+    while (running.load(std::memory_order_acquire)) {
+      if (ping->Pop(item)) {
+        while (!pong->Push(item)) {
+        }
+      } else {
+        std::this_thread::yield();
+      }
+    }
+  });
+  std::uint64_t item = 0;
+  for (auto _ : state) {
+    while (!ping->Push(item)) {
+    }
+    while (!pong->Pop(item)) {
+      std::this_thread::yield();
+    }
+    ++item;
+  }
+  running.store(false, std::memory_order_release);
+  echo.join();
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RingBufferPingPong)->UseRealTime();
+
+// CalenderQueue
+
+struct TimedEvent {
+  double time;
+  std::size_t id;
+};
+
+constexpr inline auto timedEventAccessor = [](const TimedEvent &event) {
+  return event.time;
+};
+
+// Hold model: range(0) events pending with Poisson arrivals, every pop
+// schedules the same event again one exponential interval later
+static void BM_CalenderQueueHold(benchmark::State &state) {
+  auto queue = std::make_unique<
+      CalenderQueue<TimedEvent, 1024, decltype(timedEventAccessor)>>();
+  const std::size_t nEvents = state.range(0);
+  const double rate = 1.0;
+  CounterRng rng(COMPONENT_SEED, 0, 0);
+  for (std::size_t i = 0; i < nEvents; ++i) {
+    queue->Push(TimedEvent{rng.Exponential(rate), i});
+  }
+  // Intervals are drawn up front so the loop only times the queue
+  std::vector<double> intervals(DRAW_COUNT);
+  rng.FillExponential(rate, intervals.data(), intervals.size());
+  TimedEvent event;
+  std::size_t i = 0;
+  for (auto _ : state) {
+    queue->Pop(event);
+    event.time += intervals[i];
+    queue->Push(std::move(event));
+    i = (i + 1) & (DRAW_COUNT - 1);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CalenderQueueHold)->RangeMultiplier(8)->Range(64, 32768);
+
+// Orderbook
+
+static constexpr Price ORDERBOOK_MID = 110;
+static constexpr std::size_t ORDERBOOK_LEVELS = 50;
+
+// Builds a book holding range(0) orders per side spread over the
+// ORDERBOOK_LEVELS ticks either side of the mid. The dispatcher isn't
+// started, reports are drained on this thread. Orders still resting when the
+// fixture goes away aren't handed back to the shared pool, which has room for
+// far more than the benchmarks leave behind. Cancels and aggressors are built
+// in a scratch slot, as the book reads their client from the pool.
+class OrderbookFixture {
+public:
+  explicit OrderbookFixture(std::size_t depth)
+      : orderPool_(SharedOrderPool()),
+        orderbook_(std::make_unique<Orderbook>(&orderPool_, tradeDispatcher_)),
+        scratchIndex_(orderPool_.allocate()) {
+    for (std::size_t i = 0; i < depth; ++i) {
+      const std::size_t level = i % ORDERBOOK_LEVELS;
+      orderbook_->AddOrder(NewOrder(Side::Buy, BidPrice(level)));
+      orderbook_->AddOrder(NewOrder(Side::Sell, AskPrice(level)));
+    }
+    Drain();
+  }
+
+  Order *NewOrder(Side side, Price price) {
+    const PoolIndex index = orderPool_.allocate();
+    Order *order = orderPool_.get_order(index);
+    *order = Order(nextId_++, OrderType::LIMIT, side, price, 10);
+    order->SetIndex(index);
+    *orderPool_.get_info(index) = OrderInfo{0, 10, 0};
+    return order;
+  }
+
+  Order *Scratch(const Order &order) {
+    Order *scratch = orderPool_.get_order(scratchIndex_);
+    *scratch = order;
+    scratch->SetIndex(scratchIndex_);
+    return scratch;
+  }
+
+  void Drain() {
+    orderbook_->DispatchTrades();
+    while (tradeDispatcher_.Drain(0) > 0) {
+    }
+  }
+
+  static Price BidPrice(std::size_t level) {
+    return ORDERBOOK_MID - 0.01 * static_cast<double>(level + 1);
+  }
+  static Price AskPrice(std::size_t level) {
+    return ORDERBOOK_MID + 0.01 * static_cast<double>(level);
+  }
+
+  Orderbook &orderbook() { return *orderbook_; }
+
+private:
+  TradeDispatcher tradeDispatcher_;
+  OrderPool &orderPool_;
+  std::unique_ptr<Orderbook> orderbook_;
+  PoolIndex scratchIndex_;
+  OrderId nextId_{0};
+};
+
+// Rests a limit order somewhere in the book and cancels it again
+static void BM_OrderbookAddCancel(benchmark::State &state) {
+  OrderbookFixture fixture(state.range(0));
+  Orderbook &orderbook = fixture.orderbook();
+  CounterRng rng(COMPONENT_SEED, 0, 0);
+  std::vector<std::uint64_t> draws(DRAW_COUNT);
+  for (auto &draw : draws) {
+    draw = rng.Next();
+  }
+  PerfCounters counters;
+  std::size_t i = 0;
+  counters.Start();
+  for (auto _ : state) {
+    const std::size_t level = (draws[i] >> 1) % ORDERBOOK_LEVELS;
+    const bool buy = draws[i] & 1;
+    const Side side = buy ? Side::Buy : Side::Sell;
+    const Price price = buy ? OrderbookFixture::BidPrice(level)
+                            : OrderbookFixture::AskPrice(level);
+    Order *order = fixture.NewOrder(side, price);
+    orderbook.AddOrder(order);
+    orderbook.CancelOrder(fixture.Scratch(
+        Order(order->GetOrderId(), OrderType::CANCEL, side, price, 0)));
+    fixture.Drain();
+    i = (i + 1) & (DRAW_COUNT - 1);
+  }
+  counters.Stop();
+  state.SetItemsProcessed(state.iterations());
+  ReportCacheMisses(state, counters.Read(), state.iterations());
+}
+BENCHMARK(BM_OrderbookAddCancel)
+    ->ArgName("depth")
+    ->RangeMultiplier(8)
+    ->Range(64, 32768);
+
+// Rests range(0) quotes from one client among a default depth book and takes
+// them out again, with a cancel per quote or with a single mass cancel
+static void BM_OrderbookMassCancel(benchmark::State &state) {
+  OrderbookFixture fixture(4096);
+  Orderbook &orderbook = fixture.orderbook();
+  OrderPool &orderPool = SharedOrderPool();
+  const auto nQuotes = static_cast<std::size_t>(state.range(0));
+  const bool mass = state.range(1) != 0;
+  std::vector<Order> quotes(nQuotes);
+  PerfCounters counters;
+  counters.Start();
+  for (auto _ : state) {
+    for (std::size_t i = 0; i < nQuotes; ++i) {
+      Order *order = fixture.NewOrder(
+          Side::Buy, OrderbookFixture::BidPrice(i % ORDERBOOK_LEVELS));
+      orderPool.get_info(order->GetIndex())->clientRef = 1;
+      orderbook.AddOrder(order);
+      quotes[i] = *order;
+    }
+    if (mass) {
+      Order massCancel(0, OrderType::MASS_CANCEL, Side::Buy, 0, 0);
+      Order *scratch = fixture.Scratch(massCancel);
+      orderPool.get_info(scratch->GetIndex())->clientRef = 1;
+      orderbook.MassCancel(scratch);
+    } else {
+      for (const Order &quote : quotes) {
+        orderbook.CancelOrder(
+            fixture.Scratch(Order(quote.GetOrderId(), OrderType::CANCEL,
+                                  Side::Buy, quote.GetPrice(), 0)));
+      }
+    }
+    fixture.Drain();
+  }
+  counters.Stop();
+  state.SetItemsProcessed(state.iterations() * nQuotes);
+  ReportCacheMisses(state, counters.Read(), state.iterations() * nQuotes);
+}
+BENCHMARK(BM_OrderbookMassCancel)
+    ->ArgNames({"quotes", "mass"})
+    ->ArgsProduct({{1, 8, 64, 512}, {0, 1}});
+
+// Fills the order at the head of the best ask and rests a replacement at the
+// back of the same level, so the depth stays constant
+static void BM_OrderbookFill(benchmark::State &state) {
+  OrderbookFixture fixture(state.range(0));
+  Orderbook &orderbook = fixture.orderbook();
+  PerfCounters counters;
+  counters.Start();
+  for (auto _ : state) {
+    const std::uint64_t bestAsk = *orderbook.GetBestAsk();
+    const Price price = orderbook.IndexToPrice(bestAsk);
+    orderbook.FillOrder(
+        fixture.Scratch(Order(0, OrderType::MARKET, Side::Buy, price, 10)),
+        bestAsk);
+    orderbook.AddOrder(fixture.NewOrder(Side::Sell, price));
+    fixture.Drain();
+  }
+  counters.Stop();
+  state.SetItemsProcessed(state.iterations());
+  ReportCacheMisses(state, counters.Read(), state.iterations());
+}
+BENCHMARK(BM_OrderbookFill)
+    ->ArgName("depth")
+    ->RangeMultiplier(8)
+    ->Range(64, 32768);
+
+// Queues range(0) orders at one price and lifts the whole queue with a single
+// aggressor, walking the level's links from head to tail. Only the walk is
+// timed, with the TSC as manual time since pausing the benchmark clock costs
+// more than the shorter walks, and counted, per resting order filled.
+static void BM_OrderbookSweep(benchmark::State &state) {
+  const std::size_t queue = state.range(0);
+  OrderbookFixture fixture(0);
+  Orderbook &orderbook = fixture.orderbook();
+  PerfCounters counters;
+  PerfSample total;
+  for (auto _ : state) {
+    for (std::size_t i = 0; i < queue; ++i) {
+      orderbook.AddOrder(fixture.NewOrder(Side::Sell, ORDERBOOK_MID));
+    }
+    fixture.Drain();
+    Order *aggressor = fixture.Scratch(Order(0, OrderType::MARKET, Side::Buy,
+                                             ORDERBOOK_MID, 10 * queue));
+    counters.Start();
+    const std::uint64_t start = ReadTsc();
+    while (!aggressor->isFilled()) {
+      orderbook.FillOrder(aggressor, *orderbook.GetBestAsk());
+    }
+    const std::uint64_t end = ReadTscp();
+    counters.Stop();
+    state.SetIterationTime(TscToNs(end - start) * 1e-9);
+    const PerfSample sample = counters.Read();
+    for (std::size_t e = 0; e < N_PERF_EVENTS; ++e) {
+      total.values[e] += sample.values[e];
+      total.valid[e] = sample.valid[e];
+    }
+    fixture.Drain();
+  }
+  const double fills = static_cast<double>(state.iterations() * queue);
+  state.SetItemsProcessed(state.iterations() * queue);
+  ReportCacheMisses(state, total, fills);
+}
+BENCHMARK(BM_OrderbookSweep)
+    ->UseManualTime()
+    ->ArgName("queue")
+    ->RangeMultiplier(4)
+    ->Range(8, 2048);
+
+// IndicatorService
+
+// One trade and a new top of book per update, the mid moving by a tick or
+// two either way, as the engine feeds the service after a crossing order
+static void BM_IndicatorUpdate(benchmark::State &state) {
+  CounterRng rng(COMPONENT_SEED, 0, 0);
+  std::vector<std::uint64_t> draws(DRAW_COUNT);
+  for (auto &draw : draws) {
+    draw = rng.Next();
+  }
+  IndicatorService indicators;
+  TopOfBook top{109.99, 110.01, 0, 100, 100, 0, 0};
+  std::size_t i = 0;
+  for (auto _ : state) {
+    const std::uint64_t draw = draws[i];
+    const double move = 0.01 * (static_cast<double>(draw % 5) - 2);
+    top.bid = std::clamp(top.bid + move, 100.0, 119.98);
+    top.ask = top.bid + 0.01 * static_cast<double>(1 + (draw >> 8) % 3);
+    top.bidSize = 10 * static_cast<Quantity>(1 + (draw >> 16) % 20);
+    top.askSize = 10 * static_cast<Quantity>(1 + (draw >> 24) % 20);
+    ++top.seq;
+    indicators.OnTrade(PriceToTicks(top.ask), 10);
+    indicators.OnTop(top, top.seq);
+    i = (i + 1) & (DRAW_COUNT - 1);
+  }
+  benchmark::DoNotOptimize(indicators.Load());
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_IndicatorUpdate);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,100 @@
+#include "FeedFile.h"
+#include "HdrHistogram.h"
+#include "LatencyProbes.h"
+#include "MatchingEngine.h"
+#include "Order.h"
+#include "OrderPool.h"
+#include "Orderbook.h"
+#include "TradeDispatcher.h"
+#include "Tsc.h"
+
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <type_traits>
+
+// Replays a feed file written by feedgen straight out of its mapping into the
+// matching engine, so every build is measured against the same messages
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    std::cerr << "Usage: benchmark_feedreplay <feed file>" << std::endl;
+    return 2;
+  }
+
+  try {
+    FeedReader feed(argv[1]);
+
+    TradeDispatcher tradeDispatcher;
+    OrderPool orderPool;
+    Orderbook orderbook(&orderPool, tradeDispatcher);
+    MatchingEngine matchingEngine(orderbook, &orderPool);
+
+    auto submit = [&](OrderType type, OrderId id, Side side, Price price,
+                      Quantity quantity) {
+      PoolIndex slot = orderPool.allocate();
+      Order *order = orderPool.get_order(slot);
+      order->SetOrderId(id);
+      order->SetOrderType(type);
+      order->SetSide(side);
+      order->SetPrice(price);
+      order->SetRemainingQuantity(quantity);
+      order->SetIndex(slot);
+      *orderPool.get_info(slot) = OrderInfo{0, quantity, 0};
+      matchingEngine.ProcessOrder(order);
+    };
+
+    HdrHistogram latencies;
+    tradeDispatcher.Start();
+    auto loop_start = std::chrono::steady_clock::now();
+    feed.ForEach([&](const auto &message) {
+      using Message = std::decay_t<decltype(message)>;
+      std::uint64_t start = ReadTsc();
+      if constexpr (std::is_same_v<Message, FeedAdd>) {
+        submit(OrderType::LIMIT, message.id, FeedToSide(message.side),
+               FeedToPrice(message.price), message.quantity);
+      } else if constexpr (std::is_same_v<Message, FeedCancel>) {
+        submit(OrderType::CANCEL, message.id, FeedToSide(message.side),
+               FeedToPrice(message.price), 0);
+      } else if constexpr (std::is_same_v<Message, FeedReplace>) {
+        submit(OrderType::CANCEL, message.id, FeedToSide(message.side),
+               FeedToPrice(message.price), 0);
+        submit(OrderType::LIMIT, message.newId, FeedToSide(message.side),
+               FeedToPrice(message.newPrice), message.newQuantity);
+      } else if constexpr (std::is_same_v<Message, FeedExecute>) {
+        submit(OrderType::MARKET, message.id, FeedToSide(message.side),
+               FeedToPrice(message.price), message.quantity);
+      }
+      latencies.Record(ReadTscp() - start);
+    });
+    auto loop_end = std::chrono::steady_clock::now();
+    tradeDispatcher.Stop();
+
+    double total_messages = latencies.count();
+    double duration_ms =
+        std::chrono::duration<double, std::milli>(loop_end - loop_start)
+            .count();
+    double throughput_msgs_per_sec = (total_messages / duration_ms) * 1000.0;
+
+    std::cout << "+---------------------------------------+" << std::endl;
+    std::cout << "| Messages replayed: " << std::setw(10) << std::fixed
+              << std::setprecision(0) << total_messages << std::endl;
+    std::cout << "| Orders processed: " << std::setw(11)
+              << matchingEngine.GetProcessedOrders() << std::endl;
+    std::cout << "| Duration: " << std::setw(12) << std::fixed
+              << std::setprecision(2) << duration_ms << " ms" << std::endl;
+    std::cout << "| Throughput: " << std::setw(10) << std::fixed
+              << std::setprecision(0) << throughput_msgs_per_sec
+              << " msgs/sec" << std::endl;
+    std::cout << "+---------------------------------------+" << std::endl;
+    PrintLatencyHeader("Message Latency (ns)");
+    PrintLatencyRow("All messages", latencies);
+    PrintLatencyReport();
+    return 0;
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return 2;
+  }
+}
@@ -0,0 +1,186 @@
+#include "BookBuilder.h"
+#include "HdrHistogram.h"
+#include "LatencyProbes.h"
+#include "MarketDataFeed.h"
+#include "MatchingEngine.h"
+#include "Order.h"
+#include "OrderPool.h"
+#include "Orderbook.h"
+#include "TradeDispatcher.h"
+#include "Tsc.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Feeds random orders through the engine with two subscribers on the market
+// data feed, one polling flat out and one that sleeps between polls and so
+// keeps falling a full stream behind. The engine must never wait for either,
+// and once it stops both rebuilt books must match the engine's level for
+// level, the slow one after resyncing from an image.
+static constexpr int MARKET_DATA_ORDERS = 2'000'000;
+static constexpr std::size_t MARKET_DATA_POOL_CAPACITY = std::size_t{1} << 22;
+static constexpr std::size_t MARKET_DATA_MAP_CAPACITY = std::size_t{1} << 22;
+static constexpr auto SLOW_POLL_GAP = std::chrono::milliseconds(20);
+
+struct Subscriber {
+  std::string label;
+  std::unique_ptr<BookBuilder> builder;
+  std::size_t mismatches{0};
+};
+
+static std::uint32_t EngineBestBid(const Orderbook &book) {
+  for (int level = MAX_PRICE_LEVELS - 1; level >= 0; --level) {
+    if (book.GetLevelQuantity(Side::Buy, level) > 0) {
+      return static_cast<std::uint32_t>(level);
+    }
+  }
+  return INVALID_BOOK_LEVEL;
+}
+
+static std::uint32_t EngineBestAsk(const Orderbook &book) {
+  for (int level = 0; level < MAX_PRICE_LEVELS; ++level) {
+    if (book.GetLevelQuantity(Side::Sell, level) > 0) {
+      return static_cast<std::uint32_t>(level);
+    }
+  }
+  return INVALID_BOOK_LEVEL;
+}
+
+static std::size_t CompareBooks(const BookBuilder &builder,
+                                const Orderbook &book) {
+  std::size_t mismatches = 0;
+  for (int level = 0; level < MAX_PRICE_LEVELS; ++level) {
+    mismatches += builder.GetBidQuantity(level) !=
+                  book.GetLevelQuantity(Side::Buy, level);
+    mismatches += builder.GetAskQuantity(level) !=
+                  book.GetLevelQuantity(Side::Sell, level);
+  }
+  mismatches += builder.GetBestBidLevel() != EngineBestBid(book);
+  mismatches += builder.GetBestAskLevel() != EngineBestAsk(book);
+  return mismatches;
+}
+
+int main() {
+  std::bernoulli_distribution bernoulli_distribution(0.5);
+  std::bernoulli_distribution bernoulli_distribution_cancel(0.05);
+  std::normal_distribution<> normal_distribution(0, 5);
+  std::mt19937 gen(7);
+
+  TradeDispatcher tradeDispatcher;
+  auto orderPool = std::make_unique<OrderPool>(MARKET_DATA_POOL_CAPACITY);
+  auto orderbook = std::make_unique<Orderbook>(
+      orderPool.get(), tradeDispatcher, MARKET_DATA_MAP_CAPACITY);
+  MatchingEngine matchingEngine(*orderbook, orderPool.get());
+  matchingEngine.GetLedger().Open(0, INT64_MAX / 4, INT64_MAX / 4);
+  MarketDataFeed feed(2);
+  orderbook->AttachMarketDataFeed(&feed);
+
+  std::vector<Order *> orders;
+  orders.reserve(MARKET_DATA_ORDERS + MARKET_DATA_ORDERS / 10);
+  for (int i = 0; i < MARKET_DATA_ORDERS; ++i) {
+    if (bernoulli_distribution_cancel(gen) && i > 100) {
+      Order *selectedOrder = orders[orders.size() - (gen() % 100 + 1)];
+      PoolIndex index = orderPool->allocate();
+      Order *cancelOrder = orderPool->get_order(index);
+      cancelOrder->SetOrderId(i);
+      cancelOrder->SetOrderType(OrderType::CANCEL);
+      cancelOrder->SetSide(selectedOrder->GetSide());
+      cancelOrder->SetPrice(selectedOrder->GetPrice());
+      cancelOrder->SetRemainingQuantity(0);
+      cancelOrder->SetIndex(index);
+      *orderPool->get_info(index) = OrderInfo{0, 0, 0};
+      orders.push_back(cancelOrder);
+    }
+    Price price = std::round((110 + normal_distribution(gen)) * 100.0) / 100.0;
+    Quantity quantity =
+        std::round((10 + normal_distribution(gen)) * 100.0) / 100.0;
+    PoolIndex index = orderPool->allocate();
+    Order *order = orderPool->get_order(index);
+    order->SetOrderId(i);
+    order->SetOrderType(bernoulli_distribution(gen) ? OrderType::LIMIT
+                                                    : OrderType::MARKET);
+    order->SetSide(bernoulli_distribution(gen) ? Side::Buy : Side::Sell);
+    order->SetPrice(price);
+    order->SetRemainingQuantity(quantity);
+    order->SetIndex(index);
+    *orderPool->get_info(index) = OrderInfo{0, quantity, 0};
+    orders.push_back(order);
+  }
+
+  Subscriber subscribers[2] = {
+      {"Fast subscriber", std::make_unique<BookBuilder>(feed, 0)},
+      {"Slow subscriber", std::make_unique<BookBuilder>(feed, 1)}};
+  std::atomic<bool> running{true};
+  std::thread fast([&] {
+    while (running.load(std::memory_order_acquire)) {
+      subscribers[0].builder->Poll();
+    }
+  });
+  std::thread slow([&] {
+    while (running.load(std::memory_order_acquire)) {
+      subscribers[1].builder->Poll();
+      std::this_thread::sleep_for(SLOW_POLL_GAP);
+    }
+  });
+
+  HdrHistogram latencies;
+  tradeDispatcher.Start();
+  const auto loop_start = std::chrono::steady_clock::now();
+  for (Order *order : orders) {
+    const std::uint64_t start = ReadTsc();
+    matchingEngine.ProcessOrder(order);
+    latencies.Record(ReadTscp() - start);
+  }
+  const auto loop_end = std::chrono::steady_clock::now();
+  running.store(false, std::memory_order_release);
+  fast.join();
+  slow.join();
+  tradeDispatcher.Stop();
+
+  // The engine has stopped, so this thread stands in for it to publish the
+  // image any dropped subscriber is still waiting on
+  std::size_t mismatches = 0;
+  for (Subscriber &subscriber : subscribers) {
+    subscriber.builder->Poll();
+    if (!subscriber.builder->IsSynced()) {
+      orderbook->PublishMarketData(matchingEngine.GetProcessedOrders());
+      subscriber.builder->Poll();
+    }
+    subscriber.mismatches = subscriber.builder->IsSynced()
+                                ? CompareBooks(*subscriber.builder, *orderbook)
+                                : MAX_PRICE_LEVELS * 2;
+    mismatches += subscriber.mismatches;
+  }
+
+  const double duration_ms =
+      std::chrono::duration<double, std::milli>(loop_end - loop_start)
+          .count();
+  std::cout << "+---------------------------------------+" << std::endl;
+  std::cout << "| Orders processed: " << std::setw(10) << orders.size()
+            << std::endl;
+  std::cout << "| Throughput: " << std::setw(10) << std::fixed
+            << std::setprecision(0) << orders.size() / duration_ms * 1000.0
+            << " ops/sec" << std::endl;
+  std::cout << "| Subscribers dropped: " << std::setw(7) << feed.GetDropped()
+            << std::endl;
+  for (const Subscriber &subscriber : subscribers) {
+    std::cout << "| " << subscriber.label << ": "
+              << subscriber.builder->GetResyncs() << " resyncs, "
+              << subscriber.mismatches << " mismatched levels" << std::endl;
+  }
+  std::cout << "+---------------------------------------+" << std::endl;
+  PrintLatencyHeader("Order Latency With Subscribers (ns)");
+  PrintLatencyRow("ProcessOrder", latencies);
+  return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
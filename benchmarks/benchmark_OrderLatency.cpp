@@ -1,16 +1,38 @@
 #include "Agent.h"
 #include "AgentStrategy.h"
+#include "HdrHistogram.h"
+#include "LatencyProbes.h"
 #include "MatchingEngine.h"
 #include "Order.h"
 #include "Orderbook.h"
+#include "PerfCounters.h"
 #include "TradeDispatcher.h"
+#include "Tsc.h"
 
+#include <algorithm>
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
 #include <memory>
 #include <random>
 #include <ratio>
+#include <string>
+#include <thread>
 #include <vector>
 
+// The bursty phase feeds a running engine thread, first saturated and then
+// in bursts with idle gaps between them, once popping one order at a time
+// and once a full batch with prefetching. Orders are stamped as their burst
+// is pushed, so the engine sojourn includes waiting behind the rest of it.
+// Throughput is only reported for the saturated runs, as the bursty ones
+// spend most of their time in the gaps.
+static constexpr int BURSTY_ORDERS = 1'000'000;
+static constexpr std::size_t BURST_SIZE = 512;
+static constexpr auto BURST_GAP = std::chrono::microseconds(200);
+static constexpr std::size_t BURSTY_POOL_CAPACITY = std::size_t{1} << 21;
+static constexpr std::size_t BURSTY_MAP_CAPACITY = std::size_t{1} << 22;
+
 int main() {
   std::bernoulli_distribution bernoulli_distribution(0.5);
   std::bernoulli_distribution bernoulli_distribution_cancel(0.05);
@@ -22,27 +44,27 @@ int main() {
   Orderbook orderbook(&orderPool, tradeDispatcher);
   MatchingEngine matchingEngine(orderbook, &orderPool);
 
-  std::unique_ptr<Agent> agent =
-      std::make_unique<Agent>(tradeDispatcher, matchingEngine,
-                              Random(&orderbook, &orderPool, 0.5), 0, 1);
+  Agent agent(tradeDispatcher, matchingEngine, 0, 1);
+  // The one client trades with itself, fund it so the ledger never rejects
+  // the generated flow
+  matchingEngine.GetLedger().Open(0, INT64_MAX / 4, INT64_MAX / 4);
 
-  auto CreateRandomOrders = [&]() {
+  auto CreateRandomOrders = [&](OrderPool &pool, int count) {
     std::vector<Order *> orders;
-    for (int i = 0; i < 5'000'000; ++i) {
+    for (int i = 0; i < count; ++i) {
       bool cancel_result = bernoulli_distribution_cancel(gen);
       if (cancel_result && i > 100) {
         auto selectedIndex = std::rand() % 100 + 1;
         Order *selectedOrder = orders[i - selectedIndex];
-        PoolIndex index = orderPool.allocate();
-        Order *cancelOrder = orderPool.get_order(index);
+        PoolIndex index = pool.allocate();
+        Order *cancelOrder = pool.get_order(index);
         cancelOrder->SetOrderId(i);
         cancelOrder->SetOrderType(OrderType::CANCEL);
-        cancelOrder->GetClientRef(0);
         cancelOrder->SetSide(selectedOrder->GetSide());
         cancelOrder->SetPrice(selectedOrder->GetPrice());
-        cancelOrder->SetInitialQuantity(0);
         cancelOrder->SetRemainingQuantity(0);
         cancelOrder->SetIndex(index);
+        *pool.get_info(index) = OrderInfo{0, 0, 0};
 
         orders.push_back(cancelOrder);
       }
@@ -64,60 +86,52 @@ int main() {
       } else {
         orderType = OrderType::MARKET;
       }
-      PoolIndex index = orderPool.allocate();
-      Order *order = orderPool.get_order(index);
+      PoolIndex index = pool.allocate();
+      Order *order = pool.get_order(index);
       order->SetOrderId(i);
       order->SetOrderType(orderType);
-      order->GetClientRef(0);
       order->SetSide(side);
       order->SetPrice(price);
-      order->SetInitialQuantity(quantity);
       order->SetRemainingQuantity(quantity);
       order->SetIndex(index);
+      *pool.get_info(index) = OrderInfo{0, quantity, 0};
 
       orders.push_back(order);
     }
     return orders;
   };
 
-  std::vector<Order *> orders = CreateRandomOrders();
-  std::vector<double> latencies;
-  latencies.reserve(10'000'000);
+  PerfCounters createCounters;
+  createCounters.Start();
+  std::vector<Order *> orders = CreateRandomOrders(orderPool, 5'000'000);
+  createCounters.Stop();
+  HdrHistogram latencies;
 
+  PerfCounters processCounters;
+  tradeDispatcher.Start();
+  processCounters.Start();
   auto loop_start = std::chrono::steady_clock::now();
   for (auto order : orders) {
-    auto start = std::chrono::steady_clock::now();
+    std::uint64_t start = ReadTsc();
     matchingEngine.ProcessOrder(std::move(order));
-    auto end = std::chrono::steady_clock::now();
-    double ms = std::chrono::duration<double, std::nano>(end - start).count();
-    latencies.push_back(ms);
+    latencies.Record(ReadTscp() - start);
   }
   auto loop_end = std::chrono::steady_clock::now();
+  processCounters.Stop();
+  tradeDispatcher.Stop();
 
-  std::sort(latencies.begin(), latencies.end());
-  double total_operations = latencies.size();
+  double total_operations = latencies.count();
   double duration_ms =
       std::chrono::duration<double, std::milli>(loop_end - loop_start).count();
   double throughput_ops_per_sec = (total_operations / duration_ms) * 1000.0;
 
-  double avg_latency_ns;
-  double p50_latency_ns;
-  double p95_latency_ns;
-  double p99_latency_ns;
-  double p999_latency_ns;
-  double p9999_latency_ns;
-  double max_latency_ns;
-
-  if (!latencies.empty()) {
-    avg_latency_ns = std::accumulate(latencies.begin(), latencies.end(), 0.0) /
-                     latencies.size();
-    p50_latency_ns = latencies[latencies.size() * 50 / 100];
-    p95_latency_ns = latencies[latencies.size() * 95 / 100];
-    p99_latency_ns = latencies[latencies.size() * 99 / 100];
-    p999_latency_ns = latencies[latencies.size() * 999 / 1000];
-    p9999_latency_ns = latencies[latencies.size() * 9999 / 10000];
-    max_latency_ns = latencies.back();
-  }
+  double avg_latency_ns = latencies.mean() / TscTicksPerNs();
+  double p50_latency_ns = TscToNs(latencies.ValueAtPercentile(50));
+  double p95_latency_ns = TscToNs(latencies.ValueAtPercentile(95));
+  double p99_latency_ns = TscToNs(latencies.ValueAtPercentile(99));
+  double p999_latency_ns = TscToNs(latencies.ValueAtPercentile(99.9));
+  double p9999_latency_ns = TscToNs(latencies.ValueAtPercentile(99.99));
+  double max_latency_ns = TscToNs(latencies.max());
 
   std::cout << "+---------------------------------------+" << std::endl;
   std::cout << "| Orders processed: " << std::setw(10) << std::fixed
@@ -151,4 +165,89 @@ int main() {
   }
 
   std::cout << "+---------------------------------------+" << std::endl;
+  PrintPerfReport("creating orders", createCounters.Read(), orders.size());
+  PrintPerfReport("processing orders", processCounters.Read(), orders.size());
+  PrintLatencyReport();
+
+  struct BurstyRun {
+    std::string label;
+    bool bursty;
+    double throughput;
+    HdrHistogram sojourn;
+  };
+  auto RunBursty = [&](std::size_t drainBatch, bool gaps) {
+    TradeDispatcher dispatcher;
+    auto pool = std::make_unique<OrderPool>(BURSTY_POOL_CAPACITY);
+    auto book = std::make_unique<Orderbook>(pool.get(), dispatcher,
+                                            BURSTY_MAP_CAPACITY);
+    MatchingEngine engine(*book, pool.get());
+    engine.GetLedger().Open(0, INT64_MAX / 4, INT64_MAX / 4);
+    engine.SetDrainBatch(drainBatch);
+    std::vector<Order *> burstyOrders =
+        CreateRandomOrders(*pool, BURSTY_ORDERS);
+
+    dispatcher.Start();
+    ResetLatencyProbes();
+    std::thread engineThread([&] { engine.Start(); });
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t begin = 0; begin < burstyOrders.size();
+         begin += BURST_SIZE) {
+      const std::size_t end =
+          std::min(begin + BURST_SIZE, burstyOrders.size());
+      const Timestamp stamp = OrderTimestamp();
+      for (std::size_t i = begin; i < end; ++i) {
+        pool->get_info(burstyOrders[i]->GetIndex())->timestamp = stamp;
+      }
+      std::size_t pushed = begin;
+      while (pushed < end) {
+        pushed += engine.Submit(burstyOrders.data() + pushed, end - pushed);
+        if (pushed < end) {
+          std::this_thread::yield();
+        }
+      }
+      if (gaps) {
+        const auto gapEnd = std::chrono::steady_clock::now() + BURST_GAP;
+        while (std::chrono::steady_clock::now() < gapEnd) {
+          std::this_thread::yield();
+        }
+      }
+    }
+    engine.Stop();
+    engineThread.join();
+    const auto finish = std::chrono::steady_clock::now();
+    dispatcher.Stop();
+
+    const double ms =
+        std::chrono::duration<double, std::milli>(finish - start).count();
+    return BurstyRun{
+        "Drain batch " + std::to_string(drainBatch) +
+            (gaps ? ", bursty" : ", saturated"),
+        gaps, static_cast<double>(engine.GetProcessedOrders()) / ms * 1000.0,
+        GetLatency(ProbeStage::SOJOURN)};
+  };
+
+  std::vector<BurstyRun> burstyRuns;
+  for (bool gaps : {false, true}) {
+    for (std::size_t drainBatch : {std::size_t{1}, ENGINE_DRAIN_BATCH}) {
+      burstyRuns.push_back(RunBursty(drainBatch, gaps));
+    }
+  }
+
+  std::cout << "+---------------------------------------+" << std::endl;
+  std::cout << "| Engine thread, bursts of " << BURST_SIZE << " orders"
+            << std::endl;
+  for (const BurstyRun &run : burstyRuns) {
+    std::cout << "| " << std::left << std::setw(28) << run.label << std::right;
+    if (run.bursty) {
+      std::cout << std::setw(10) << "-" << " (sojourn only)" << std::endl;
+      continue;
+    }
+    std::cout << std::setw(10) << std::fixed << std::setprecision(0)
+              << run.throughput << " ops/sec" << std::endl;
+  }
+  std::cout << "+---------------------------------------+" << std::endl;
+  PrintLatencyHeader("Engine Sojourn Under Load (ns)");
+  for (const BurstyRun &run : burstyRuns) {
+    PrintLatencyRow(run.label, run.sojourn);
+  }
 }
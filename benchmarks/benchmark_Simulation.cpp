@@ -2,6 +2,7 @@
 #include "AgentManager.h"
 #include "AgentStrategy.h"
 #include "AgentStrategyFactory.h"
+#include "LatencyProbes.h"
 #include "Orderbook.h"
 #include "TradeDispatcher.h"
 
@@ -17,7 +18,7 @@ static void BM_Simulation(benchmark::State &state) {
     Orderbook orderbook(&orderPool, tradeDispatcher);
     MatchingEngine matchingEngine(orderbook, &orderPool);
     std::uint64_t maxTime{100'000};
-    AgentManager agentManager_(maxTime);
+    AgentManager agentManager_(maxTime, orderbook);
     size_t nRandom = state.range(0);
     size_t nMarketMaker = state.range(0);
     size_t nMomentumTrader = state.range(0);
@@ -25,41 +26,42 @@ static void BM_Simulation(benchmark::State &state) {
     double randomRate{1}, marketMakerRate{1}, momentumTraderRate{1};
 
     for (size_t i = 0; i < nRandom; ++i) {
-      agentManager_.AddAgent(std::make_unique<Agent>(
-          tradeDispatcher, matchingEngine,
-          MakeStrategyRandom(&orderbook, &orderPool, 1),
-          i + (nRandom + nMarketMaker), momentumTraderRate));
+      agentManager_.AddAgent(
+          Agent(tradeDispatcher, matchingEngine, i, randomRate),
+          MakeStrategyRandom(&orderPool, 1));
     }
 
     for (size_t i = 0; i < nMarketMaker; ++i) {
-      agentManager_.AddAgent(std::make_unique<Agent>(
-          tradeDispatcher, matchingEngine,
-          MakeStrategyMarketMaker(&orderbook, &orderPool, 0.02),
-          i + (nRandom + nMarketMaker), momentumTraderRate));
+      agentManager_.AddAgent(
+          Agent(tradeDispatcher, matchingEngine, i + nRandom, marketMakerRate),
+          MakeStrategyMarketMaker(&orderPool, 0.02));
     }
 
     for (size_t i = 0; i < nMomentumTrader; ++i) {
-      agentManager_.AddAgent(std::make_unique<Agent>(
-          tradeDispatcher, matchingEngine,
-          MakeStrategyMomentumTrader(&orderbook, &orderPool, 0.005),
-          i + (nRandom + nMarketMaker), momentumTraderRate));
+      agentManager_.AddAgent(
+          Agent(tradeDispatcher, matchingEngine,
+                i + (nRandom + nMarketMaker), momentumTraderRate),
+          MakeStrategyMomentumTrader(&orderPool, 0.005));
     }
 
     agentManager_.WarmUp();
     agentManager_.SetRunning(true);
 
+    tradeDispatcher.Start();
     std::thread t1(&MatchingEngine::Start, &matchingEngine);
     std::thread t2(&AgentManager::RunIncomingLoop, &agentManager_);
 
     agentManager_.RunOutgoingLoop();
 
-    agentManager_.SetRunning(false);
     matchingEngine.Stop();
 
     if (t1.joinable()) {
       t1.join();
     }
 
+    tradeDispatcher.Stop();
+    agentManager_.SetRunning(false);
+
     if (t2.joinable()) {
       t2.join();
     }
@@ -68,4 +70,13 @@ static void BM_Simulation(benchmark::State &state) {
 
 BENCHMARK(BM_Simulation)->RangeMultiplier(2)->Range(16, 256);
 
-BENCHMARK_MAIN();
+int main(int argc, char **argv) {
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  PrintLatencyReport();
+  return 0;
+}
@@ -1,21 +1,31 @@
 #pragma once
-#include "AgentStrategy.h"
+#include "CounterRng.h"
+#include "LatencyProbes.h"
+#include "Ledger.h"
 #include "MatchingEngine.h"
 #include "Order.h"
 #include "OrderPool.h"
 #include "RingBuffer.h"
 #include "Trade.h"
 #include "TradeDispatcher.h"
-#include <atomic>
+#include <array>
+#include <cstddef>
 #include <cstdint>
-#include <map>
-#include <unordered_map>
-#include <unordered_set>
+#include <mutex>
+#include <shared_mutex>
+#include <utility>
+#include <vector>
+
+// Waits between actions are drawn this many at a time
+static constexpr std::size_t AGENT_WAIT_BATCH_SIZE = 8;
+// Active orders room reserved up front so the common case never grows it.
+// Agents built without it, for very large populations, start with a few
+// slots on first use and grow from there.
+static constexpr std::size_t AGENT_ACTIVE_ORDERS_RESERVE = 64;
+static constexpr std::size_t AGENT_ACTIVE_ORDERS_LAZY_RESERVE = 4;
 
 struct AgentInfo {
-  enum class Strategy { RANDOM, MARKETMAKER, MOMENTUMTRADER };
   ClientRef clientRef_;
-  Strategy strategy_;
   std::int64_t cash_;
   std::int64_t units_;
 };
@@ -23,53 +33,68 @@ struct AgentInfo {
 class Agent {
 public:
   Agent(TradeDispatcher &tradeDispatcher, MatchingEngine &matchingEngine,
-        AgentStrategy &&strategy, ClientRef clientRef, double rate);
-  ~Agent();
+        ClientRef clientRef, double rate,
+        std::uint64_t seed = DEFAULT_RUN_SEED,
+        bool reserveActiveOrders = true);
+  // Agents are only moved into their pool while the simulation is being set
+  // up, never once any thread is running
+  Agent(Agent &&other) noexcept;
 
-  OrderPtrs Act();
   void PushOrder(Order *order);
-  void PushTrade(TradeInfo &&tradeInfo);
-  void PopTrade();
+  void PopTrade(RoundTripLatency *roundTrips = nullptr);
   void AddActiveOrder(PoolIndex index, Order *order);
   void RemoveActiveOrder(PoolIndex index);
   double ScheduleNextAction(std::uint64_t currentTime);
 
-  std::int64_t GetCash() const { return cash_; }
-  std::int64_t GetAvailableCash() const { return availableCash_; }
-  std::int64_t GetReservedCash() const { return reservedCash_; }
-  std::int64_t GetUnits() const { return units_; }
+  // The engine's latest snapshot of the agent's account
+  Position GetPosition() const { return ledger_.GetSnapshot(clientRef_); }
+  std::int64_t GetCash() const { return GetPosition().cash; }
+  std::int64_t GetAvailableCash() const {
+    return GetPosition().AvailableCash();
+  }
+  std::int64_t GetReservedCash() const { return GetPosition().heldCash; }
+  // Units not already offered on the book
+  std::int64_t GetUnits() const { return GetPosition().AvailableUnits(); }
   ClientRef GetClientRef() const { return clientRef_; }
-  std::unordered_map<PoolIndex, Order *> GetActiveOrders() const;
-  std::map<Price, std::unordered_set<PoolIndex>> GetActiveOrdersByPrice() const;
+  // Stream for the agent's strategy, only used by whoever is acting for it
+  CounterRng &GetRng() { return rng_; }
+  std::size_t GetNActiveOrders() const;
+  // Calls f with each active order in the order they were placed, removing
+  // those f returns true for. Holds the lock, so f must not call back into
+  // the agent's active orders.
+  template <typename F> void EraseActiveOrdersIf(F &&f);
   AgentInfo GetInfo();
 
-  void ClearIncoming();
+  void ClearIncoming(RoundTripLatency *roundTrips = nullptr);
   void PrintState();
 
 private:
   void PushLimitOrder(Order *order);
   void PushMarketOrder(Order *order);
   void PushCancelOrder(Order *order);
-
-  void PopLimitOrderTrade(TradeInfo &tradeInfo);
-  void PopMarketOrderTrade(TradeInfo &tradeInfo);
-  void PopCancelOrderTrade(TradeInfo &tradeInfo);
+  void SubmitOrder(Order *order);
 
 private:
-  AgentStrategy strategy_;
   MatchingEngine &matchingEngine_;
+  const Ledger &ledger_;
   TradeDispatcher &tradeDispatcher_;
-  RingBuffer<TradeInfo, 1024> incomingBuffer_;
-  std::unordered_map<PoolIndex, Order *> activeOrders_;
-  std::map<Price, std::unordered_set<PoolIndex>> activeOrdersByPrice_;
+  // Few enough per agent that a flat scan beats hashing, and it never
+  // allocates once it has grown to the agent's working set
+  std::vector<std::pair<PoolIndex, Order *>> activeOrders_;
   OrderId agentOrders_ = 0;
   ClientRef clientRef_;
-  std::int64_t initialCash_{1'000'000'000};
-  std::int64_t initialUnits_{100'000};
-  std::atomic<std::int64_t> cash_{1'000'000'000};
-  std::atomic<std::int64_t> reservedCash_{0};
-  std::atomic<std::int64_t> availableCash_{1'000'000'000};
-  std::atomic<std::int64_t> units_{100'000};
+  std::int64_t initialCash_{INITIAL_CASH};
+  std::int64_t initialUnits_{INITIAL_UNITS};
   double rate_;
+  CounterRng rng_;
+  CounterRng waitRng_;
+  std::array<double, AGENT_WAIT_BATCH_SIZE> waits_;
+  std::size_t nextWait_{AGENT_WAIT_BATCH_SIZE};
   mutable std::shared_mutex mtx_;
 };
+
+template <typename F> void Agent::EraseActiveOrdersIf(F &&f) {
+  std::unique_lock<std::shared_mutex> lock(mtx_);
+  std::erase_if(activeOrders_,
+                [&](const auto &entry) { return f(entry.second); });
+}
@@ -1,45 +1,123 @@
 #pragma once
 #include "Agent.h"
+#include "AgentPool.h"
 #include "AgentStrategy.h"
 #include "CalenderQueue.h"
+#include "Orderbook.h"
 #include <atomic>
-#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
 #include <vector>
 
+// Every strategy the simulation can run, registering a new strategy here is
+// all the scheduler needs
+using AgentPools = AgentPoolSet<Random, MarketMaker, MomentumTrader>;
+
+// Largest run of same strategy agents handed to one ActBatch call in
+// batch-synchronous mode
+static constexpr std::size_t AGENT_ACT_BATCH_SIZE = 64;
+
+// Each agent has one pending event so no bucket ever holds more events than
+// there are agents, buckets are reserved up to this many
+static constexpr std::size_t AGENT_EVENT_BUCKET_RESERVE = 64;
+
 struct AgentEvent {
   double time;
-  size_t pos;
+  size_t pos; // Position within the pool for this kind of agent
+  AgentPools::Kind kind;
 
   bool operator<(const AgentEvent &otherEvent) const {
     return time > otherEvent.time;
   }
 };
 
+// End of run state of every agent running one strategy
+struct StrategySummary {
+  std::string_view name;
+  std::size_t nAgents;
+  double meanProfit;
+  double profitStdDev;
+  double meanCash;
+  double cashStdDev;
+  double meanUnits;
+  double unitsStdDev;
+};
+
+// How many agents run each strategy and how they are configured. Agents are
+// given consecutive ClientRefs in registration order, random agents first.
+struct AgentPopulation {
+  std::size_t nRandom{0};
+  double randomRate{1};
+  double sigma{1};
+  std::size_t nMarketMaker{0};
+  double marketMakerRate{1};
+  double spread{0.02};
+  std::size_t nMomentumTrader{0};
+  double momentumTraderRate{1};
+  double threshold{0.005};
+  // Off for large populations of mostly idle agents, which then only
+  // allocate their active orders once they first rest one, at the cost of
+  // that allocation landing on the action path
+  bool reserveActiveOrders{true};
+
+  std::size_t size() const { return nRandom + nMarketMaker + nMomentumTrader; }
+};
+
 constexpr inline auto accessor = [](const AgentEvent &event) {
   return event.time;
 };
 
 class AgentManager {
 public:
-  AgentManager(std::uint64_t maxTime);
+  AgentManager(std::uint64_t maxTime, Orderbook &orderbook);
 
   void SetRunning(bool running);
 
-  void AddAgent(std::unique_ptr<Agent> agent);
+  template <typename Strategy> void AddAgent(Agent &&agent, Strategy strategy);
+  // Builds every agent of the population in one go, each pool sized once
+  void Populate(const AgentPopulation &population,
+                TradeDispatcher &tradeDispatcher,
+                MatchingEngine &matchingEngine, OrderPool *orderPool,
+                std::uint64_t seed = DEFAULT_RUN_SEED);
   void PushAgentEvent(AgentEvent &&event);
   void WarmUp();
   void RunOutgoingLoop();
+  void RunBatchedOutgoingLoop(double timeSlice, std::size_t nThreads);
+  void RunLockstepLoop(MatchingEngine &matchingEngine,
+                       TradeDispatcher &tradeDispatcher);
   void RunIncomingLoop();
 
   std::uint64_t GetNAgentActions() const;
 
   void PrintStates();
+  // One entry per strategy, in registration order
+  std::vector<StrategySummary> GetSummary();
   void PrintSummary();
+  void PrintRoundTripReport();
 
   std::atomic<bool> running_{false};
   std::uint64_t currentTime_{0};
   std::uint64_t maxTime_;
   std::uint64_t agentActions_{0};
-  std::vector<std::unique_ptr<Agent>> agents_;
+  Orderbook &orderbook_;
+  AgentPools agentPools_;
+  OrderBuffer orderBuffer_; // Reused by every action in serial mode
   CalenderQueue<AgentEvent, 1024, decltype(accessor)> agentEventQueue_;
+
+private:
+  // Where an agent sits, indexed by ClientRef for lockstep delivery
+  struct AgentSlot {
+    AgentPools::Kind kind;
+    std::size_t pos;
+  };
+
+  // Calls afterPush once each of the agent's orders has been submitted
+  template <typename Pool, typename AfterPush>
+  void StepAgent(Pool &pool, const AgentEvent &event, AfterPush &&afterPush);
 };
+
+template <typename Strategy>
+void AgentManager::AddAgent(Agent &&agent, Strategy strategy) {
+  agentPools_.Get<Strategy>().Add(std::move(agent), std::move(strategy));
+}
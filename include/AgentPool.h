@@ -0,0 +1,115 @@
+#pragma once
+#include "Agent.h"
+#include "AgentStrategy.h"
+#include "BookView.h"
+#include "LatencyProbes.h"
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Contiguous storage for every agent running one strategy. Agents and their
+// strategies sit in parallel arrays so the scheduler can step through a pool
+// calling a strategy type known at compile time.
+
+template <typename Strategy> class AgentPool {
+public:
+  using StrategyType = Strategy;
+
+  void Reserve(std::size_t n) {
+    agents_.reserve(n);
+    strategies_.reserve(n);
+  }
+
+  std::size_t Add(Agent &&agent, Strategy &&strategy) {
+    agents_.push_back(std::move(agent));
+    strategies_.push_back(std::move(strategy));
+    return agents_.size() - 1;
+  }
+
+  void Act(std::size_t pos, const BookView &view, OrderBuffer &orders) {
+    strategies_[pos].Act(&agents_[pos], view, orders);
+  }
+
+  // Acts for a batch of agents, strategies providing a static ActBatch get
+  // the whole batch at once
+  void ActBatch(std::span<const std::size_t> positions, const BookView &view,
+                OrderBuffer *orders) {
+    if constexpr (requires {
+                    Strategy::ActBatch(std::span<Strategy>{},
+                                       std::span<Agent>{}, positions, view,
+                                       orders);
+                  }) {
+      Strategy::ActBatch(strategies_, agents_, positions, view, orders);
+    } else {
+      for (std::size_t i = 0; i < positions.size(); ++i) {
+        orders[i].clear();
+        Act(positions[i], view, orders[i]);
+      }
+    }
+  }
+
+  Agent &GetAgent(std::size_t pos) { return agents_[pos]; }
+  Strategy &GetStrategy(std::size_t pos) { return strategies_[pos]; }
+  std::vector<Agent> &GetAgents() { return agents_; }
+  std::size_t size() const { return agents_.size(); }
+  // Only touched by the thread popping the pool's execution reports
+  RoundTripLatency &GetRoundTrips() { return roundTrips_; }
+
+private:
+  std::vector<Agent> agents_;
+  std::vector<Strategy> strategies_;
+  RoundTripLatency roundTrips_;
+};
+
+// One AgentPool per registered strategy, a strategy's kind is its position in
+// the registration list
+
+template <typename... Strategies> class AgentPoolSet {
+  static_assert(sizeof...(Strategies) <= 256, "Too many strategies");
+
+public:
+  using Kind = std::uint8_t;
+  static constexpr Kind NKinds = sizeof...(Strategies);
+
+  template <typename Strategy> static constexpr Kind KindOf() {
+    constexpr bool matches[] = {std::is_same_v<Strategy, Strategies>...};
+    for (Kind kind = 0; kind < sizeof...(Strategies); ++kind) {
+      if (matches[kind]) {
+        return kind;
+      }
+    }
+    throw "Strategy has not been registered";
+  }
+
+  template <typename Strategy> AgentPool<Strategy> &Get() {
+    return std::get<AgentPool<Strategy>>(pools_);
+  }
+
+  // Calls f with the pool for the given kind
+  template <typename F> void Visit(Kind kind, F &&f) {
+    VisitImpl(kind, f, std::index_sequence_for<Strategies...>{});
+  }
+
+  // Calls f with every pool in registration order
+  template <typename F> void ForEach(F &&f) {
+    std::apply([&](auto &...pools) { (f(pools), ...); }, pools_);
+  }
+
+  Agent &GetAgent(Kind kind, std::size_t pos) {
+    Agent *agent = nullptr;
+    Visit(kind, [&](auto &pool) { agent = &pool.GetAgent(pos); });
+    return *agent;
+  }
+
+private:
+  template <typename F, std::size_t... Kinds>
+  void VisitImpl(Kind kind, F &f, std::index_sequence<Kinds...>) {
+    ((kind == Kinds ? (f(std::get<Kinds>(pools_)), void()) : void()), ...);
+  }
+
+  std::tuple<AgentPool<Strategies>...> pools_;
+};
@@ -1,24 +1,55 @@
 #pragma once
 
+#include "BookView.h"
 #include "OrderPool.h"
-#include "Orderbook.h"
-#include "SingleThreadRingBuffer.h"
-#include <random>
-#include <variant>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
 
 class Agent;
 
-class MarketMaker;
-class MomentumTrader;
-class Random;
+// Most orders a single agent action can emit
+static constexpr std::size_t MAX_ORDERS_PER_ACTION = 32;
 
-using AgentStrategy = std::variant<MarketMaker, MomentumTrader, Random>;
+// Orders emitted by one agent action, owned by the caller and reused between
+// actions so acting never touches the heap. Strategies stop emitting (e.g.
+// leave further orders uncancelled) once it is full.
+class OrderBuffer {
+public:
+  bool Push(Order *order) {
+    if (size_ == orders_.size()) {
+      return false;
+    }
+    orders_[size_++] = order;
+    return true;
+  }
+
+  std::size_t available() const { return orders_.size() - size_; }
+  bool full() const { return size_ == orders_.size(); }
+  bool empty() const { return size_ == 0; }
+  std::size_t size() const { return size_; }
+  void clear() { size_ = 0; }
+
+  Order **begin() { return orders_.data(); }
+  Order **end() { return orders_.data() + size_; }
 
-using OrderPtrs = std::vector<Order *>;
+private:
+  std::array<Order *, MAX_ORDERS_PER_ACTION> orders_;
+  std::size_t size_{0};
+};
+
+// Most quotes a market maker keeps resting. Stale quotes are swept by its
+// mass cancels, this bounds the rest so its active orders never outgrow the
+// agent's reserve.
+static constexpr std::size_t MARKET_MAKER_MAX_QUOTES = 32;
 
 class MarketMaker {
 public:
-  MarketMaker(Orderbook *orderbook, OrderPool *orderPool, double spread);
+  static constexpr std::string_view Name{"Market Maker Agents"};
+
+  MarketMaker(OrderPool *orderPool, double spread);
 
   MarketMaker(const MarketMaker&) = delete;
   MarketMaker& operator=(const MarketMaker&) = delete;
@@ -26,21 +57,22 @@ public:
   MarketMaker(MarketMaker&&) = default;
   MarketMaker& operator=(MarketMaker&&) = default;
 
-  OrderPtrs Act(Agent *agent);
-  OrderPtrs CreateOrders(Agent *agent);
-  OrderPtrs CancelOrders(Agent *agent);
+  void Act(Agent *agent, const BookView &view, OrderBuffer &orders);
+  void CreateOrders(Agent *agent, const BookView &view, OrderBuffer &orders);
+  void CancelOrders(Agent *agent, OrderBuffer &orders);
 
 private:
   double spread_;
   double lastMidPrice_;
   double midPrice_;
-  Orderbook *orderbook_;
   OrderPool *orderPool_;
 };
 
 class MomentumTrader {
 public:
-  MomentumTrader(Orderbook *orderbook, OrderPool *orderPool, double threshold);
+  static constexpr std::string_view Name{"Momentum Trader Agents"};
+
+  MomentumTrader(OrderPool *orderPool, double threshold);
 
   MomentumTrader(const MomentumTrader&) = delete;
   MomentumTrader& operator=(const MomentumTrader&) = delete;
@@ -48,24 +80,20 @@ public:
   MomentumTrader(MomentumTrader&&) = default;
   MomentumTrader& operator=(MomentumTrader&&) = default;
 
-  OrderPtrs Act(Agent *agent);
-  OrderPtrs CreateOrders(Agent *agent);
-  OrderPtrs CancelOrders(Agent *agent);
+  void Act(Agent *agent, const BookView &view, OrderBuffer &orders);
+  void CreateOrders(Agent *agent, const BookView &view, OrderBuffer &orders);
+  void CancelOrders(Agent *agent, OrderBuffer &orders);
 
 private:
-  SingleThreadRingBuffer<double, 256> longTermObservations_;
-  SingleThreadRingBuffer<double, 32> shortTermObservations_;
-
-  double shortTermSum_{0};
-  double longTermSum_{0};
   double threshold_;
-  Orderbook *orderbook_;
   OrderPool *orderPool_;
 };
 
 class Random {
 public:
-  Random(Orderbook *orderbook, OrderPool *orderPool, double sigma);
+  static constexpr std::string_view Name{"Random Agents"};
+
+  Random(OrderPool *orderPool, double sigma);
 
   Random(const Random&) = delete;
   Random& operator=(const Random&) = delete;
@@ -73,14 +101,17 @@ public:
   Random(Random&&) = default;
   Random& operator=(Random&&) = default;
 
-  OrderPtrs Act(Agent *agent);
-  OrderPtrs CreateOrders(Agent *agent);
-  OrderPtrs CancelOrders(Agent *agent);
+  void Act(Agent *agent, const BookView &view, OrderBuffer &orders);
+  void CreateOrders(Agent *agent, const BookView &view, OrderBuffer &orders);
+  void CancelOrders(Agent *agent, OrderBuffer &orders);
+
+  // Acts for every agent at the given positions of the pool, orders[i] gets
+  // the orders for positions[i]. All agents must share one OrderPool.
+  static void ActBatch(std::span<Random> strategies, std::span<Agent> agents,
+                       std::span<const std::size_t> positions,
+                       const BookView &view, OrderBuffer *orders);
 
 private:
   double sigma_;
-  std::normal_distribution<double> normal_distribution_;
-  std::bernoulli_distribution bernoulli_distribution_;
-  Orderbook *orderbook_;
   OrderPool *orderPool_;
 };
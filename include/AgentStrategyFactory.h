@@ -1,20 +1,15 @@
 #pragma once
 #include "AgentStrategy.h"
 
-AgentStrategy MakeStrategyRandom(Orderbook *orderbook, OrderPool *orderPool,
-                                 double sigma) {
-  return AgentStrategy{std::in_place_type<Random>, orderbook, orderPool, sigma};
+Random MakeStrategyRandom(OrderPool *orderPool, double sigma) {
+  return Random(orderPool, sigma);
 }
 
-AgentStrategy MakeStrategyMarketMaker(Orderbook *orderbook,
-                                      OrderPool *orderPool, double spread) {
-  return AgentStrategy{std::in_place_type<MarketMaker>, orderbook, orderPool,
-                       spread};
+MarketMaker MakeStrategyMarketMaker(OrderPool *orderPool, double spread) {
+  return MarketMaker(orderPool, spread);
 }
 
-AgentStrategy MakeStrategyMomentumTrader(Orderbook *orderbook,
-                                         OrderPool *orderPool,
-                                         double threshold) {
-  return AgentStrategy{std::in_place_type<MomentumTrader>, orderbook, orderPool,
-                       threshold};
+MomentumTrader MakeStrategyMomentumTrader(OrderPool *orderPool,
+                                          double threshold) {
+  return MomentumTrader(orderPool, threshold);
 }
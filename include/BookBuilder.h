@@ -0,0 +1,61 @@
+#pragma once
+#include "BookView.h"
+#include "MarketData.h"
+#include "MarketDataFeed.h"
+#include "Order.h"
+#include "Orderbook.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+static constexpr std::size_t BOOK_BUILDER_BATCH_SIZE = 256;
+static constexpr std::uint32_t INVALID_BOOK_LEVEL =
+    std::numeric_limits<std::uint32_t>::max();
+
+// Rebuilds an L2 book from one subscription to the market data feed. The
+// copy is private to the thread polling it, so readers never touch the
+// engine's book, and it only ever stops between orders so it is always a
+// book the engine actually had. A builder the engine dropped for falling
+// behind clears its copy and asks to resync, and is not synced again until
+// the image of the book that follows has been applied.
+
+class BookBuilder {
+public:
+  BookBuilder(MarketDataFeed &feed, std::size_t subscriber);
+
+  // Applies everything published so far, returns how many updates it applied
+  std::size_t Poll();
+  bool IsSynced() const { return synced_; }
+  std::uint64_t GetResyncs() const { return resyncs_; }
+  void Apply(const MarketDataUpdate &update);
+
+  Quantity GetBidQuantity(std::uint32_t level) const { return bids_[level]; }
+  Quantity GetAskQuantity(std::uint32_t level) const { return asks_[level]; }
+  std::uint32_t GetBestBidLevel() const { return bestBid_; }
+  std::uint32_t GetBestAskLevel() const { return bestAsk_; }
+  BookView GetBookView() const;
+  Price GetLastTradePrice() const { return lastTradePrice_; }
+  Quantity GetLastTradeQuantity() const { return lastTradeQuantity_; }
+  std::uint64_t GetSequence() const { return seq_; }
+
+private:
+  void SetLevel(Side side, std::uint32_t level, Price price,
+                Quantity quantity);
+  void Resync();
+
+  MarketDataFeed &feed_;
+  std::size_t subscriber_;
+  std::array<Quantity, MAX_PRICE_LEVELS> bids_{};
+  std::array<Quantity, MAX_PRICE_LEVELS> asks_{};
+  std::array<Price, MAX_PRICE_LEVELS> prices_{};
+  std::uint32_t bestBid_{INVALID_BOOK_LEVEL};
+  std::uint32_t bestAsk_{INVALID_BOOK_LEVEL};
+  Price lastTradePrice_{0};
+  Quantity lastTradeQuantity_{0};
+  std::uint64_t seq_{0};
+  bool midSeq_{false}; // Applied part of an order's updates
+  bool synced_{true};
+  std::uint64_t resyncs_{0};
+  std::array<MarketDataUpdate, BOOK_BUILDER_BATCH_SIZE> scratch_;
+};
@@ -0,0 +1,89 @@
+#pragma once
+#include "Order.h"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+// Top of book as published by the engine after each order that changes it.
+// Small enough to share a cache line with its seqlock, an empty side has a
+// size of 0.
+
+struct TopOfBook {
+  Price bid;
+  Price ask;
+  Price lastTradePrice;
+  Quantity bidSize;
+  Quantity askSize;
+  Quantity lastTradeQuantity;
+  std::uint64_t seq; // Engine sequence number of the order behind it
+};
+
+// The moving averages and volatility are fed the mid after every
+// MID_SAMPLE_INTERVAL-th order while the book is quoted on both sides, so a
+// mid that holds for longer weighs more. Their windows are in samples, about
+// 1024 and 8192 orders.
+static constexpr std::uint64_t MID_SAMPLE_INTERVAL = 8;
+static constexpr std::size_t SHORT_AVERAGE_WINDOW = 128;
+static constexpr std::size_t LONG_AVERAGE_WINDOW = 1024;
+
+// Market indicators kept once by the engine for every strategy to read,
+// maintained incrementally as the book changes. seq is that of the TopOfBook
+// they were computed with, so a reader holding both can tell they match.
+struct MarketIndicators {
+  double mid{0}; // Of the latest quoted top, kept while a side is empty
+  double spread{0};
+  double shortAverage{0}; // Of the last SHORT_AVERAGE_WINDOW mids
+  double longAverage{0};  // Of the last LONG_AVERAGE_WINDOW mids
+  double volatility{0};   // EWMA of per sample mid returns
+  double vwap{0};         // Over every trade so far, 0 before the first
+  double imbalance{0};    // Top of book (bid - ask) / (bid + ask) size
+  std::uint64_t nMids{0}; // Mids sampled so far, up to LONG_AVERAGE_WINDOW
+  std::uint64_t seq{0};   // TopOfBook::seq of the top behind them
+  bool quoted{false};     // Both sides of the book are quoted
+
+  std::optional<Price> MidPrice() const {
+    if (!quoted) {
+      return std::nullopt;
+    }
+    return mid;
+  }
+  // Once both windows are full
+  bool AveragesReady() const { return nMids >= LONG_AVERAGE_WINDOW; }
+};
+
+// Top of book as seen by an agent when it acts. Agents only read the book
+// through this view so a batch of agents can be handed the same one.
+
+struct BookView {
+  std::optional<Price> bestBid;
+  std::optional<Price> bestAsk;
+  Quantity bidSize{0};
+  Quantity askSize{0};
+  std::optional<Price> lastTradePrice;
+  std::uint64_t seq{0};
+  MarketIndicators indicators;
+
+  std::optional<Price> MidPrice() const {
+    if (!bestBid || !bestAsk) {
+      return std::nullopt;
+    }
+    return (*bestAsk + *bestBid) / 2.0;
+  }
+};
+
+inline BookView MakeBookView(const TopOfBook &top) {
+  BookView view;
+  if (top.bidSize > 0) {
+    view.bestBid = top.bid;
+    view.bidSize = top.bidSize;
+  }
+  if (top.askSize > 0) {
+    view.bestAsk = top.ask;
+    view.askSize = top.askSize;
+  }
+  if (top.lastTradeQuantity > 0) {
+    view.lastTradePrice = top.lastTradePrice;
+  }
+  view.seq = top.seq;
+  return view;
+}
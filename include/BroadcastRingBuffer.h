@@ -0,0 +1,136 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Single producer ring buffer read by a fixed number of consumers, each with
+// its own cursor so every consumer sees every item. The producer only
+// overwrites a slot once the slowest consumer has moved past it, unless it
+// has detached that consumer, after which the consumer reads nothing until
+// the producer reattaches it at the head.
+// Head and tail are free running sequence numbers, masked on access.
+
+template <typename T, size_t n> class BroadcastRingBuffer {
+  static_assert((n & (n - 1)) == 0, "Size is not a power of 2");
+
+private:
+  struct alignas(64) Cursor {
+    std::atomic<size_t> tail_{0};
+    std::atomic<bool> detached_{false}; // Only written by the producer
+  };
+
+  std::vector<T> buffer_;
+  std::vector<Cursor> cursors_;
+  alignas(64) std::atomic<size_t> head_{0};
+  alignas(64) size_t cached_min_tail_{0}; // producer only
+
+  size_t MinTail() const;
+
+public:
+  explicit BroadcastRingBuffer(size_t consumers)
+      : buffer_(n), cursors_(consumers) {};
+
+  size_t Push(const T *items, size_t count);
+  size_t Pop(size_t consumer, T *items, size_t max_items);
+  // Producer only. Stops waiting for every consumer too far behind for count
+  // more items to fit, returns how many were detached.
+  size_t DetachLaggards(size_t count);
+  // Producer only, the consumer carries on from the next item pushed
+  void Reattach(size_t consumer);
+  bool IsDetached(size_t consumer) const {
+    return cursors_[consumer].detached_.load(std::memory_order_acquire);
+  }
+  size_t consumers() const { return cursors_.size(); }
+  bool empty() const;
+};
+
+template <typename T, std::size_t n>
+size_t BroadcastRingBuffer<T, n>::MinTail() const {
+  size_t min_tail = head_.load(std::memory_order_relaxed);
+  for (const auto &cursor : cursors_) {
+    if (cursor.detached_.load(std::memory_order_relaxed)) {
+      continue;
+    }
+    size_t tail = cursor.tail_.load(std::memory_order_acquire);
+    if (tail < min_tail) {
+      min_tail = tail;
+    }
+  }
+  return min_tail;
+}
+
+// Pushes as many of the items as will fit and publishes them with a single
+// release store, returns how many were pushed
+template <typename T, std::size_t n>
+size_t BroadcastRingBuffer<T, n>::Push(const T *items, size_t count) {
+  size_t current_head = head_.load(std::memory_order_relaxed);
+  if (current_head + count - cached_min_tail_ > n) {
+    cached_min_tail_ = MinTail();
+  }
+  size_t free_slots = n - (current_head - cached_min_tail_);
+  size_t to_push = count < free_slots ? count : free_slots;
+
+  for (size_t i = 0; i < to_push; ++i) {
+    buffer_[(current_head + i) & (n - 1)] = items[i];
+  }
+  head_.store(current_head + to_push, std::memory_order_release);
+  return to_push;
+}
+
+template <typename T, std::size_t n>
+size_t BroadcastRingBuffer<T, n>::Pop(size_t consumer, T *items,
+                                      size_t max_items) {
+  auto &cursor = cursors_[consumer];
+  if (cursor.detached_.load(std::memory_order_acquire)) {
+    return 0;
+  }
+  size_t current_tail = cursor.tail_.load(std::memory_order_relaxed);
+  size_t available = head_.load(std::memory_order_acquire) - current_tail;
+  size_t to_pop = available < max_items ? available : max_items;
+
+  for (size_t i = 0; i < to_pop; ++i) {
+    items[i] = buffer_[(current_tail + i) & (n - 1)];
+  }
+  // As with a seqlock, items copied while the producer was already
+  // overwriting them after detaching this consumer are thrown away
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (cursor.detached_.load(std::memory_order_relaxed)) {
+    return 0;
+  }
+  cursor.tail_.store(current_tail + to_pop, std::memory_order_release);
+  return to_pop;
+}
+
+template <typename T, std::size_t n>
+size_t BroadcastRingBuffer<T, n>::DetachLaggards(size_t count) {
+  size_t current_head = head_.load(std::memory_order_relaxed);
+  size_t detached = 0;
+  for (auto &cursor : cursors_) {
+    if (cursor.detached_.load(std::memory_order_relaxed)) {
+      continue;
+    }
+    if (current_head + count - cursor.tail_.load(std::memory_order_acquire) >
+        n) {
+      cursor.detached_.store(true, std::memory_order_relaxed);
+      ++detached;
+    }
+  }
+  // Ordered before any overwrite of the slots the laggards were reading
+  std::atomic_thread_fence(std::memory_order_release);
+  cached_min_tail_ = MinTail();
+  return detached;
+}
+
+template <typename T, std::size_t n>
+void BroadcastRingBuffer<T, n>::Reattach(size_t consumer) {
+  auto &cursor = cursors_[consumer];
+  cursor.tail_.store(head_.load(std::memory_order_relaxed),
+                     std::memory_order_relaxed);
+  cursor.detached_.store(false, std::memory_order_release);
+}
+
+template <typename T, std::size_t n>
+bool BroadcastRingBuffer<T, n>::empty() const {
+  return MinTail() == head_.load(std::memory_order_acquire);
+}
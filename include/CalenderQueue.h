@@ -2,8 +2,12 @@
 #include <algorithm>
 #include <array>
 #include <cstddef>
+#include <cstdint>
 #include <vector>
 
+// Buckets are bucket_width_ wide and reused every n buckets, a bucket's items
+// are only popped once the head has reached their own pass over the buckets,
+// so items scheduled more than n buckets ahead wait their turn.
 template <typename T, std::size_t n, typename TimeAccessor>
 class CalenderQueue {
   static_assert((n & (n - 1)) == 0, "Size is not a power of 2");
@@ -13,10 +17,16 @@ private:
   std::array<Bucket, n> buckets_{};
   std::size_t bucket_width_{1};
   TimeAccessor time_accessor_{};
-  std::size_t head_{0};
+  std::size_t head_{0}; // Absolute bucket number, not wrapped
   std::size_t size_{0};
 
+  std::size_t BucketOf(const T &item) const {
+    return static_cast<std::size_t>(time_accessor_(item)) / bucket_width_;
+  }
+
 public:
+  // Gives every bucket room for this many items up front
+  void Reserve(std::size_t perBucket);
   bool Push(T &&item);
   bool Pop(T &item);
   // size_t size() const;
@@ -27,10 +37,7 @@ public:
 template <typename T, std::size_t n, typename TimeAccessor>
 bool CalenderQueue<T, n, TimeAccessor>::Push(T &&item) {
 
-  std::size_t timestamp = static_cast<std::size_t>(time_accessor_(item));
-  std::size_t bucketIndex = (timestamp / bucket_width_) & (n - 1);
-
-  auto &bucket = buckets_[bucketIndex];
+  auto &bucket = buckets_[BucketOf(item) & (n - 1)];
   auto iter = std::upper_bound(bucket.begin(), bucket.end(), item,
                                [&](const T &a, const T &b) {
                                return time_accessor_(a) > time_accessor_(b);
@@ -40,20 +47,38 @@ bool CalenderQueue<T, n, TimeAccessor>::Push(T &&item) {
   return true;
 };
 
+template <typename T, std::size_t n, typename TimeAccessor>
+void CalenderQueue<T, n, TimeAccessor>::Reserve(std::size_t perBucket) {
+  for (auto &bucket : buckets_) {
+    bucket.reserve(perBucket);
+  }
+}
+
 template <typename T, std::size_t n, typename TimeAccessor>
 bool CalenderQueue<T, n, TimeAccessor>::Pop(T &item) {
   if (size_ == 0) {
     return false;
   }
 
-  while (buckets_[head_].empty()) {
-    head_ = (head_ + 1) & (n - 1);
+  for (std::size_t scanned = 0;; ++scanned, ++head_) {
+    if (scanned == n) {
+      // Nothing due within a whole pass, skip ahead to the earliest item
+      head_ = SIZE_MAX;
+      for (const auto &bucket : buckets_) {
+        if (!bucket.empty()) {
+          head_ = std::min(head_, BucketOf(bucket.back()));
+        }
+      }
+      scanned = 0;
+    }
+    auto &bucket = buckets_[head_ & (n - 1)];
+    if (!bucket.empty() && BucketOf(bucket.back()) <= head_) {
+      item = std::move(bucket.back());
+      bucket.pop_back();
+      --size_;
+      return true;
+    }
   }
-  auto &bucket= buckets_[head_];
-  item = std::move(bucket.back());
-  bucket.pop_back();
-  --size_;
-  return true;
 }
 
 template <typename T, std::size_t n, typename TimeAccessor>
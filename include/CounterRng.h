@@ -0,0 +1,164 @@
+#pragma once
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <numbers>
+
+// Counter based random numbers: every draw is a pure function of a key and a
+// counter, so a batch of draws has no dependency chain between lanes and the
+// loops generating them vectorise.
+
+// Seed used when a run does not ask for one, runs with the same seed and
+// inputs draw the same numbers
+static constexpr std::uint64_t DEFAULT_RUN_SEED = 1;
+
+inline std::uint64_t SplitMix64(std::uint64_t x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+// Maps the top 53 bits onto (0, 1], never 0 so it is safe to take the log of
+inline double ToUnitDouble(std::uint64_t bits) {
+  return static_cast<double>((bits >> 11) + 1) * 0x1.0p-53;
+}
+
+// Natural log of a (0, 1] uniform in plain arithmetic, so loops over it
+// vectorise without a vector maths library. Within a few ulp of
+// std::log.
+inline double UnitLog(double x) {
+  // 1/3, 1/5, ... 1/17, the odd terms of 2 atanh(f) after f
+  constexpr std::array<double, 8> ATANH_TERMS = {
+      1.0 / 17, 1.0 / 15, 1.0 / 13, 1.0 / 11, 1.0 / 9, 1.0 / 7, 1.0 / 5,
+      1.0 / 3};
+  const std::uint64_t bits = std::bit_cast<std::uint64_t>(x);
+  // The exponent as a double without an integer conversion
+  double exponent =
+      std::bit_cast<double>((bits >> 52) | 0x4330000000000000ULL) -
+      (0x1.0p52 + 1023.0);
+  double mantissa = std::bit_cast<double>(
+      (bits & 0x000FFFFFFFFFFFFFULL) | 0x3FF0000000000000ULL);
+  const bool high = mantissa > std::numbers::sqrt2;
+  mantissa = high ? mantissa * 0.5 : mantissa;
+  exponent = high ? exponent + 1.0 : exponent;
+  // log(m) = 2 atanh(f) with f = (m - 1) / (m + 1), |f| <= 0.172
+  const double f = (mantissa - 1.0) / (mantissa + 1.0);
+  const double s = f * f;
+  double series = 0.0;
+  for (const double term : ATANH_TERMS) {
+    series = (series + term) * s;
+  }
+  return exponent * std::numbers::ln2 + 2.0 * f * (series + 1.0);
+}
+
+// cos(2 pi u) for u in (0, 1], folded onto a quarter turn and summed as a
+// Taylor series whose first dropped term is below 1e-16
+inline double CosTwoPi(double u) {
+  // (-1)^n / (2n)! from n = 10 down to n = 1
+  constexpr std::array<double, 10> COS_TERMS = {
+      1.0 / 2432902008176640000.0, -1.0 / 6402373705728000.0,
+      1.0 / 20922789888000.0,      -1.0 / 87178291200.0,
+      1.0 / 479001600.0,           -1.0 / 3628800.0,
+      1.0 / 40320.0,               -1.0 / 720.0,
+      1.0 / 24.0,                  -1.0 / 2.0};
+  const double t = std::fabs(u > 0.5 ? u - 1.0 : u);
+  const bool folded = t > 0.25;
+  const double x = 2.0 * std::numbers::pi * (folded ? 0.5 - t : t);
+  const double x2 = x * x;
+  double c = 0.0;
+  for (const double term : COS_TERMS) {
+    c = (c + term) * x2;
+  }
+  c += 1.0;
+  return folded ? -c : c;
+}
+
+// Box-Muller, one standard normal from two (0, 1] uniforms
+inline double BoxMuller(double u1, double u2) {
+  return std::sqrt(-2.0 * UnitLog(u1)) * CosTwoPi(u2);
+}
+
+using PhiloxBlock = std::array<std::uint32_t, 4>;
+using PhiloxKey = std::array<std::uint32_t, 2>;
+
+// Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2,
+// 3"), 128 random bits per counter
+inline PhiloxBlock Philox4x32(PhiloxBlock counter, PhiloxKey key) {
+  constexpr std::uint32_t M0 = 0xD2511F53;
+  constexpr std::uint32_t M1 = 0xCD9E8D57;
+  constexpr std::uint32_t W0 = 0x9E3779B9;
+  constexpr std::uint32_t W1 = 0xBB67AE85;
+  for (int round = 0; round < 10; ++round) {
+    const std::uint64_t p0 = static_cast<std::uint64_t>(M0) * counter[0];
+    const std::uint64_t p1 = static_cast<std::uint64_t>(M1) * counter[2];
+    counter = {static_cast<std::uint32_t>(p1 >> 32) ^ counter[1] ^ key[0],
+               static_cast<std::uint32_t>(p1),
+               static_cast<std::uint32_t>(p0 >> 32) ^ counter[3] ^ key[1],
+               static_cast<std::uint32_t>(p0)};
+    key[0] += W0;
+    key[1] += W1;
+  }
+  return counter;
+}
+
+// One independent stream of random numbers. The key comes from the run seed
+// and the counter from the owner's id, a stream tag and the number of blocks
+// drawn so far, so streams never overlap and need no locking.
+class CounterRng {
+public:
+  CounterRng(std::uint64_t seed, std::uint64_t id, std::uint32_t stream)
+      : id_(id), stream_(stream) {
+    const std::uint64_t key = SplitMix64(seed);
+    key_ = {static_cast<std::uint32_t>(key),
+            static_cast<std::uint32_t>(key >> 32)};
+  }
+
+  // The two 64 bit halves of the next block
+  void NextBlock(std::uint64_t &lo, std::uint64_t &hi) {
+    const PhiloxBlock block =
+        Philox4x32({block_++, stream_, static_cast<std::uint32_t>(id_),
+                    static_cast<std::uint32_t>(id_ >> 32)},
+                   key_);
+    lo = (static_cast<std::uint64_t>(block[1]) << 32) | block[0];
+    hi = (static_cast<std::uint64_t>(block[3]) << 32) | block[2];
+  }
+
+  std::uint64_t Next() {
+    std::uint64_t lo, hi;
+    NextBlock(lo, hi);
+    return lo ^ hi;
+  }
+
+  // (0, 1]
+  double Uniform() { return ToUnitDouble(Next()); }
+
+  bool Bernoulli(double p) { return Uniform() <= p; }
+
+  double Exponential(double rate) { return -std::log(Uniform()) / rate; }
+
+  double Normal() {
+    std::uint64_t lo, hi;
+    NextBlock(lo, hi);
+    return BoxMuller(ToUnitDouble(lo), ToUnitDouble(hi));
+  }
+
+  // Bulk draws, one block per exponential. Normal price offsets are drawn
+  // in bulk across agents instead, one lane per agent's own stream, by the
+  // batched Random kernel.
+  void FillExponential(double rate, double *out, std::size_t count) {
+    for (std::size_t i = 0; i < count; ++i) {
+      out[i] = Exponential(rate);
+    }
+  }
+
+  std::uint32_t GetBlocksDrawn() const { return block_; }
+
+private:
+  PhiloxKey key_;
+  std::uint64_t id_;
+  std::uint32_t stream_;
+  std::uint32_t block_{0};
+};
@@ -0,0 +1,113 @@
+#pragma once
+#include "MappedFile.h"
+#include "Order.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// ITCH-like binary order feed. Every message starts with its length and a
+// type character, readers skip types they don't know. Messages are packed and
+// read in place from a mapped file. Unlike ITCH, cancels and replaces carry
+// the side and price of the order they refer to, as the engine needs them to
+// find it. Prices are in cents.
+
+static constexpr std::uint64_t FEED_MAGIC = 0x444545464b4f4f42; // BOOKFEED
+static constexpr std::uint32_t FEED_VERSION = 1;
+
+enum FeedMessageType : char {
+  FEED_ADD = 'A',     // New limit order
+  FEED_CANCEL = 'X',  // Cancel a resting order
+  FEED_REPLACE = 'U', // Cancel a resting order and add its replacement
+  FEED_EXECUTE = 'E', // Marketable order taking liquidity
+};
+
+struct [[gnu::packed]] FeedFileHeader {
+  std::uint64_t magic;
+  std::uint32_t version;
+  std::uint32_t reserved;
+  std::uint64_t nMessages;
+};
+
+struct [[gnu::packed]] FeedMessageHeader {
+  std::uint16_t length; // Whole message, this header included
+  char type;
+};
+
+struct [[gnu::packed]] FeedAdd {
+  FeedMessageHeader header;
+  std::uint64_t id;
+  char side; // 'B' or 'S'
+  std::uint32_t quantity;
+  std::uint32_t price;
+};
+
+struct [[gnu::packed]] FeedCancel {
+  FeedMessageHeader header;
+  std::uint64_t id;
+  char side;
+  std::uint32_t price;
+};
+
+struct [[gnu::packed]] FeedReplace {
+  FeedMessageHeader header;
+  std::uint64_t id;
+  std::uint64_t newId;
+  char side;
+  std::uint32_t price;
+  std::uint32_t newQuantity;
+  std::uint32_t newPrice;
+};
+
+struct [[gnu::packed]] FeedExecute {
+  FeedMessageHeader header;
+  std::uint64_t id;
+  char side; // Side taking liquidity
+  std::uint32_t quantity;
+  std::uint32_t price; // Where any unfilled remainder is booked and cancelled
+};
+
+inline Price FeedToPrice(std::uint32_t cents) { return cents / 100.0; }
+inline Side FeedToSide(char side) {
+  return side == 'B' ? Side::Buy : Side::Sell;
+}
+
+class FeedReader {
+public:
+  explicit FeedReader(const std::string &path);
+
+  std::uint64_t GetNMessages() const { return header_->nMessages; }
+
+  // Calls f with each message in file order, as a reference into the mapping
+  template <typename F> void ForEach(F &&f) const;
+
+private:
+  MappedFile file_;
+  const FeedFileHeader *header_;
+};
+
+template <typename F> void FeedReader::ForEach(F &&f) const {
+  const std::byte *p = file_.data() + sizeof(FeedFileHeader);
+  const std::byte *end = file_.data() + file_.size();
+  while (p + sizeof(FeedMessageHeader) <= end) {
+    const auto *header = reinterpret_cast<const FeedMessageHeader *>(p);
+    if (header->length < sizeof(FeedMessageHeader) ||
+        p + header->length > end) {
+      return;
+    }
+    switch (header->type) {
+    case FEED_ADD:
+      f(*reinterpret_cast<const FeedAdd *>(p));
+      break;
+    case FEED_CANCEL:
+      f(*reinterpret_cast<const FeedCancel *>(p));
+      break;
+    case FEED_REPLACE:
+      f(*reinterpret_cast<const FeedReplace *>(p));
+      break;
+    case FEED_EXECUTE:
+      f(*reinterpret_cast<const FeedExecute *>(p));
+      break;
+    }
+    p += header->length;
+  }
+}
@@ -25,6 +25,8 @@ public:
   bool insert(const Entry newEntry);
   U *find(const T key);
   bool erase(const T key);
+  // Pulls in the slot a lookup of key starts probing from
+  void prefetch(const T key) const;
 };
 
 template <typename T, typename U, typename Hasher>
@@ -96,3 +98,8 @@ bool FlatHashMap<T, U, Hasher>::erase(const T key) {
     index = (index + 1) & mask;
   }
 }
+
+template <typename T, typename U, typename Hasher>
+void FlatHashMap<T, U, Hasher>::prefetch(const T key) const {
+  __builtin_prefetch(&data[hasher(key) & mask]);
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+// High dynamic range histogram over the full uint64 range in fixed memory.
+// Values below 2^SUB_BUCKET_BITS are counted exactly, above that each power
+// of two is split into 2^(SUB_BUCKET_BITS - 1) linear buckets, so any value
+// is reported to within 1 / 2^(SUB_BUCKET_BITS - 1) of itself. Recording is
+// a couple of shifts and an increment, nothing is ever allocated.
+
+class HdrHistogram {
+public:
+  static constexpr unsigned SUB_BUCKET_BITS = 7;
+
+  void Record(std::uint64_t value) {
+    ++counts_[Index(value)];
+    ++count_;
+    sum_ += value;
+    min_ = std::min(min_, value);
+    max_ = std::max(max_, value);
+  }
+
+  void Merge(const HdrHistogram &other) {
+    for (std::size_t i = 0; i < N_BUCKETS; ++i) {
+      counts_[i] += other.counts_[i];
+    }
+    count_ += other.count_;
+    sum_ += other.sum_;
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+  }
+
+  void Reset() { *this = HdrHistogram{}; }
+
+  // Highest value that falls in the same bucket as the given percentile
+  std::uint64_t ValueAtPercentile(double percentile) const {
+    if (count_ == 0) {
+      return 0;
+    }
+    const std::uint64_t target = std::max<std::uint64_t>(
+        1, static_cast<std::uint64_t>(
+               std::ceil(percentile / 100.0 * static_cast<double>(count_))));
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < N_BUCKETS; ++i) {
+      seen += counts_[i];
+      if (seen >= target) {
+        return std::min(HighestEquivalentValue(i), max_);
+      }
+    }
+    return max_;
+  }
+
+  std::uint64_t count() const { return count_; }
+  std::uint64_t min() const { return count_ ? min_ : 0; }
+  std::uint64_t max() const { return max_; }
+  double mean() const {
+    return count_ ? static_cast<double>(sum_) / static_cast<double>(count_)
+                  : 0.0;
+  }
+
+private:
+  static constexpr std::size_t LINEAR = std::size_t{1} << SUB_BUCKET_BITS;
+  static constexpr std::size_t HALF = LINEAR / 2;
+  static constexpr std::size_t N_BUCKETS =
+      LINEAR + (64 - SUB_BUCKET_BITS) * HALF;
+
+  static std::size_t Index(std::uint64_t value) {
+    if (value < LINEAR) {
+      return static_cast<std::size_t>(value);
+    }
+    const unsigned magnitude = std::bit_width(value) - 1;
+    const unsigned shift = magnitude - (SUB_BUCKET_BITS - 1);
+    const std::size_t sub = static_cast<std::size_t>(value >> shift) - HALF;
+    return LINEAR + (magnitude - SUB_BUCKET_BITS) * HALF + sub;
+  }
+
+  static std::uint64_t HighestEquivalentValue(std::size_t index) {
+    if (index < LINEAR) {
+      return index;
+    }
+    const std::size_t magnitude = (index - LINEAR) / HALF + SUB_BUCKET_BITS;
+    const std::size_t sub = (index - LINEAR) % HALF + HALF;
+    const unsigned shift =
+        static_cast<unsigned>(magnitude - (SUB_BUCKET_BITS - 1));
+    const std::uint64_t low = static_cast<std::uint64_t>(sub) << shift;
+    return low + ((std::uint64_t{1} << shift) - 1);
+  }
+
+  std::array<std::uint64_t, N_BUCKETS> counts_{};
+  std::uint64_t count_{0};
+  std::uint64_t sum_{0};
+  std::uint64_t min_{std::numeric_limits<std::uint64_t>::max()};
+  std::uint64_t max_{0};
+};
@@ -0,0 +1,43 @@
+#pragma once
+#include "BookView.h"
+#include "Order.h"
+#include "SeqLock.h"
+#include <array>
+#include <cstdint>
+
+// Decay of the EWMA of squared mid returns, over about the short window
+static constexpr double VOLATILITY_DECAY = 1.0 - 1.0 / SHORT_AVERAGE_WINDOW;
+
+// Keeps the MarketIndicators up to date from the matching thread, fed every
+// fill and the top of book after each order, and republishes them only when
+// a published field changes, so most orders cost a few compares. Mids are
+// held as twice the mid in ticks so the window sums are exact however long
+// the run.
+class IndicatorService {
+public:
+  // Matching thread only. seq is the engine's number for the order just
+  // processed, top is the top of book as published after it.
+  void OnTrade(PriceTicks price, Quantity quantity);
+  void OnTop(const TopOfBook &top, std::uint64_t seq);
+
+  // Safe from any thread
+  MarketIndicators Load() const { return published_.Load(); }
+
+private:
+  void AddMid(std::int64_t twiceMid);
+
+  std::array<std::int64_t, LONG_AVERAGE_WINDOW> mids_{};
+  std::int64_t shortSum_{0};
+  std::int64_t longSum_{0};
+  std::int64_t lastTwiceMid_{0};
+  std::uint64_t nSamples_{0};
+  std::uint64_t nextSample_{0}; // Engine seq of the next order to sample
+  double variance_{0};
+  std::int64_t tradedValue_{0}; // Ticks times quantity
+  std::int64_t tradedQuantity_{0};
+  Quantity bidSize_{0};
+  Quantity askSize_{0};
+  MarketIndicators current_;
+  MarketIndicators stored_; // Last value published
+  SeqLock<MarketIndicators> published_;
+};
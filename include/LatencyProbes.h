@@ -0,0 +1,111 @@
+#pragma once
+#include "HdrHistogram.h"
+#include "Order.h"
+#include "Trade.h"
+#include "Tsc.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Per stage latency probes. Every thread records into its own histograms, so
+// a probe is two counter reads and an increment, and PrintLatencyReport
+// merges them at the end of a run. Building with LATENCY_PROBES off compiles
+// every probe away.
+
+#ifdef LATENCY_PROBES
+inline constexpr bool LATENCY_PROBES_ENABLED = true;
+#else
+inline constexpr bool LATENCY_PROBES_ENABLED = false;
+#endif
+
+enum class ProbeStage : std::uint8_t {
+  AGENT_ACT,  // Strategy deciding and building its orders
+  RING_PUSH,  // Order into the engine's buffer
+  ENGINE_POP, // Batch of orders out of the engine's buffer
+  MATCH,      // Matching, resting or cancelling one order
+  DISPATCH,   // Trades, market data and top of book after one order
+  SOJOURN,    // Order from its stamp until the engine is done with it
+  POP_TRADE,  // Agent handling one execution report
+  COUNT
+};
+
+static constexpr std::size_t N_PROBE_STAGES =
+    static_cast<std::size_t>(ProbeStage::COUNT);
+
+void RecordLatency(ProbeStage stage, std::uint64_t ticks);
+void PrintLatencyReport();
+// Both only while no thread is recording
+HdrHistogram GetLatency(ProbeStage stage);
+void ResetLatencyProbes();
+void PrintLatencyHeader(std::string_view title);
+void PrintLatencyRow(std::string_view label, const HdrHistogram &histogram);
+
+inline std::uint64_t ProbeStart() {
+  if constexpr (LATENCY_PROBES_ENABLED) {
+    return ReadTsc();
+  } else {
+    return 0;
+  }
+}
+
+inline void ProbeEnd(ProbeStage stage, std::uint64_t start) {
+  if constexpr (LATENCY_PROBES_ENABLED) {
+    RecordLatency(stage, ReadTscp() - start);
+  }
+}
+
+class ScopedProbe {
+public:
+  explicit ScopedProbe(ProbeStage stage)
+      : stage_(stage), start_(ProbeStart()) {}
+  ~ScopedProbe() { ProbeEnd(stage_, start_); }
+
+  ScopedProbe(const ScopedProbe &) = delete;
+  ScopedProbe &operator=(const ScopedProbe &) = delete;
+
+private:
+  ProbeStage stage_;
+  std::uint64_t start_;
+};
+
+// Stamp for a newly created order, 0 when probes are compiled out
+inline Timestamp OrderTimestamp() { return ProbeStart(); }
+
+// Round trips from a strategy creating an order to its agent receiving the
+// execution report, split by the type of order the report answers. Acks for
+// limit orders that rest are kept apart from the fills of those that cross.
+// Each order is recorded once, on the report that ends its trip through the
+// engine, so partial fills of an order sweeping several levels are skipped.
+class RoundTripLatency {
+public:
+  void Record(const TradeInfo &tradeInfo) {
+    if constexpr (LATENCY_PROBES_ENABLED) {
+      if (tradeInfo.timestamp == 0 ||
+          tradeInfo.type == ExecutionType::PARTIAL) {
+        return;
+      }
+      if (tradeInfo.type == ExecutionType::ACK) {
+        acks_.Record(ReadTscp() - tradeInfo.timestamp);
+        return;
+      }
+      // Cancel reports answer a cancel request, except for market orders
+      // the engine cancels for lack of liquidity
+      const OrderType type = tradeInfo.type == ExecutionType::CANCEL &&
+                                     tradeInfo.orderType != OrderType::MARKET
+                                 ? OrderType::CANCEL
+                                 : tradeInfo.orderType;
+      histograms_[static_cast<std::size_t>(type)].Record(
+          ReadTscp() - tradeInfo.timestamp);
+    }
+  }
+
+  const HdrHistogram &Get(OrderType type) const {
+    return histograms_[static_cast<std::size_t>(type)];
+  }
+  const HdrHistogram &GetAcks() const { return acks_; }
+
+private:
+  std::array<HdrHistogram, 4> histograms_;
+  HdrHistogram acks_;
+};
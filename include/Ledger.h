@@ -0,0 +1,69 @@
+#pragma once
+#include "Order.h"
+#include "SeqLock.h"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// What every agent starts with, cash in pence
+static constexpr std::int64_t INITIAL_CASH = 1'000'000'000;
+static constexpr std::int64_t INITIAL_UNITS = 100'000;
+
+// One client's holdings as settled by the engine. Orders resting on the book
+// hold back what they could still spend or sell.
+struct Position {
+  std::int64_t cash{0}; // Pence
+  std::int64_t units{0};
+  std::int64_t heldCash{0};  // Committed to resting buys
+  std::int64_t heldUnits{0}; // Committed to resting sells
+
+  std::int64_t AvailableCash() const { return cash - heldCash; }
+  std::int64_t AvailableUnits() const { return units - heldUnits; }
+};
+
+// Every client's position, indexed by ClientRef and only ever written by the
+// matching thread as a side effect of the orders it processes, so fills are
+// settled exactly once and in sequence. Orders a client can't cover are
+// rejected before they reach the book. Other threads read per client
+// snapshots, republished after each order that changed them. Clients without
+// an account trade unchecked and unrecorded. An account costs its position,
+// its snapshot and two flags, so a million idle clients stay small.
+class Ledger {
+public:
+  // Only while the simulation is being set up, reopening resets the account
+  void Open(ClientRef clientRef, std::int64_t cash, std::int64_t units);
+  bool IsOpen(ClientRef clientRef) const {
+    return clientRef < open_.size() && open_[clientRef];
+  }
+
+  // Matching thread only
+  bool CanAfford(ClientRef clientRef, Side side, PriceTicks price,
+                 Quantity quantity) const;
+  void Hold(ClientRef clientRef, Side side, PriceTicks price,
+            Quantity quantity);
+  void Release(ClientRef clientRef, Side side, PriceTicks price,
+               Quantity quantity);
+  void Settle(ClientRef buyer, ClientRef seller, PriceTicks price,
+              Quantity quantity);
+  // Republishes every position changed since the last call
+  void Publish();
+  const Position &Get(ClientRef clientRef) const {
+    return positions_[clientRef];
+  }
+
+  // Safe from any thread
+  Position GetSnapshot(ClientRef clientRef) const {
+    return snapshots_[clientRef].Load();
+  }
+
+private:
+  Position *Touch(ClientRef clientRef);
+
+  std::vector<Position> positions_;
+  // A deque as snapshots can't be moved when it grows
+  std::deque<SeqLock<Position>> snapshots_;
+  std::vector<std::uint8_t> open_;
+  std::vector<std::uint8_t> touched_;
+  std::vector<ClientRef> changed_;
+};
@@ -0,0 +1,21 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// Read only mapping of a whole file, for formats read in place
+class MappedFile {
+public:
+  explicit MappedFile(const std::string &path);
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  const std::byte *data() const { return data_; }
+  std::size_t size() const { return size_; }
+
+private:
+  int fd_{-1};
+  std::byte *data_{nullptr};
+  std::size_t size_{0};
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Order.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Incremental L2 updates published by the engine. Level updates carry the
+// new total resting quantity at that price, trades carry the traded quantity
+// and the side of the incoming (aggressing) order. A book image, sent as one
+// unit when a subscriber resyncs, has a SNAPSHOT update per resting level,
+// or a single empty one for an empty book.
+
+enum class MarketDataType : std::uint8_t {
+  LEVEL_ADD,
+  LEVEL_CHANGE,
+  LEVEL_DELETE,
+  TRADE,
+  SNAPSHOT
+};
+
+struct MarketDataUpdate {
+  std::uint64_t seq;   // Number of the processed order that caused the update
+  MarketDataType type;
+  bool lastInSeq;      // Last update caused by this order
+  Side side;
+  std::uint32_t level; // Price level index
+  Price price;
+  Quantity quantity;
+};
+
+// Every update produced while processing a single incoming order, published
+// as one unit so subscribers only ever see the book between orders
+
+class MarketDataBatch {
+public:
+  MarketDataBatch() { updates_.reserve(64); }
+
+  void Add(MarketDataType type, Side side, std::uint32_t level, Price price,
+           Quantity quantity) {
+    updates_.push_back(
+        MarketDataUpdate{0, type, false, side, level, price, quantity});
+  }
+
+  // Stamps the batch with its sequence number and marks its last update
+  void Seal(std::uint64_t seq) {
+    for (auto &update : updates_) {
+      update.seq = seq;
+    }
+    updates_.back().lastInSeq = true;
+  }
+
+  MarketDataUpdate *data() { return updates_.data(); }
+  std::size_t size() const { return updates_.size(); }
+  bool empty() const { return updates_.empty(); }
+  void clear() { updates_.clear(); }
+
+private:
+  std::vector<MarketDataUpdate> updates_;
+};
@@ -0,0 +1,56 @@
+#pragma once
+#include "BroadcastRingBuffer.h"
+#include "MarketData.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+static constexpr std::size_t MARKET_DATA_BUFFER_SIZE = 16384;
+
+using MarketDataStream =
+    BroadcastRingBuffer<MarketDataUpdate, MARKET_DATA_BUFFER_SIZE>;
+
+// Bounded stream of incremental L2 updates from the matching thread to a
+// fixed set of subscribers, each reading at its own pace through its own
+// cursor. Publishing is a sequential copy and a single release store, the
+// matching thread never touches subscriber state and never waits: a
+// subscriber a full stream behind is dropped and marked lagging. It then asks
+// to resync, and the engine puts it back at the head of the stream and
+// follows with an image of the book.
+
+class MarketDataFeed {
+public:
+  explicit MarketDataFeed(std::size_t nSubscribers);
+
+  // Matching thread only, seq is the engine's number for the order
+  void Publish(MarketDataBatch &batch, std::uint64_t seq);
+  // Matching thread only. Once a subscriber has asked to resync, the engine
+  // builds an image of its book and publishes it here, after putting every
+  // subscriber that asked back at the head of the stream.
+  bool ResyncPending() const {
+    return pendingResyncs_.load(std::memory_order_acquire) != 0;
+  }
+  void PublishSnapshot(MarketDataBatch &image, std::uint64_t seq);
+
+  std::size_t Poll(std::size_t subscriber, MarketDataUpdate *updates,
+                   std::size_t maxUpdates);
+  // Dropped for falling behind, its polls return nothing until it resyncs
+  bool IsLagging(std::size_t subscriber) const {
+    return stream_->IsDetached(subscriber);
+  }
+  // Only once lagging
+  void RequestResync(std::size_t subscriber);
+  // Times a subscriber was dropped, safe from any thread
+  std::uint64_t GetDropped() const {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+  std::size_t subscribers() const { return stream_->consumers(); }
+  bool empty() const { return stream_->empty(); }
+
+private:
+  std::unique_ptr<MarketDataStream> stream_;
+  std::unique_ptr<std::atomic<bool>[]> resyncRequested_;
+  std::atomic<std::size_t> pendingResyncs_{0};
+  std::atomic<std::uint64_t> dropped_{0};
+};
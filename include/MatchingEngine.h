@@ -1,12 +1,18 @@
 #pragma once
 
 #include "AgentStrategy.h"
+#include "Ledger.h"
+#include "OrderJournal.h"
 #include "OrderPool.h"
 #include "Orderbook.h"
 #include "RingBuffer.h"
+#include <cstddef>
 #include <cstdint>
 #include <unordered_map>
 
+// Most orders the engine takes out of its buffer per pass
+static constexpr std::size_t ENGINE_DRAIN_BATCH = 16;
+
 class Dispatcher;
 class AgentManager;
 
@@ -14,12 +20,36 @@ class MatchingEngine {
 public:
   void ProcessOrder(Order *order);
   MatchingEngine(Orderbook &orderbook, OrderPool *orderPool)
-      : orderbook_(orderbook), orderPool_(orderPool) {};
+      : orderbook_(orderbook), orderPool_(orderPool) {
+    orderbook_.AttachLedger(&ledger_);
+  };
 
+  // Sequences orders until Stop(), only checking for it once the buffer
+  // has run dry
   void Start();
   void Stop();
+  // Before Start(), clamped to [1, ENGINE_DRAIN_BATCH]. A batch of 1 pops
+  // and sequences one order at a time with nothing prefetched.
+  void SetDrainBatch(std::size_t drainBatch);
+  // Pushes as many of the orders as fit into the engine's buffer, for a
+  // single producer thread outside the agent pipeline
+  std::size_t Submit(Order *const *orders, std::size_t count) {
+    return orders_.Push(orders, count);
+  }
+  // Sequences every order waiting in the buffer on the calling thread, for
+  // lockstep runs where the engine has no thread of its own
+  std::size_t Drain();
+  // Journals every order Start() sequences along with a digest of the
+  // execution reports they produce
+  void AttachJournal(OrderJournal *journal);
+  void AttachTradeDigest(TradeDigest *tradeDigest);
 
   std::uint64_t GetProcessedOrders() const { return ordersProcessed_; }
+  std::uint64_t GetRejectedOrders() const { return ordersRejected_; }
+  // Accounts are opened before the engine starts, afterwards only the
+  // snapshots may be read from other threads
+  Ledger &GetLedger() { return ledger_; }
+  const Ledger &GetLedger() const { return ledger_; }
 
   friend class OrderDispatcher;
   friend class Agent;
@@ -28,16 +58,27 @@ public:
 private:
   std::uint64_t counter_{0};
   std::uint64_t ordersProcessed_{0}; // for benchmarking
+  std::uint64_t ordersRejected_{0};
+  std::size_t drainBatch_{ENGINE_DRAIN_BATCH};
   Orderbook &orderbook_;
   OrderPool *orderPool_;
+  Ledger ledger_;
   RingBuffer<Order *, 1024> orders_;
+  OrderJournal *journal_{nullptr};
+  TradeDigest *tradeDigest_{nullptr};
   std::unordered_map<OrderId, Order *> ordersMap_;
 
   std::atomic<bool> running_{false};
 
   void MatchLimitOrder(Order *order);
+  void RestLimitOrder(Order *order);
   void MatchMarketOrder(Order *order);
   void CancelOrder(Order *order);
+  bool CanAfford(const Order *order) const;
+  bool CanAffordFill(const Order *order, std::uint64_t index) const;
+  void RejectOrder(Order *order);
 
   Order *CreateCancelOrder(Order *order);
+  void SequenceOrder(Order *order);
+  std::size_t SequenceBatch();
 };
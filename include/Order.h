@@ -1,66 +1,97 @@
 #pragma once
 #include <algorithm>
+#include <cmath>
 #include <cstdint>
 #include <vector>
 
 using OrderId = std::uint64_t;
 using Price = double;
+using PriceTicks = std::int32_t; // Price in whole ticks (pence)
 using Quantity = std::uint32_t;
 using ClientRef = std::uint64_t;
 using Timestamp = std::uint64_t;
+using PoolIndex = std::int32_t;
 
-enum class Side { Buy, Sell };
+static constexpr Price PRICE_TICKS_PER_UNIT = 100;
 
-enum class OrderType { LIMIT, MARKET, CANCEL };
-class Order {
+inline PriceTicks PriceToTicks(const Price price) {
+  return static_cast<PriceTicks>(std::lround(price * PRICE_TICKS_PER_UNIT));
+}
+
+inline Price TicksToPrice(const PriceTicks ticks) {
+  return ticks / PRICE_TICKS_PER_UNIT;
+}
+
+enum class Side : std::uint8_t { Buy, Sell };
+
+// MASS_CANCEL removes every resting order of its client on its side whose
+// price passes its price filter, one message however many orders it takes out
+enum class OrderType : std::uint8_t { LIMIT, MARKET, CANCEL, MASS_CANCEL };
+
+// Which resting orders a MASS_CANCEL takes, relative to its own price
+enum class PriceFilter : std::uint8_t { ANY, AT_OR_ABOVE, AT_OR_BELOW };
+
+// The part of an order the book walks while matching, half a cache line so a
+// level's queue touches as few lines as possible. Everything only needed once
+// an order trades or is reported lives in its OrderInfo, kept by the pool in
+// a parallel array under the same index.
+class alignas(32) Order {
 private:
   OrderId id_;
-  OrderType type_;
-  ClientRef clientRef_;
-  Side side_;
-  Price price_;
-  Quantity initialQuantity_;
+  PriceTicks price_;
   Quantity remainingQuantity_;
-  std::int64_t index_{-1};
-  std::int64_t prev_{-1}; // Prev -> closer to the head (older orders)
-  std::int64_t next_{-1}; // Next -> closer to the tail (newer orders)
-  Timestamp timestamp_;
+  PoolIndex index_{-1};
+  PoolIndex prev_{-1}; // Prev -> closer to the head (older orders)
+  PoolIndex next_{-1}; // Next -> closer to the tail (newer orders)
+  Side side_;
+  OrderType type_;
+  PriceFilter filter_{PriceFilter::ANY}; // Only read for MASS_CANCEL
 
 public:
   OrderId GetOrderId() const { return id_; }
   OrderType GetOrderType() const { return type_; }
-  ClientRef GetClientRef() const { return clientRef_; }
   Side GetSide() const { return side_; }
-  Price GetPrice() const { return price_; }
-  Quantity GetInitialQuantity() const { return initialQuantity_; }
+  Price GetPrice() const { return TicksToPrice(price_); }
+  PriceTicks GetPriceTicks() const { return price_; }
   Quantity GetRemainingQuantity() const { return remainingQuantity_; }
-  std::int64_t GetIndex() const { return index_; }
-  std::int64_t GetPrev() const { return prev_; }
-  std::int64_t GetNext() const { return next_; }
+  PoolIndex GetIndex() const { return index_; }
+  PoolIndex GetPrev() const { return prev_; }
+  PoolIndex GetNext() const { return next_; }
+  PriceFilter GetPriceFilter() const { return filter_; }
 
   void SetOrderId(const OrderId id) { id_ = id; }
   void SetOrderType(const OrderType type) { type_ = type; }
-  void GetClientRef(const ClientRef clientRef) { clientRef_ = clientRef; }
   void SetSide(const Side side) { side_ = side; }
-  void SetPrice(const Price price) { price_ = price; }
-  void SetInitialQuantity(const Quantity quantity) {
-    initialQuantity_ = quantity;
-  }
+  void SetPrice(const Price price) { price_ = PriceToTicks(price); }
   void SetRemainingQuantity(const Quantity quantity) {
     remainingQuantity_ = quantity;
   }
-  void SetIndex(const std::int64_t index) { index_ = index; }
-  void SetPrev(const std::int64_t index) { prev_ = index; }
-  void SetNext(const std::int64_t index) { next_ = index; }
-
-  Order(OrderId orderId, OrderType orderType, ClientRef clientRef, Side side,
-        Price price, Quantity quantity)
-      : id_(orderId), type_(orderType), clientRef_(clientRef), side_(side),
-        price_(price), initialQuantity_(quantity),
-        remainingQuantity_(quantity) {}
+  void SetIndex(const PoolIndex index) { index_ = index; }
+  void SetPrev(const PoolIndex index) { prev_ = index; }
+  void SetNext(const PoolIndex index) { next_ = index; }
+  void SetPriceFilter(const PriceFilter filter) { filter_ = filter; }
+
+  Order(OrderId orderId, OrderType orderType, Side side, Price price,
+        Quantity quantity)
+      : id_(orderId), price_(PriceToTicks(price)),
+        remainingQuantity_(quantity), side_(side), type_(orderType) {}
   Order() {}
 
   bool isFilled() const { return remainingQuantity_ == 0; }
+  // Whether a MASS_CANCEL from the same client takes this order
+  bool MatchesMassCancel(const Order &massCancel) const {
+    if (side_ != massCancel.side_) {
+      return false;
+    }
+    switch (massCancel.filter_) {
+    case PriceFilter::AT_OR_ABOVE:
+      return price_ >= massCancel.price_;
+    case PriceFilter::AT_OR_BELOW:
+      return price_ <= massCancel.price_;
+    default:
+      return true;
+    }
+  }
 
   Quantity Fill(Order &order) {
     const Quantity orderRemaining = order.GetRemainingQuantity();
@@ -72,4 +103,19 @@ public:
   }
 };
 
+static_assert(sizeof(Order) == 32, "Order should be half a cache line");
+
+// Cold half of an order, read when it trades, is cancelled or is journaled.
+// While the order rests it is also linked into its client's list of resting
+// orders, which mass cancels walk instead of the whole book.
+struct OrderInfo {
+  ClientRef clientRef{0};
+  Quantity initialQuantity{0};
+  Timestamp timestamp{0}; // Counter ticks when the strategy created it
+  PoolIndex clientPrev{-1};
+  PoolIndex clientNext{-1};
+};
+
+static_assert(sizeof(OrderInfo) == 32, "OrderInfo should be 32 bytes");
+
 using Orders = std::vector<Order>;
@@ -0,0 +1,115 @@
+#pragma once
+#include "MappedFile.h"
+#include "Order.h"
+#include "Trade.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <thread>
+
+static constexpr std::uint64_t JOURNAL_MAGIC = 0x4c4e524a4b4f4f42; // BOOKJRNL
+static constexpr std::uint32_t JOURNAL_VERSION = 1;
+// Upper bound on journaled orders, the file is sparse until written
+static constexpr std::size_t JOURNAL_MAX_RECORDS = std::size_t{1} << 28;
+// Disk space is reserved this far ahead of the matching thread
+static constexpr std::size_t JOURNAL_ALLOCATE_AHEAD = 64 << 20;
+
+// One sequenced inbound order as the engine saw it
+struct JournalRecord {
+  OrderId id;
+  ClientRef clientRef;
+  Price price;
+  Quantity quantity;
+  std::uint8_t type; // OrderType
+  std::uint8_t side;   // Side
+  std::uint8_t filter; // PriceFilter, only meaningful for mass cancels
+  std::uint8_t reserved;
+};
+
+static_assert(sizeof(JournalRecord) == 32, "Journal records are 32 bytes");
+
+struct JournalHeader {
+  std::uint64_t magic;
+  std::uint32_t version;
+  std::uint32_t recordSize;
+  std::uint64_t nRecords;
+  std::uint64_t nReports;    // Execution reports produced by those records
+  std::uint64_t tradeDigest; // TradeDigest over those reports
+  std::uint64_t reserved[3];
+};
+
+static_assert(sizeof(JournalHeader) == 64, "Journal header is 64 bytes");
+
+// Order independent of timestamps and pool slots, so a replay producing the
+// same reports in the same order produces the same digest
+class TradeDigest {
+public:
+  void Add(const TradeBatch &batch);
+
+  std::uint64_t GetDigest() const { return digest_; }
+  std::uint64_t GetNReports() const { return nReports_; }
+
+private:
+  std::uint64_t digest_{0};
+  std::uint64_t nReports_{0};
+};
+
+// Appends every order the engine sequences to a memory mapped file. The
+// matching thread only ever copies 32 bytes into the mapping, a background
+// thread reserves disk space ahead of it and writes completed pages back.
+// Once full the journal stops recording rather than block the engine, the
+// header then describes the complete prefix.
+
+class OrderJournal {
+public:
+  explicit OrderJournal(const std::string &path,
+                        std::size_t maxRecords = JOURNAL_MAX_RECORDS);
+  ~OrderJournal();
+
+  OrderJournal(const OrderJournal &) = delete;
+  OrderJournal &operator=(const OrderJournal &) = delete;
+
+  // Matching thread only
+  void Append(const Order &order, const OrderInfo &info);
+  TradeDigest &GetTradeDigest() { return tradeDigest_; }
+
+  // Writes the header and trims the file to what was recorded
+  void Close();
+
+  std::uint64_t size() const {
+    return nRecords_.load(std::memory_order_relaxed);
+  }
+  bool full() const { return full_; }
+
+private:
+  void RunFlusher();
+
+  int fd_{-1};
+  std::byte *map_{nullptr};
+  std::size_t mapSize_{0};
+  std::size_t maxRecords_;
+  JournalRecord *records_{nullptr};
+  std::atomic<std::uint64_t> nRecords_{0};
+  bool full_{false};
+  TradeDigest tradeDigest_;
+  TradeDigest fullDigest_; // Digest as of the last recorded order
+  std::atomic<bool> running_{false};
+  std::thread flusher_;
+};
+
+// Read only view of a finished journal, records are read straight out of
+// the mapping
+class JournalReader {
+public:
+  explicit JournalReader(const std::string &path);
+
+  const JournalHeader &GetHeader() const { return *header_; }
+  std::span<const JournalRecord> GetRecords() const { return records_; }
+
+private:
+  MappedFile file_;
+  const JournalHeader *header_{nullptr};
+  std::span<const JournalRecord> records_;
+};
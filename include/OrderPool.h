@@ -7,47 +7,65 @@
 #include <stdexcept>
 #include <vector>
 
-using PoolIndex = std::int64_t;
 static constexpr int MAX_ORDERS = 50'000'000;
-static constexpr int64_t INVALID_POOL_INDEX = -1;
+static constexpr PoolIndex INVALID_POOL_INDEX = -1;
 class OrderPool {
 
 private:
-  struct Node {
-    Order order;
-    std::int64_t next_free;
-  };
-  std::vector<Node> orders_;
-  std::int64_t free_head_{0};
+  // Hot and cold halves of each order under the same index. Free slots are
+  // chained through their order's next link.
+  std::vector<Order> orders_;
+  std::vector<OrderInfo> infos_;
+  PoolIndex free_head_{0};
   std::mutex mtx_;
 
 public:
-  OrderPool() {
-    orders_.resize(MAX_ORDERS);
-    for (std::size_t i = 0; i < MAX_ORDERS - 1; ++i) {
-      orders_[i].next_free = i + 1;
+  explicit OrderPool(std::size_t capacity = MAX_ORDERS) {
+    orders_.resize(capacity);
+    infos_.resize(capacity);
+    for (std::size_t i = 0; i + 1 < capacity; ++i) {
+      orders_[i].SetNext(static_cast<PoolIndex>(i + 1));
     }
-    orders_[MAX_ORDERS - 1].next_free = INVALID_POOL_INDEX;
+    orders_[capacity - 1].SetNext(INVALID_POOL_INDEX);
   };
 
-  Order *get_order(PoolIndex index) {
-    std::lock_guard<std::mutex> lock(mtx_);
-    return &orders_.at(index).order;
-  }
+  std::size_t capacity() const { return orders_.size(); }
 
+  // Slots never move, so reading one doesn't need the free list's lock
+  Order *get_order(PoolIndex index) { return &orders_.at(index); }
+  OrderInfo *get_info(PoolIndex index) { return &infos_.at(index); }
+
+  // Order builders set every field they use except the price filter, which
+  // only mass cancels set, so it is reset here for a reused slot
   PoolIndex allocate() {
     std::lock_guard<std::mutex> lock(mtx_);
     if (free_head_ == INVALID_POOL_INDEX) {
       throw std::logic_error("Allocating from a full OrderPool");
     }
     auto index = free_head_;
-    free_head_ = orders_[index].next_free;
+    free_head_ = orders_[index].GetNext();
+    orders_[index].SetPriceFilter(PriceFilter::ANY);
     return index;
   };
 
+  // Allocates a block of slots under a single lock
+  void allocate(PoolIndex *indices, std::size_t count) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    for (std::size_t i = 0; i < count; ++i) {
+      if (free_head_ == INVALID_POOL_INDEX) {
+        throw std::logic_error("Allocating from a full OrderPool");
+      }
+      indices[i] = free_head_;
+      free_head_ = orders_[free_head_].GetNext();
+      orders_[indices[i]].SetPriceFilter(PriceFilter::ANY);
+    }
+  };
+
   void deallocate(PoolIndex index) {
     std::lock_guard<std::mutex> lock(mtx_);
-    orders_[index].next_free = free_head_;
+    orders_[index].SetNext(free_head_);
     free_head_ = index;
   };
 };
+
+static_assert(MAX_ORDERS <= INT32_MAX, "Pool indices are 32 bits");
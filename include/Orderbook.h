@@ -1,32 +1,82 @@
 #pragma once
+#include "BookView.h"
 #include "FlatHashMap.h"
+#include "Indicators.h"
+#include "Ledger.h"
+#include "MarketData.h"
+#include "MarketDataFeed.h"
 #include "Order.h"
 #include "OrderPool.h"
 #include "PriceLevel.h"
+#include "SeqLock.h"
+#include "Tape.h"
+#include "Trade.h"
 #include "TradeDispatcher.h"
 #include <array>
+#include <cstddef>
 #include <cstdint>
 #include <limits>
 #include <optional>
 #include <shared_mutex>
+#include <vector>
 
 static constexpr int MAX_PRICE_LEVELS = 2001; // +/- 1000 levels
+// Price of level 0 in ticks
+static constexpr PriceTicks MIN_PRICE_TICKS = 10'000;
 static constexpr uint64_t BITMAP_SIZE = (MAX_PRICE_LEVELS + 63) / 64;
 static constexpr uint64_t INVALID_PRICE_LEVEL_INDEX =
     std::numeric_limits<uint64_t>::max();
+// Slots in the resting order index, must be a power of two
+static constexpr std::size_t ORDER_MAP_CAPACITY = 8'388'608;
 
 class Orderbook {
 public:
-  Orderbook(OrderPool *orderPool, TradeDispatcher &tradeDispatcher);
+  Orderbook(OrderPool *orderPool, TradeDispatcher &tradeDispatcher,
+            std::size_t orderMapCapacity = ORDER_MAP_CAPACITY);
   void AddOrder(Order *order);
   void RemoveOrder(Order *order);
   void FillOrder(Order *order, uint64_t index);
   void CancelOrder(Order *cancelOrder);
+  // Cancels the client's resting orders the mass cancel selects, reporting
+  // each one and then a summary
+  void MassCancel(Order *massCancel);
+  // Reports an order back unfilled without it touching the book
+  void RejectOrder(Order *order);
+  // Reports a limit order that has just been added to the book
+  void AckOrder(const Order *order);
+  // Pulls in the price level an incoming order rests on or cancels from and
+  // the index slot for the id it will be sequenced as, so the engine can
+  // warm them while it matches the order before
+  void Prefetch(const Order *order, OrderId orderId) const;
+  void DispatchTrades();
+  // Execution reports produced so far by the current incoming order
+  const TradeBatch &GetTradeBatch() const { return tradeBatch_; }
+  // Publishes every L2 change made by the current incoming order, only
+  // collected once a feed has been attached
+  void AttachMarketDataFeed(MarketDataFeed *marketDataFeed);
+  void PublishMarketData(std::uint64_t seq);
+  // Publishes the top of book if the current incoming order changed it
+  void PublishTopOfBook(std::uint64_t seq);
+  // Tapes every trade and top of book change, once a tape has been attached
+  void AttachTape(TapeWriter *tape);
+  void PublishTape(std::uint64_t seq);
+  // Holds what resting orders commit and settles every fill, once attached
+  void AttachLedger(Ledger *ledger);
 
   std::optional<uint64_t> GetBestBid();
   std::optional<uint64_t> GetBestAsk();
+  // Safe from any thread, reads the last published top of book and
+  // indicators
+  BookView GetBookView() const;
   uint64_t PriceToIndex(const Price price) const;
   Price IndexToPrice(const uint64_t index) const;
+  // Integer forms for the matching path, clamped like their Price forms
+  uint64_t TicksToIndex(const PriceTicks ticks) const;
+  PriceTicks IndexToTicks(const uint64_t index) const;
+  // Matching thread only, or once it has stopped
+  Quantity GetLevelQuantity(Side side, uint64_t index) const;
+  // What FillOrder(order, index) would fill, matching thread only
+  Quantity GetFillQuantity(const Order *order, uint64_t index) const;
 
   void PrintBook();
 
@@ -39,14 +89,35 @@ private:
   uint64_t asks_bitmap_[BITMAP_SIZE] = {};
   uint64_t bestBidIndex_{INVALID_PRICE_LEVEL_INDEX};
   uint64_t bestAskIndex_{INVALID_PRICE_LEVEL_INDEX};
-  FlatHashMap<OrderId, PoolIndex> orderMap_{8'388'608};
+  FlatHashMap<OrderId, PoolIndex> orderMap_;
+  // Newest resting order of each client, indexed by ClientRef and linked
+  // through the orders' OrderInfo
+  std::vector<PoolIndex> clientOrders_;
   mutable std::shared_mutex mtx_;
 
   void setBidBit(const uint64_t index);
   void setAskBit(const uint64_t index);
   void clearBidBit(const uint64_t index);
   void clearAskBit(const uint64_t index);
+  void RecordLevel(Side side, uint64_t index, MarketDataType type);
+  void PublishBookImage(std::uint64_t seq);
+  void LinkClientOrder(PoolIndex poolIndex, OrderInfo &info);
+  void UnlinkClientOrder(OrderInfo &info);
 
+  TradeBatch tradeBatch_;
   TradeDispatcher &tradeDispatcher_;
+  MarketDataBatch marketDataBatch_;
+  MarketDataFeed *marketDataFeed_{nullptr};
+  TapeWriter *tape_{nullptr};
+  Ledger *ledger_{nullptr};
+  Price lastTradePrice_{0};
+  Quantity lastTradeQuantity_{0};
+  TopOfBook publishedTop_{}; // Matching thread only
+  // Read by agents, on its own cache line away from the engine's state
+  SeqLock<TopOfBook> topOfBook_;
+  IndicatorService indicators_;
   OrderPool *orderPool_;
 };
+
+static_assert(sizeof(SeqLock<TopOfBook>) == 64,
+              "Top of book should fit in a single cache line");
@@ -0,0 +1,85 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Hardware performance counters read through perf_event_open. Counters the
+// machine or the kernel won't give us (virtual machines, a strict
+// perf_event_paranoid) are reported as unavailable rather than failing the
+// run. Building with PERF_COUNTERS off compiles them away.
+
+#if defined(PERF_COUNTERS) && defined(__linux__)
+inline constexpr bool PERF_COUNTERS_ENABLED = true;
+#else
+inline constexpr bool PERF_COUNTERS_ENABLED = false;
+#endif
+
+enum class PerfEvent : std::uint8_t {
+  CYCLES,
+  INSTRUCTIONS,
+  L1D_MISSES,
+  LLC_MISSES,
+  BRANCH_MISSES,
+  DTLB_MISSES,
+  PAGE_FAULTS,
+  CONTEXT_SWITCHES,
+  COUNT
+};
+
+static constexpr std::size_t N_PERF_EVENTS =
+    static_cast<std::size_t>(PerfEvent::COUNT);
+
+struct PerfSample {
+  std::array<std::uint64_t, N_PERF_EVENTS> values{};
+  std::array<bool, N_PERF_EVENTS> valid{};
+
+  bool Has(PerfEvent event) const {
+    return valid[static_cast<std::size_t>(event)];
+  }
+  std::uint64_t Get(PerfEvent event) const {
+    return values[static_cast<std::size_t>(event)];
+  }
+  bool empty() const;
+};
+
+// Counts the thread that opened it, and with inherit every thread it creates
+// afterwards (their counts are added in as they exit)
+class PerfCounters {
+public:
+  explicit PerfCounters(bool inherit = false);
+  ~PerfCounters();
+
+  PerfCounters(const PerfCounters &) = delete;
+  PerfCounters &operator=(const PerfCounters &) = delete;
+
+  void Start();
+  void Stop();
+  // Scaled up for the time a counter was multiplexed off the hardware
+  PerfSample Read() const;
+
+private:
+  std::array<int, N_PERF_EVENTS> fds_;
+};
+
+// Counts one pipeline thread from construction until destruction, then files
+// the counts under its name for PrintThreadPerfReport. The name is kept by
+// reference, so pass a literal.
+class ThreadPerfCounters {
+public:
+  explicit ThreadPerfCounters(std::string_view name);
+  ~ThreadPerfCounters();
+
+private:
+  std::string_view name_;
+  PerfCounters counters_;
+};
+
+// Per operation breakdown of one benchmark phase
+void PrintPerfReport(std::string_view phase, const PerfSample &sample,
+                     std::uint64_t nOperations);
+// Every thread counted so far, normalised per thousand instructions
+void PrintThreadPerfReport();
+// Forgets the threads counted so far, between runs in one process
+void ResetThreadPerfReports();
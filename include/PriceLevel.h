@@ -1,8 +1,10 @@
 #pragma once
+#include "Order.h"
 #include <cstdint>
 
 struct PriceLevel {
-  std::int64_t tail_{-1};
-  std::int64_t head_{-1};
+  PoolIndex tail_{-1};
+  PoolIndex head_{-1};
+  Quantity quantity_{0}; // Total remaining quantity resting at this level
   bool empty() const { return head_ == -1; }
 };
@@ -22,7 +22,9 @@ private:
 public:
   bool Push(T &&item);
   bool Push(const T &item);
+  size_t Push(const T *items, size_t count);
   bool Pop(T &item);
+  size_t Pop(T *items, size_t max_items);
   size_t size() const;
   bool empty() const;
   bool full() const;
@@ -55,6 +57,22 @@ bool RingBuffer<T, n>::Push(const T &item) {
   return true;
 }
 
+// Pushes as many of the items as will fit and publishes them with a single
+// release store, returns how many were pushed
+template <typename T, std::size_t n>
+size_t RingBuffer<T, n>::Push(const T *items, size_t count) {
+  size_t current_head = head_.load(std::memory_order_relaxed);
+  size_t current_tail = tail_.load(std::memory_order_acquire);
+  size_t free_slots = (current_tail - current_head - 1) & (n - 1);
+  size_t to_push = count < free_slots ? count : free_slots;
+
+  for (size_t i = 0; i < to_push; ++i) {
+    buffer_[(current_head + i) & (n - 1)] = items[i];
+  }
+  head_.store((current_head + to_push) & (n - 1), std::memory_order_release);
+  return to_push;
+}
+
 template <typename T, std::size_t n> bool RingBuffer<T, n>::Pop(T &item) {
   size_t current_tail = tail_.load(std::memory_order_relaxed);
 
@@ -68,6 +86,22 @@ template <typename T, std::size_t n> bool RingBuffer<T, n>::Pop(T &item) {
   return true;
 }
 
+// Pops up to max_items and frees their slots with a single release store,
+// returns how many were popped
+template <typename T, std::size_t n>
+size_t RingBuffer<T, n>::Pop(T *items, size_t max_items) {
+  size_t current_tail = tail_.load(std::memory_order_relaxed);
+  size_t current_head = head_.load(std::memory_order_acquire);
+  size_t available = (current_head - current_tail) & (n - 1);
+  size_t to_pop = max_items < available ? max_items : available;
+
+  for (size_t i = 0; i < to_pop; ++i) {
+    items[i] = std::move(buffer_[(current_tail + i) & (n - 1)]);
+  }
+  tail_.store((current_tail + to_pop) & (n - 1), std::memory_order_release);
+  return to_pop;
+}
+
 template <typename T, std::size_t n> size_t RingBuffer<T, n>::size() const {
   size_t current_head = head_.load(std::memory_order_acquire);
   size_t current_tail = tail_.load(std::memory_order_acquire);
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// Single writer sequence lock around a small trivially copyable value. The
+// writer never waits, readers retry if they overlap a write. The value is
+// held as relaxed atomic words so a torn read is detected rather than being
+// a data race.
+
+template <typename T> class alignas(64) SeqLock {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "T must be trivially copyable");
+
+private:
+  static constexpr std::size_t nWords =
+      (sizeof(T) + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t);
+
+  std::atomic<std::uint64_t> seq_{0};
+  std::array<std::atomic<std::uint64_t>, nWords> words_{};
+
+public:
+  void Store(const T &value);
+  T Load() const;
+};
+
+template <typename T> void SeqLock<T>::Store(const T &value) {
+  std::uint64_t words[nWords]{};
+  std::memcpy(words, &value, sizeof(T));
+
+  const std::uint64_t seq = seq_.load(std::memory_order_relaxed);
+  seq_.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  for (std::size_t i = 0; i < nWords; ++i) {
+    words_[i].store(words[i], std::memory_order_relaxed);
+  }
+  seq_.store(seq + 2, std::memory_order_release);
+}
+
+template <typename T> T SeqLock<T>::Load() const {
+  std::uint64_t words[nWords];
+  std::uint64_t before;
+  std::uint64_t after;
+  do {
+    before = seq_.load(std::memory_order_acquire);
+    for (std::size_t i = 0; i < nWords; ++i) {
+      words[i] = words_[i].load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    after = seq_.load(std::memory_order_relaxed);
+  } while ((before & 1) || before != after);
+
+  T value;
+  std::memcpy(&value, words, sizeof(T));
+  return value;
+}
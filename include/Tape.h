@@ -0,0 +1,156 @@
+#pragma once
+#include "MappedFile.h"
+#include "Order.h"
+#include "RingBuffer.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+static constexpr std::uint64_t TAPE_MAGIC = 0x455041544b4f4f42; // BOOKTAPE
+static constexpr std::uint32_t TAPE_VERSION = 1;
+static constexpr std::size_t TAPE_BUFFER_SIZE = 65536;
+// Events per column block, each block decodes on its own
+static constexpr std::size_t TAPE_BLOCK_EVENTS = 4096;
+
+struct TapeTrade {
+  std::uint64_t seq; // Number of the processed order that traded
+  Price price;
+  Quantity quantity;
+  Side side; // Side of the incoming order
+  ClientRef buyer;
+  ClientRef seller;
+};
+
+struct TapeTop {
+  std::uint64_t seq;
+  Price bid; // 0 when that side of the book is empty
+  Price ask;
+  Quantity bidSize;
+  Quantity askSize;
+};
+
+enum class TapeEventType : std::uint8_t { TRADE, TOP };
+
+// What the matching thread enqueues, one per trade or top of book change
+struct TapeEvent {
+  std::uint64_t seq;
+  TapeEventType type;
+  Side side;
+  Price price; // Trade price or best bid
+  Price ask;
+  Quantity quantity; // Trade quantity or bid size
+  Quantity askSize;
+  ClientRef buyer;
+  ClientRef seller;
+};
+
+// Streams the trade tape and top of book tape to a file. The matching thread
+// collects the events of an order and publishes them with a single store
+// into a lock free queue, the writer thread does all of the encoding and I/O.
+//
+// The file is a header followed by blocks of up to TAPE_BLOCK_EVENTS events
+// of one tape. A block is stored by column, each column as LEB128 varints of
+// zigzag encoded differences from the previous row (trade quantity and side
+// are stored as they are). Prices are stored in cents.
+
+class TapeWriter {
+public:
+  explicit TapeWriter(const std::string &path);
+  ~TapeWriter();
+
+  TapeWriter(const TapeWriter &) = delete;
+  TapeWriter &operator=(const TapeWriter &) = delete;
+
+  // Matching thread only
+  void AddTrade(Price price, Quantity quantity, Side side, ClientRef buyer,
+                ClientRef seller);
+  void AddTop(Price bid, Price ask, Quantity bidSize, Quantity askSize);
+  void Publish(std::uint64_t seq);
+
+  // Writes out everything queued and closes the file, call once the
+  // matching engine has stopped
+  void Close();
+
+  std::uint64_t GetNTrades() const { return nTrades_; }
+  std::uint64_t GetNTops() const { return nTops_; }
+  // A write to the file failed, the writer kept draining the queue but the
+  // tape stops at the last complete block. Read after Close.
+  bool failed() const { return failed_; }
+
+private:
+  struct Columns {
+    std::vector<std::int64_t> values[6];
+    std::size_t rows{0};
+  };
+
+  void RunWriter();
+  void Append(const TapeEvent &event);
+  void WriteBlock(TapeEventType type, Columns &columns, std::size_t nColumns);
+
+  std::FILE *file_{nullptr};
+  std::vector<TapeEvent> pending_; // Matching thread only
+  std::unique_ptr<RingBuffer<TapeEvent, TAPE_BUFFER_SIZE>> queue_;
+  Columns trades_;
+  Columns tops_;
+  std::vector<std::uint8_t> encoded_;
+  std::uint64_t nTrades_{0};
+  std::uint64_t nTops_{0};
+  bool failed_{false}; // Writer thread until Close
+  std::atomic<bool> running_{false};
+  std::thread writer_;
+};
+
+// Visits a tape file through a memory mapping one block at a time, so any
+// length of tape is read in the memory of a single block
+class TapeReader {
+public:
+  explicit TapeReader(const std::string &path);
+
+  // Calls visit with every trade, or every top of book change, in tape
+  // order and returns how many there were
+  template <typename Visit> std::uint64_t ForEachTrade(Visit &&visit);
+  template <typename Visit> std::uint64_t ForEachTop(Visit &&visit);
+
+private:
+  // Decodes the next block of the tape at or after offset into trades_ or
+  // tops_ and moves offset past it, returns its rows or 0 at the end
+  std::size_t NextBlock(TapeEventType type, std::size_t &offset);
+
+  MappedFile file_;
+  std::string path_;
+  std::size_t firstBlock_{0};
+  std::vector<std::int64_t> values_[6]; // One per trade column
+  std::vector<TapeTrade> trades_;
+  std::vector<TapeTop> tops_;
+};
+
+template <typename Visit>
+std::uint64_t TapeReader::ForEachTrade(Visit &&visit) {
+  std::uint64_t n = 0;
+  std::size_t offset = firstBlock_;
+  while (const std::size_t rows = NextBlock(TapeEventType::TRADE, offset)) {
+    for (std::size_t i = 0; i < rows; ++i) {
+      visit(std::as_const(trades_[i]));
+    }
+    n += rows;
+  }
+  return n;
+}
+
+template <typename Visit> std::uint64_t TapeReader::ForEachTop(Visit &&visit) {
+  std::uint64_t n = 0;
+  std::size_t offset = firstBlock_;
+  while (const std::size_t rows = NextBlock(TapeEventType::TOP, offset)) {
+    for (std::size_t i = 0; i < rows; ++i) {
+      visit(std::as_const(tops_[i]));
+    }
+    n += rows;
+  }
+  return n;
+}
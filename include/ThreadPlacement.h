@@ -0,0 +1,77 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+// Pins pipeline threads to chosen cores. A placement is written as a list of
+// role:cores pairs, e.g. "engine:2,outgoing:4,incoming:6,demux:8,workers:
+// 10-13,io:14", and installed before any pipeline thread starts. Each thread
+// pins itself as it starts, taking the core at its own index within its role,
+// and files where it actually ended up for PrintPlacementReport. Roles left
+// out of the placement float as before.
+
+enum class PipelineRole : std::uint8_t {
+  ENGINE,   // Matching engine, and the lockstep thread
+  OUTGOING, // Agent outgoing loop
+  INCOMING, // Agent incoming loop
+  DEMUX,    // Trade dispatcher demultiplexers, one core per partition
+  WORKERS,  // Batch-synchronous agent workers, one core per worker
+  IO,       // Journal flusher and tape writer
+  COUNT
+};
+
+static constexpr std::size_t N_PIPELINE_ROLES =
+    static_cast<std::size_t>(PipelineRole::COUNT);
+
+struct ThreadPlacement {
+  std::array<std::vector<int>, N_PIPELINE_ROLES> cores;
+
+  const std::vector<int> &Get(PipelineRole role) const {
+    return cores[static_cast<std::size_t>(role)];
+  }
+  bool empty() const;
+};
+
+// Returns nothing if the spec doesn't parse, "-" is the empty placement
+std::optional<ThreadPlacement> ParseThreadPlacement(std::string_view spec);
+// Must be called before any pipeline thread starts
+void SetThreadPlacement(const ThreadPlacement &placement);
+
+// Pins the calling thread if its role has been given cores
+void PinThread(PipelineRole role, std::size_t index = 0);
+
+// Runs the constructing thread on a role's first core until Restore, so the
+// pages it touches first (pool, book, rings) are placed on that core's NUMA
+// node. Does nothing if the role has no cores.
+class FirstTouchPlacement {
+public:
+  explicit FirstTouchPlacement(PipelineRole role);
+  ~FirstTouchPlacement();
+
+  FirstTouchPlacement(const FirstTouchPlacement &) = delete;
+  FirstTouchPlacement &operator=(const FirstTouchPlacement &) = delete;
+
+  void Restore();
+
+private:
+  bool pinned_{false};
+  std::vector<int> previous_;
+};
+
+// Files the NUMA nodes holding the pages of a structure for
+// PrintPlacementReport, sampling up to MEMORY_PLACEMENT_SAMPLES pages spread
+// across it. Pages not yet touched are left out.
+static constexpr std::size_t MEMORY_PLACEMENT_SAMPLES = 256;
+void RecordMemoryPlacement(std::string_view name, const void *address,
+                           std::size_t bytes);
+
+// Where every pinned thread and recorded allocation ended up, prints nothing
+// when no placement was set
+void PrintPlacementReport();
+// Forgets the threads and allocations filed so far, between runs in one
+// process
+void ResetPlacementRecords();
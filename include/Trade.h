@@ -1,11 +1,28 @@
 #pragma once
 
 #include "Order.h"
+#include <cstddef>
+#include <vector>
 
-enum class ExecutionType { CANCEL, PARTIAL, FULL, INVALID };
+// REJECT answers an order the client couldn't cover, it never reached the book.
+// ACK confirms a limit order, or what was left of it after matching, now rests
+// on the book.
+// MASS_CANCEL summarises a mass cancel after the CANCEL notice for each order
+// it took, its quantity is the number of orders cancelled.
+enum class ExecutionType {
+  CANCEL,
+  PARTIAL,
+  FULL,
+  INVALID,
+  REJECT,
+  MASS_CANCEL,
+  ACK
+};
 
 // Trade info gives information on the trade as well as providing the original
-// order from the opposite side
+// order from the opposite side. The timestamp is the creation stamp of the
+// message this report answers, 0 for fills against an order resting on the
+// book as nothing was waiting on those.
 
 struct TradeInfo {
   OrderId orderId;
@@ -16,6 +33,7 @@ struct TradeInfo {
   Quantity quantity;
   Order order;
   ExecutionType type;
+  Timestamp timestamp;
 };
 
 class Trade {
@@ -30,3 +48,34 @@ private:
   TradeInfo askTrade_;
   TradeInfo bidTrade_;
 };
+
+// Collects every execution report produced while processing a single incoming
+// order so the TradeDispatcher can deliver them in one go. Reports for cancel
+// messages themselves are dropped as no agent is waiting on them.
+
+class TradeBatch {
+public:
+  TradeBatch() { reports_.reserve(64); }
+
+  void Add(Trade &&trade) {
+    if (trade.GetAskTrade().orderType != OrderType::CANCEL) {
+      reports_.push_back(trade.GetAskTrade());
+    }
+    if (trade.GetBidTrade().orderType != OrderType::CANCEL) {
+      reports_.push_back(trade.GetBidTrade());
+    }
+  }
+
+  // A report without a counterparty
+  void Add(const TradeInfo &report) { reports_.push_back(report); }
+
+  TradeInfo &operator[](std::size_t i) { return reports_[i]; }
+  TradeInfo *data() { return reports_.data(); }
+  const TradeInfo *data() const { return reports_.data(); }
+  std::size_t size() const { return reports_.size(); }
+  bool empty() const { return reports_.empty(); }
+  void clear() { reports_.clear(); }
+
+private:
+  std::vector<TradeInfo> reports_;
+};
@@ -1,18 +1,98 @@
 #pragma once
+#include "BroadcastRingBuffer.h"
 #include "Order.h"
+#include "RingBuffer.h"
 #include "Trade.h"
-#include <unordered_map>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <vector>
 
-class Agent;
+static constexpr std::size_t OUTBOUND_BUFFER_SIZE = 8192;
+static constexpr std::size_t DEMUX_BATCH_SIZE = 64;
+// Emptied mailboxes handed back to a running demultiplexer at a time
+static constexpr std::size_t MAILBOX_RETURN_SIZE = 1024;
+
+using Mailbox = RingBuffer<TradeInfo, 1024>;
+
+// The matching thread appends execution reports to a single outbound stream,
+// demultiplexer threads (each owning a contiguous range of ClientRefs) read
+// the stream and deliver reports into the agents' mailboxes. This keeps the
+// scattered agent mailboxes out of the matching thread's cache.
+// Mailboxes are owned here rather than by the agents so agents can be moved
+// into their pools freely. A client's mailbox is only allocated, by the
+// partition delivering to it, once it is first sent a report, so clients
+// that never trade cost a pointer rather than a mailbox. A client hands its
+// mailbox back as soon as it has emptied it, so lockstep runs only ever
+// allocate as many mailboxes as one order's reports touch, and threaded runs
+// about as many as there are clients with reports waiting. With
+// demultiplexer threads running, the client clears its pointer and queues
+// the mailbox to the partition's demultiplexer, which reuses it once it has
+// checked no report it delivered raced the release.
 
 class TradeDispatcher {
 public:
-  TradeDispatcher() {};
+  explicit TradeDispatcher(std::size_t nDemuxThreads = 1);
+  ~TradeDispatcher();
+
+  // Only while the simulation is being set up
+  void Attach(ClientRef clientRef);
+  // Null until the client has been sent a report, safe from any thread
+  Mailbox *GetMailbox(ClientRef clientRef) const {
+    return clientRef < mailboxes_.size()
+               ? mailboxes_[clientRef].load(std::memory_order_acquire)
+               : nullptr;
+  }
+  // Takes back a client's emptied mailbox for reuse, from the thread that
+  // reads the client's mailbox
+  void ReleaseMailbox(ClientRef clientRef);
+  // Mailboxes allocated so far, not while demultiplexer threads are running
+  std::size_t GetNMailboxes() const;
+  void PushTradeBatch(TradeBatch &batch);
 
-  void Attach(Agent *agent);
-  void Detach(Agent *agent);
-  void PushTradeInfo(Trade &&trade);
+  void Start();
+  void Stop();
+  // Clients whose mailbox was pushed to are appended to delivered, if given
+  std::size_t Drain(std::size_t partition,
+                    std::vector<ClientRef> *delivered = nullptr);
+  // Drains every partition on the calling thread until the stream is empty,
+  // for runs with no demultiplexer threads
+  void DrainAll(std::vector<ClientRef> *delivered = nullptr);
 
 private:
-  std::unordered_map<ClientRef, Agent *> clients_;
+  struct MailboxReturn {
+    ClientRef clientRef;
+    Mailbox *mailbox;
+  };
+
+  struct Partition {
+    ClientRef begin_{0};
+    ClientRef end_{0};
+    std::vector<TradeInfo> scratch_;
+    // Only touched by the partition's own demultiplexer
+    std::vector<std::unique_ptr<Mailbox>> owned_;
+    std::vector<Mailbox *> free_;
+    // Pushed by the thread reading the partition's mailboxes
+    std::unique_ptr<RingBuffer<MailboxReturn, MAILBOX_RETURN_SIZE>> returns_;
+  };
+
+  Partition &PartitionOf(ClientRef clientRef);
+  Mailbox *AcquireMailbox(Partition &part, ClientRef clientRef);
+  void TakeReturns(Partition &part);
+  void RunDemux(std::size_t partition);
+
+  // Indexed by ClientRef, a deque as atomics can't be moved when it grows
+  std::deque<std::atomic<Mailbox *>> mailboxes_;
+  std::vector<std::uint8_t> attached_;
+  std::unique_ptr<BroadcastRingBuffer<TradeInfo, OUTBOUND_BUFFER_SIZE>>
+      outbound_;
+  std::vector<Partition> partitions_;
+  std::vector<std::thread> demuxThreads_;
+  std::atomic<bool> running_{false};
+  // Set once demultiplexer threads have been started, after which clients
+  // may be returning mailboxes from their own thread
+  bool queueReturns_{false};
 };
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Time stamp counter reads for latency probes. ReadTsc marks the start of a
+// measured section, ReadTscp the end: rdtscp waits for the measured work to
+// retire so it isn't reordered past the read. Other architectures fall back
+// to the steady clock in nanoseconds.
+
+#if defined(__x86_64__) || defined(__i386__)
+
+inline std::uint64_t ReadTsc() { return __rdtsc(); }
+
+inline std::uint64_t ReadTscp() {
+  unsigned int aux;
+  return __rdtscp(&aux);
+}
+
+#else
+
+inline std::uint64_t ReadTsc() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+inline std::uint64_t ReadTscp() { return ReadTsc(); }
+
+#endif
+
+// Counter ticks per nanosecond, measured against the steady clock the first
+// time it is asked for
+double TscTicksPerNs();
+
+inline double TscToNs(std::uint64_t ticks) {
+  return static_cast<double>(ticks) / TscTicksPerNs();
+}
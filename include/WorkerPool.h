@@ -0,0 +1,99 @@
+#pragma once
+
+#include "PerfCounters.h"
+#include "ThreadPlacement.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads which, together with the calling thread, run
+// every index of a batch of tasks. Workers block on an atomic wait between
+// batches so an idle pool costs nothing.
+
+class WorkerPool {
+public:
+  explicit WorkerPool(std::size_t nThreads);
+  ~WorkerPool();
+
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool &operator=(const WorkerPool &) = delete;
+
+  // Calls task(i) for every i in [0, count), returns once all calls are done
+  template <typename F> void ParallelFor(std::size_t count, F &task);
+  std::size_t size() const { return workers_.size() + 1; }
+
+private:
+  using TaskFn = void (*)(void *, std::size_t);
+
+  void RunWorker(std::size_t index);
+  void RunTasks();
+
+  TaskFn task_{nullptr};
+  void *context_{nullptr};
+  std::size_t count_{0};
+  alignas(64) std::atomic<std::size_t> next_{0};
+  alignas(64) std::atomic<std::size_t> busy_{0};
+  alignas(64) std::atomic<std::uint64_t> generation_{0};
+  std::atomic<bool> running_{true};
+  std::vector<std::thread> workers_;
+};
+
+inline WorkerPool::WorkerPool(std::size_t nThreads) {
+  for (std::size_t i = 1; i < nThreads; ++i) {
+    workers_.emplace_back(&WorkerPool::RunWorker, this, i - 1);
+  }
+}
+
+inline WorkerPool::~WorkerPool() {
+  running_ = false;
+  generation_.fetch_add(1, std::memory_order_release);
+  generation_.notify_all();
+  for (auto &worker : workers_) {
+    if (worker.joinable()) {
+      worker.join();
+    }
+  }
+}
+
+template <typename F> void WorkerPool::ParallelFor(std::size_t count, F &task) {
+  task_ = [](void *context, std::size_t i) { (*static_cast<F *>(context))(i); };
+  context_ = &task;
+  count_ = count;
+  next_.store(0, std::memory_order_relaxed);
+  busy_.store(workers_.size(), std::memory_order_relaxed);
+  generation_.fetch_add(1, std::memory_order_release);
+  generation_.notify_all();
+
+  RunTasks();
+
+  for (std::size_t busy = busy_.load(std::memory_order_acquire); busy != 0;
+       busy = busy_.load(std::memory_order_acquire)) {
+    busy_.wait(busy, std::memory_order_acquire);
+  }
+}
+
+inline void WorkerPool::RunWorker(std::size_t index) {
+  PinThread(PipelineRole::WORKERS, index);
+  ThreadPerfCounters counters("Agent worker");
+  std::uint64_t seen = 0;
+  while (true) {
+    generation_.wait(seen, std::memory_order_acquire);
+    seen = generation_.load(std::memory_order_acquire);
+    if (!running_) {
+      return;
+    }
+    RunTasks();
+    if (busy_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      busy_.notify_one();
+    }
+  }
+}
+
+inline void WorkerPool::RunTasks() {
+  for (std::size_t i = next_.fetch_add(1, std::memory_order_relaxed);
+       i < count_; i = next_.fetch_add(1, std::memory_order_relaxed)) {
+    task_(context_, i);
+  }
+}
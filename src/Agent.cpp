@@ -1,67 +1,82 @@
 #include "Agent.h"
-#include "AgentStrategy.h"
+#include "LatencyProbes.h"
 #include "MatchingEngine.h"
 #include "Order.h"
 #include "OrderPool.h"
 #include "Trade.h"
-#include <atomic>
 #include <cassert>
 #include <cmath>
 #include <cstdint>
 #include <mutex>
 #include <shared_mutex>
 #include <stdexcept>
-#include <unordered_map>
-#include <variant>
+#include <thread>
+#include <utility>
 
-static std::random_device rd;
-static std::mt19937 gen(rd());
-static std::uniform_real_distribution<> dis(0.0, 1.0);
-
-double sampleExponential(double rate) {
-  double U = dis(gen);
-  return -std::log(U) / rate;
-}
+// Stream tags, keeping the agent's waits independent of its strategy's draws
+static constexpr std::uint32_t WAIT_STREAM = 0;
+static constexpr std::uint32_t STRATEGY_STREAM = 1;
 
 Agent::Agent(TradeDispatcher &tradeDispatcher, MatchingEngine &matchingEngine,
-             AgentStrategy &&strategy, ClientRef clientRef, double rate)
-    : strategy_(std::move(strategy)), clientRef_(clientRef), rate_(rate),
-      matchingEngine_(matchingEngine), tradeDispatcher_(tradeDispatcher) {
-  tradeDispatcher_.Attach(this);
+             ClientRef clientRef, double rate, std::uint64_t seed,
+             bool reserveActiveOrders)
+    : matchingEngine_(matchingEngine), ledger_(matchingEngine.GetLedger()),
+      tradeDispatcher_(tradeDispatcher), clientRef_(clientRef), rate_(rate),
+      rng_(seed, clientRef, STRATEGY_STREAM),
+      waitRng_(seed, clientRef, WAIT_STREAM) {
+  tradeDispatcher.Attach(clientRef_);
+  matchingEngine.GetLedger().Open(clientRef_, initialCash_, initialUnits_);
+  if (reserveActiveOrders) {
+    activeOrders_.reserve(AGENT_ACTIVE_ORDERS_RESERVE);
+  }
 };
 
-Agent::~Agent() {
-  ClearIncoming();
-  tradeDispatcher_.Detach(this);
-}
+Agent::Agent(Agent &&other) noexcept
+    : matchingEngine_(other.matchingEngine_), ledger_(other.ledger_),
+      tradeDispatcher_(other.tradeDispatcher_),
+      activeOrders_(std::move(other.activeOrders_)),
+      agentOrders_(other.agentOrders_), clientRef_(other.clientRef_),
+      initialCash_(other.initialCash_), initialUnits_(other.initialUnits_),
+      rate_(other.rate_), rng_(other.rng_), waitRng_(other.waitRng_),
+      waits_(other.waits_), nextWait_(other.nextWait_) {}
 
 void Agent::AddActiveOrder(PoolIndex index, Order *order) {
   std::unique_lock<std::shared_mutex> lock(mtx_);
-  (activeOrders_)[index] = order;
+  for (auto &entry : activeOrders_) {
+    if (entry.first == index) {
+      entry.second = order;
+      return;
+    }
+  }
+  // Agents built without a reserve only allocate once they rest an order
+  if (activeOrders_.capacity() == 0) {
+    activeOrders_.reserve(AGENT_ACTIVE_ORDERS_LAZY_RESERVE);
+  }
+  activeOrders_.emplace_back(index, order);
 }
 
 void Agent::RemoveActiveOrder(PoolIndex index) {
   std::unique_lock<std::shared_mutex> lock(mtx_);
-  activeOrders_.erase(index);
+  std::erase_if(activeOrders_,
+                [&](const auto &entry) { return entry.first == index; });
 }
 
-std::unordered_map<PoolIndex, Order *>
-Agent::GetActiveOrders() const {
+std::size_t Agent::GetNActiveOrders() const {
   std::shared_lock<std::shared_mutex> lock(mtx_);
-  return activeOrders_;
-}
-
-OrderPtrs Agent::Act() {
-  return std::visit(
-      [&](auto& activeStrategy) { return activeStrategy.Act(this); }, strategy_);
+  return activeOrders_.size();
 }
 
 double Agent::ScheduleNextAction(std::uint64_t currentTime) {
-  return currentTime + sampleExponential(rate_);
+  if (nextWait_ == waits_.size()) {
+    waitRng_.FillExponential(rate_, waits_.data(), waits_.size());
+    nextWait_ = 0;
+  }
+  return currentTime + waits_[nextWait_++];
 }
 
 void Agent::PushOrder(Order *order) {
-  if (order->GetOrderType() == OrderType::CANCEL) {
+  if (order->GetOrderType() == OrderType::CANCEL ||
+      order->GetOrderType() == OrderType::MASS_CANCEL) {
     PushCancelOrder(std::move(order));
   } else if (order->GetOrderType() == OrderType::MARKET) {
     PushMarketOrder(std::move(order));
@@ -70,149 +85,78 @@ void Agent::PushOrder(Order *order) {
   }
 }
 
+// Nothing is reserved here, the engine checks the order against the agent's
+// account when it arrives and holds what it commits while it rests
 void Agent::PushLimitOrder(Order *order) {
   AddActiveOrder(order->GetIndex(), order);
-  if (order->GetSide() == Side::Sell) {
-    units_.fetch_sub(order->GetRemainingQuantity(),
-                     std::memory_order_relaxed);
-  } else {
-    int64_t priceCents = static_cast<std::int64_t>(order->GetPrice() * 100);
-    int64_t totalCents =
-        static_cast<std::int64_t>(priceCents * order->GetRemainingQuantity());
-    availableCash_.fetch_sub(totalCents, std::memory_order_relaxed);
-    reservedCash_.fetch_add(totalCents, std::memory_order_relaxed);
-  }
-  matchingEngine_.orders_.Push(std::move(order));
+  SubmitOrder(order);
 }
 
-void Agent::PushMarketOrder(Order *order) {
-  AddActiveOrder(order->GetIndex(), order);
-  if (order->GetSide() == Side::Sell) {
-    units_.fetch_sub(order->GetRemainingQuantity(),
-                     std::memory_order_relaxed);
-  } else {
-    int64_t priceCents = static_cast<std::int64_t>(order->GetPrice() * 100);
-    int64_t totalCents =
-        static_cast<std::int64_t>(priceCents * order->GetRemainingQuantity());
-    availableCash_.fetch_sub(totalCents, std::memory_order_relaxed);
-    reservedCash_.fetch_add(totalCents, std::memory_order_relaxed);
-  }
-  matchingEngine_.orders_.Push(std::move(order));
-}
+// Market orders never rest on the book so they are not tracked as active,
+// the fill or cancel always comes straight back
+void Agent::PushMarketOrder(Order *order) { SubmitOrder(order); }
 
 void Agent::PushCancelOrder(Order* order) {
-  matchingEngine_.orders_.Push(std::move(order));
+  SubmitOrder(order);
 }
 
-void Agent::PushTrade(TradeInfo &&tradeInfo) {
-  incomingBuffer_.Push(std::move(tradeInfo));
+// Waits for room in the engine's buffer rather than dropping the order, a
+// batch of agents can submit faster than the engine drains
+void Agent::SubmitOrder(Order *order) {
+  ScopedProbe probe(ProbeStage::RING_PUSH);
+  while (!matchingEngine_.orders_.Push(order)) {
+    std::this_thread::yield();
+  }
 }
 
-void Agent::PopTrade() {
+void Agent::PopTrade(RoundTripLatency *roundTrips) {
   TradeInfo tradeInfo;
-  if (incomingBuffer_.Pop(tradeInfo)) {
-    if (tradeInfo.type == ExecutionType::FULL || tradeInfo.type == ExecutionType::CANCEL) {
+  const std::uint64_t start = ProbeStart();
+  Mailbox *mailbox = tradeDispatcher_.GetMailbox(clientRef_);
+  if (mailbox && mailbox->Pop(tradeInfo)) {
+    if (roundTrips) {
+      roundTrips->Record(tradeInfo);
+    }
+    if (tradeInfo.type == ExecutionType::FULL ||
+        tradeInfo.type == ExecutionType::CANCEL ||
+        tradeInfo.type == ExecutionType::REJECT) {
       RemoveActiveOrder(tradeInfo.order.GetOrderId());
     }
-    if (tradeInfo.type == ExecutionType::CANCEL) {
-      PopCancelOrderTrade(tradeInfo);
-    } else if (tradeInfo.orderType == OrderType::MARKET) {
-      PopMarketOrderTrade(tradeInfo);
-    } else if (tradeInfo.orderType == OrderType::LIMIT) {
-      PopLimitOrderTrade(tradeInfo);
+    ProbeEnd(ProbeStage::POP_TRADE, start);
+    // Emptied, so the dispatcher can hand it to the next client it delivers
+    // to
+    if (mailbox->empty()) {
+      tradeDispatcher_.ReleaseMailbox(clientRef_);
     }
   }
 }
 
-void Agent::PopLimitOrderTrade(TradeInfo &tradeInfo) {
-  if (tradeInfo.side == Side::Sell) {
-    int64_t priceCents = static_cast<std::int64_t>(tradeInfo.price * 100);
-    int64_t totalCents =
-        static_cast<std::int64_t>(priceCents * tradeInfo.quantity);
-    availableCash_.fetch_add(totalCents, std::memory_order_relaxed);
-  } else {
-    int64_t priceCents = static_cast<std::int64_t>(tradeInfo.price * 100);
-    int64_t totalCents =
-        static_cast<std::int64_t>(priceCents * tradeInfo.quantity);
-    int64_t reservedPrice =
-        static_cast<std::int64_t>(tradeInfo.order.GetPrice() * 100);
-    int64_t reservedCents =
-        static_cast<std::int64_t>(reservedPrice * tradeInfo.quantity);
-    reservedCash_.fetch_sub(reservedCents, std::memory_order_relaxed);
-    availableCash_.fetch_add(reservedCents - totalCents,
-                             std::memory_order_relaxed);
-    units_.fetch_add(tradeInfo.quantity, std::memory_order_relaxed);
-  }
-}
-
-void Agent::PopMarketOrderTrade(TradeInfo &tradeInfo) {
-  if (tradeInfo.side == Side::Sell) {
-    int64_t priceCents = static_cast<std::int64_t>(tradeInfo.price * 100);
-    int64_t totalCents =
-        static_cast<std::int64_t>(priceCents * tradeInfo.quantity);
-    availableCash_.fetch_add(totalCents, std::memory_order_relaxed);
-  } else {
-    int64_t priceCents = static_cast<std::int64_t>(tradeInfo.price * 100);
-    int64_t totalCents =
-        static_cast<std::int64_t>(priceCents * tradeInfo.quantity);
-    int64_t reservedPrice =
-        static_cast<std::int64_t>(tradeInfo.order.GetPrice() * 100);
-    int64_t reservedCents =
-        static_cast<std::int64_t>(reservedPrice * tradeInfo.quantity);
-    reservedCash_.fetch_sub(reservedCents, std::memory_order_relaxed);
-    availableCash_.fetch_add(reservedCents - totalCents,
-                             std::memory_order_relaxed);
-    units_.fetch_add(tradeInfo.quantity, std::memory_order_relaxed);
-  }
-}
-
-void Agent::PopCancelOrderTrade(TradeInfo &tradeInfo) {
-  if (tradeInfo.side == Side::Sell) {
-    units_.fetch_add(tradeInfo.quantity, std::memory_order_relaxed);
-  } else {
-    int64_t reservedPrice =
-        static_cast<std::int64_t>(tradeInfo.price * 100);
-    int64_t reservedCents =
-        static_cast<std::int64_t>(reservedPrice * tradeInfo.quantity);
-    reservedCash_.fetch_sub(reservedCents, std::memory_order_relaxed);
-    availableCash_.fetch_add(reservedCents, std::memory_order_relaxed);
-  }
-}
-
 void Agent::PrintState() {
-  while (!incomingBuffer_.empty()) {
-    PopTrade();
-  }
+  ClearIncoming();
+  const Position position = GetPosition();
   std::cout << "-- Client Ref: " << clientRef_ << " --\n";
   std::cout << "Starting  Cash: $" << initialCash_ << '\n';
-  std::cout << "Current   Cash: $" << availableCash_ + reservedCash_ << '\n';
-  std::cout << "Profit        : $" << (availableCash_ + reservedCash_) - cash_
-            << '\n'
+  std::cout << "Current   Cash: $" << position.cash << '\n';
+  std::cout << "Profit        : $" << position.cash - initialCash_ << '\n'
             << '\n';
   std::cout << "Starting  Units: " << initialUnits_ << '\n';
-  std::cout << "Current   Units: " << units_ << '\n' << '\n' << '\n';
+  std::cout << "Current   Units: " << position.units << '\n' << '\n' << '\n';
 }
 
-void Agent::ClearIncoming() {
-  while (!incomingBuffer_.empty()) {
-    PopTrade();
+// The mailbox is looked up again after every pop as emptying it hands it
+// back to the dispatcher
+void Agent::ClearIncoming(RoundTripLatency *roundTrips) {
+  while (true) {
+    const Mailbox *mailbox = tradeDispatcher_.GetMailbox(clientRef_);
+    if (!mailbox || mailbox->empty()) {
+      return;
+    }
+    PopTrade(roundTrips);
   }
 }
 
 AgentInfo Agent::GetInfo() {
-  AgentInfo::Strategy strategy = std::visit(
-      [](auto &&strategy) -> AgentInfo::Strategy {
-        using T = std::decay_t<decltype(strategy)>;
-        if constexpr (std::is_same_v<T, Random>)
-          return AgentInfo::Strategy::RANDOM;
-        else if constexpr (std::is_same_v<T, MarketMaker>)
-          return AgentInfo::Strategy::MARKETMAKER;
-        else if constexpr (std::is_same_v<T, MomentumTrader>)
-          return AgentInfo::Strategy::MOMENTUMTRADER;
-        else
-          throw std::logic_error("Agent does not have a valid strategy");
-      },
-      strategy_);
-
-  return AgentInfo{clientRef_, strategy, availableCash_, units_};
+  const Position position = GetPosition();
+  return AgentInfo{clientRef_, position.AvailableCash(),
+                   position.AvailableUnits()};
 }
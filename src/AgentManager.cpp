@@ -1,20 +1,48 @@
 #include "AgentManager.h"
 #include "AgentStrategy.h"
+#include "LatencyProbes.h"
 #include "MatchingEngine.h"
+#include "PerfCounters.h"
+#include "ThreadPlacement.h"
+#include "WorkerPool.h"
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <cstddef>
 #include <cstdint>
 #include <iomanip>
-#include <memory>
 #include <numeric>
+#include <span>
+#include <string>
+#include <type_traits>
 
-AgentManager::AgentManager(std::uint64_t maxTime) : maxTime_(maxTime) {};
+AgentManager::AgentManager(std::uint64_t maxTime, Orderbook &orderbook)
+    : maxTime_(maxTime), orderbook_(orderbook) {};
 
 void AgentManager::SetRunning(bool running) { running_ = running; }
 
-void AgentManager::AddAgent(std::unique_ptr<Agent> agent) {
-  agents_.push_back(std::move(agent));
+void AgentManager::Populate(const AgentPopulation &population,
+                            TradeDispatcher &tradeDispatcher,
+                            MatchingEngine &matchingEngine,
+                            OrderPool *orderPool, std::uint64_t seed) {
+  ClientRef clientRef = 0;
+  agentPools_.ForEach([&](auto &pool) { clientRef += pool.size(); });
+  auto add = [&](auto &pool, std::size_t n, double rate, auto makeStrategy) {
+    pool.Reserve(pool.size() + n);
+    for (std::size_t i = 0; i < n; ++i) {
+      pool.Add(Agent(tradeDispatcher, matchingEngine, clientRef++, rate, seed,
+                     population.reserveActiveOrders),
+               makeStrategy());
+    }
+  };
+  add(agentPools_.Get<Random>(), population.nRandom, population.randomRate,
+      [&] { return Random(orderPool, population.sigma); });
+  add(agentPools_.Get<MarketMaker>(), population.nMarketMaker,
+      population.marketMakerRate,
+      [&] { return MarketMaker(orderPool, population.spread); });
+  add(agentPools_.Get<MomentumTrader>(), population.nMomentumTrader,
+      population.momentumTraderRate,
+      [&] { return MomentumTrader(orderPool, population.threshold); });
 }
 
 void AgentManager::PushAgentEvent(AgentEvent &&event) {
@@ -22,50 +50,233 @@ void AgentManager::PushAgentEvent(AgentEvent &&event) {
 }
 
 void AgentManager::WarmUp() {
-  for (size_t i = 0; i < agents_.size(); ++i) {
-    double time = agents_[i]->ScheduleNextAction(currentTime_);
-    size_t pos = i;
-    PushAgentEvent(AgentEvent(time, pos));
+  std::size_t nAgents = 0;
+  agentPools_.ForEach([&](auto &pool) { nAgents += pool.size(); });
+  agentEventQueue_.Reserve(std::min(nAgents, AGENT_EVENT_BUCKET_RESERVE));
+
+  agentPools_.ForEach([&](auto &pool) {
+    using Strategy = typename std::decay_t<decltype(pool)>::StrategyType;
+    constexpr auto kind = AgentPools::KindOf<Strategy>();
+    for (size_t i = 0; i < pool.size(); ++i) {
+      double time = pool.GetAgent(i).ScheduleNextAction(currentTime_);
+      PushAgentEvent(AgentEvent(time, i, kind));
+    }
+  });
+}
+
+template <typename Pool, typename AfterPush>
+void AgentManager::StepAgent(Pool &pool, const AgentEvent &event,
+                             AfterPush &&afterPush) {
+  Agent &agent = pool.GetAgent(event.pos);
+  orderBuffer_.clear();
+  {
+    ScopedProbe probe(ProbeStage::AGENT_ACT);
+    pool.Act(event.pos, orderbook_.GetBookView(), orderBuffer_);
   }
+  ++agentActions_;
+  for (Order *order : orderBuffer_) {
+    agent.PushOrder(order);
+    afterPush();
+  }
+  currentTime_ = event.time;
+  double nextTime = agent.ScheduleNextAction(currentTime_);
+  PushAgentEvent(AgentEvent(nextTime, event.pos, event.kind));
 }
 
 void AgentManager::RunOutgoingLoop() {
+  PinThread(PipelineRole::OUTGOING);
+  ThreadPerfCounters counters("Agent outgoing");
   AgentEvent event;
-  double nextTime;
   while (currentTime_ < maxTime_) {
     agentEventQueue_.Pop(event);
-    OrderPtrs orders{agents_[event.pos]->Act()};
-    ++agentActions_;
-    for (auto &order : orders) {
-      agents_[event.pos]->PushOrder(std::move(order));
+    agentPools_.Visit(event.kind,
+                      [&](auto &pool) { StepAgent(pool, event, [] {}); });
+  }
+}
+
+// Lockstep stepping: one thread acts for each agent in scheduled time order,
+// matches every order it submits and delivers the resulting reports before
+// anything else happens. Nothing runs concurrently so a seed always produces
+// the same run, and the run's cost is pure compute with no cross-core
+// traffic or waiting. The trade dispatcher and engine must not be started.
+void AgentManager::RunLockstepLoop(MatchingEngine &matchingEngine,
+                                   TradeDispatcher &tradeDispatcher) {
+  PinThread(PipelineRole::ENGINE);
+  ThreadPerfCounters counters("Lockstep");
+  std::vector<AgentSlot> slots;
+  agentPools_.ForEach([&](auto &pool) {
+    using Strategy = typename std::decay_t<decltype(pool)>::StrategyType;
+    constexpr auto kind = AgentPools::KindOf<Strategy>();
+    for (std::size_t i = 0; i < pool.size(); ++i) {
+      const ClientRef clientRef = pool.GetAgent(i).GetClientRef();
+      if (clientRef >= slots.size()) {
+        slots.resize(clientRef + 1);
+      }
+      slots[clientRef] = AgentSlot{kind, i};
+    }
+  });
+
+  std::vector<ClientRef> delivered;
+  // Each order is matched and its reports handed back as soon as it is
+  // submitted, so no buffer between the stages can ever fill up
+  auto matchAndDeliver = [&]() {
+    matchingEngine.Drain();
+    delivered.clear();
+    tradeDispatcher.DrainAll(&delivered);
+    for (const ClientRef clientRef : delivered) {
+      const AgentSlot slot = slots[clientRef];
+      // Emptying the mailbox hands it back for the next client delivered to
+      agentPools_.Visit(slot.kind, [&](auto &pool) {
+        pool.GetAgent(slot.pos).ClearIncoming(&pool.GetRoundTrips());
+      });
     }
-    currentTime_ = event.time;
-    nextTime = agents_[event.pos]->ScheduleNextAction(currentTime_);
-    PushAgentEvent(AgentEvent(nextTime, event.pos));
+  };
+
+  AgentEvent event;
+  while (currentTime_ < maxTime_ && agentEventQueue_.Pop(event)) {
+    agentPools_.Visit(event.kind, [&](auto &pool) {
+      StepAgent(pool, event, matchAndDeliver);
+    });
+  }
+}
+
+// Batch-synchronous stepping: every agent due within a time slice acts in
+// parallel against the same view of the book, their orders are then submitted
+// in a deterministic order (scheduled time, then client ref). Agents lose the
+// chance to react to each other within a slice in exchange for the agent side
+// scaling with the number of threads.
+void AgentManager::RunBatchedOutgoingLoop(double timeSlice,
+                                          std::size_t nThreads) {
+  PinThread(PipelineRole::OUTGOING);
+  ThreadPerfCounters counters("Agent outgoing");
+  struct ActChunk {
+    AgentPools::Kind kind;
+    std::size_t begin;
+    std::size_t end;
+  };
+
+  WorkerPool workerPool(nThreads);
+  std::vector<AgentEvent> batch;
+  // The batch regrouped by strategy, so same strategy agents act together
+  std::vector<std::size_t> actPositions;
+  std::vector<OrderBuffer> actOrders;
+  std::vector<std::size_t> actSlot; // Batch index -> index in the regrouping
+  std::vector<ActChunk> chunks;
+  BookView view;
+  auto act = [&](std::size_t c) {
+    const ActChunk &chunk = chunks[c];
+    const std::uint64_t start = ProbeStart();
+    agentPools_.Visit(chunk.kind, [&](auto &pool) {
+      pool.ActBatch(std::span<const std::size_t>(
+                        actPositions.data() + chunk.begin,
+                        chunk.end - chunk.begin),
+                    view, actOrders.data() + chunk.begin);
+    });
+    if constexpr (LATENCY_PROBES_ENABLED) {
+      // A chunk acts as one call, each agent is charged an equal share
+      const std::size_t n = chunk.end - chunk.begin;
+      const std::uint64_t share = (ReadTscp() - start) / n;
+      for (std::size_t i = 0; i < n; ++i) {
+        RecordLatency(ProbeStage::AGENT_ACT, share);
+      }
+    }
+  };
+
+  AgentEvent event;
+  bool pending = false; // Holds the first event of the next slice
+  while (currentTime_ < maxTime_) {
+    if (!pending && !agentEventQueue_.Pop(event)) {
+      break;
+    }
+    pending = false;
+    const double sliceEnd = event.time + timeSlice;
+    batch.clear();
+    batch.push_back(event);
+    while (agentEventQueue_.Pop(event)) {
+      if (event.time >= sliceEnd) {
+        pending = true;
+        break;
+      }
+      batch.push_back(event);
+    }
+    std::sort(batch.begin(), batch.end(),
+              [&](const AgentEvent &a, const AgentEvent &b) {
+                if (a.time != b.time) {
+                  return a.time < b.time;
+                }
+                return agentPools_.GetAgent(a.kind, a.pos).GetClientRef() <
+                       agentPools_.GetAgent(b.kind, b.pos).GetClientRef();
+              });
+
+    actPositions.clear();
+    actSlot.resize(batch.size());
+    chunks.clear();
+    for (AgentPools::Kind kind = 0; kind < AgentPools::NKinds; ++kind) {
+      for (std::size_t i = 0; i < batch.size(); ++i) {
+        if (batch[i].kind != kind) {
+          continue;
+        }
+        if (chunks.empty() || chunks.back().kind != kind ||
+            chunks.back().end - chunks.back().begin == AGENT_ACT_BATCH_SIZE) {
+          chunks.push_back(
+              ActChunk{kind, actPositions.size(), actPositions.size()});
+        }
+        actSlot[i] = actPositions.size();
+        actPositions.push_back(batch[i].pos);
+        ++chunks.back().end;
+      }
+    }
+
+    actOrders.resize(batch.size());
+    view = orderbook_.GetBookView();
+    workerPool.ParallelFor(chunks.size(), act);
+
+    for (std::size_t i = 0; i < batch.size(); ++i) {
+      Agent &agent = agentPools_.GetAgent(batch[i].kind, batch[i].pos);
+      for (Order *order : actOrders[actSlot[i]]) {
+        agent.PushOrder(order);
+      }
+      ++agentActions_;
+      currentTime_ = batch[i].time;
+      double nextTime = agent.ScheduleNextAction(currentTime_);
+      PushAgentEvent(AgentEvent(nextTime, batch[i].pos, batch[i].kind));
+    }
+  }
+  if (pending) {
+    PushAgentEvent(std::move(event));
   }
 }
 
 void AgentManager::RunIncomingLoop() {
-  while (running_) {
-    for (auto &agent : agents_) {
-      agent->PopTrade();
+  PinThread(PipelineRole::INCOMING);
+  ThreadPerfCounters counters("Agent incoming");
+  auto popTrades = [](auto &pool) {
+    for (auto &agent : pool.GetAgents()) {
+      agent.PopTrade(&pool.GetRoundTrips());
     }
+  };
+  while (running_) {
+    agentPools_.ForEach(popTrades);
   }
   // Empty out each agent incoming buffer once we are done
-  for (auto &agent : agents_) {
-    agent->ClearIncoming();
-  }
+  agentPools_.ForEach([](auto &pool) {
+    for (auto &agent : pool.GetAgents()) {
+      agent.ClearIncoming(&pool.GetRoundTrips());
+    }
+  });
 }
 
 std::uint64_t AgentManager::GetNAgentActions() const { return agentActions_; }
 
 void AgentManager::PrintStates() {
-  for (auto &agent : agents_) {
-    agent->PrintState();
-  }
+  agentPools_.ForEach([](auto &pool) {
+    for (auto &agent : pool.GetAgents()) {
+      agent.PrintState();
+    }
+  });
 }
 
-void AgentManager::PrintSummary() {
+std::vector<StrategySummary> AgentManager::GetSummary() {
   auto calculateMean = [](const std::vector<double> &values) {
     if (values.empty())
       return 0.0;
@@ -84,72 +295,71 @@ void AgentManager::PrintSummary() {
     return std::sqrt(sq_sum / static_cast<double>(values.size()));
   };
 
-  struct AgentData {
+  std::vector<StrategySummary> summaries;
+  agentPools_.ForEach([&](auto &pool) {
+    using Strategy = typename std::decay_t<decltype(pool)>::StrategyType;
     std::vector<double> cash;
     std::vector<double> units;
     std::vector<double> profit;
-  };
-
-  AgentData randomAgents, marketMakerAgents, momentumTraderAgents;
-  constexpr std::int64_t initial_cash_per_agent = 1'000'000'000;
-
-  for (const auto &agent : agents_) {
-    AgentInfo info = agent->GetInfo();
-    double totalCash =
-        (agent->GetAvailableCash() + agent->GetReservedCash()) / 100.0;
-    double units = agent->GetUnits();
-    double profit = (totalCash) - (initial_cash_per_agent / 100.0);
-
-    switch (info.strategy_) {
-    case AgentInfo::Strategy::RANDOM:
-      randomAgents.cash.push_back(totalCash);
-      randomAgents.units.push_back(units);
-      randomAgents.profit.push_back(profit);
-      break;
-    case AgentInfo::Strategy::MARKETMAKER:
-      marketMakerAgents.cash.push_back(totalCash);
-      marketMakerAgents.units.push_back(units);
-      marketMakerAgents.profit.push_back(profit);
-      break;
-    case AgentInfo::Strategy::MOMENTUMTRADER:
-      momentumTraderAgents.cash.push_back(totalCash);
-      momentumTraderAgents.units.push_back(units);
-      momentumTraderAgents.profit.push_back(profit);
-      break;
+    // Exact, the ledger settles every fill in pence on the matching thread
+    for (const auto &agent : pool.GetAgents()) {
+      const Position position = agent.GetPosition();
+      cash.push_back(position.cash / 100.0);
+      units.push_back(static_cast<double>(position.units));
+      profit.push_back((position.cash - INITIAL_CASH) / 100.0);
     }
-  }
+    summaries.push_back(StrategySummary{
+        Strategy::Name, pool.size(), calculateMean(profit),
+        calculateStdDev(profit), calculateMean(cash), calculateStdDev(cash),
+        calculateMean(units), calculateStdDev(units)});
+  });
+  return summaries;
+}
 
-  auto printAgentStats = [&](const std::string &agentName,
-                             const AgentData &data) {
-    const int LABEL_WIDTH = 40;
-    const int VALUE_WIDTH = 15;
-
-    double meanProfit = calculateMean(data.profit);
-    double profitStdDev = calculateStdDev(data.profit);
-    double meanCash = calculateMean(data.cash);
-    double cashStdDev = calculateStdDev(data.cash);
-    double meanUnits = calculateMean(data.units);
-    double unitsStdDev = calculateStdDev(data.units);
-
-    auto printLine = [&](const std::string &label, double value) {
-      std::ostringstream line;
-      line << std::fixed << std::setprecision(3) << std::left
-           << std::setw(LABEL_WIDTH) << (label + ":") << std::right
-           << std::setw(VALUE_WIDTH) << value;
-      std::cout << line.str() << '\n';
-    };
-
-    printLine(agentName + " mean profit", meanProfit);
-    printLine(agentName + " profit σ", profitStdDev);
-    printLine(agentName + " mean cash", meanCash);
-    printLine(agentName + " cash σ", cashStdDev);
-    printLine(agentName + " mean units", meanUnits);
-    printLine(agentName + " units σ", unitsStdDev);
+void AgentManager::PrintSummary() {
+  const int LABEL_WIDTH = 40;
+  const int VALUE_WIDTH = 15;
 
-    std::cout << "\n";
+  auto printLine = [&](const std::string &label, double value) {
+    std::ostringstream line;
+    line << std::fixed << std::setprecision(3) << std::left
+         << std::setw(LABEL_WIDTH) << (label + ":") << std::right
+         << std::setw(VALUE_WIDTH) << value;
+    std::cout << line.str() << '\n';
   };
 
-  printAgentStats("Random Agents", randomAgents);
-  printAgentStats("Market Maker Agents", marketMakerAgents);
-  printAgentStats("Momentum Trader Agents", momentumTraderAgents);
+  for (const StrategySummary &summary : GetSummary()) {
+    const std::string agentName(summary.name);
+    printLine(agentName + " mean profit", summary.meanProfit);
+    printLine(agentName + " profit σ", summary.profitStdDev);
+    printLine(agentName + " mean cash", summary.meanCash);
+    printLine(agentName + " cash σ", summary.cashStdDev);
+    printLine(agentName + " mean units", summary.meanUnits);
+    printLine(agentName + " units σ", summary.unitsStdDev);
+
+    std::cout << "\n";
+  }
+}
+
+void AgentManager::PrintRoundTripReport() {
+  if constexpr (!LATENCY_PROBES_ENABLED) {
+    return;
+  }
+  constexpr std::pair<OrderType, std::string_view> types[] = {
+      {OrderType::LIMIT, "limit"},
+      {OrderType::MARKET, "market"},
+      {OrderType::CANCEL, "cancel"},
+      {OrderType::MASS_CANCEL, "mass cancel"},
+  };
+  PrintLatencyHeader("Order To Ack Latency (ns)");
+  agentPools_.ForEach([&](auto &pool) {
+    using Strategy = typename std::decay_t<decltype(pool)>::StrategyType;
+    for (const auto &[type, typeName] : types) {
+      std::string label(Strategy::Name);
+      label.append(" ").append(typeName);
+      PrintLatencyRow(label, pool.GetRoundTrips().Get(type));
+    }
+    PrintLatencyRow(std::string(Strategy::Name).append(" limit rested"),
+                    pool.GetRoundTrips().GetAcks());
+  });
 }
@@ -1,249 +1,255 @@
 #include "AgentStrategy.h"
 #include "Agent.h"
+#include "CounterRng.h"
+#include "LatencyProbes.h"
 #include "Order.h"
 #include "OrderPool.h"
 #include <cassert>
+#include <algorithm>
+#include <array>
 #include <cmath>
+#include <cstddef>
+#include <cstdint>
 #include <optional>
-#include <random>
-#include <vector>
-
-MarketMaker::MarketMaker(Orderbook *orderbook, OrderPool *orderPool,
-                         double spread)
-    : orderbook_(orderbook), orderPool_(orderPool), spread_(spread) {};
-
-OrderPtrs MarketMaker::Act(Agent *agent) {
-  OrderPtrs orders{};
-  OrderPtrs cancelOrders{CancelOrders(agent)};
-  OrderPtrs activeOrders{CreateOrders(agent)};
-  orders.insert(orders.end(), activeOrders.begin(), activeOrders.end());
-  orders.insert(orders.end(), cancelOrders.begin(), cancelOrders.end());
-  return orders;
+#include <numbers>
+#include <span>
+
+static_assert(MARKET_MAKER_MAX_QUOTES <= AGENT_ACTIVE_ORDERS_RESERVE,
+              "Quoting should never grow a market maker's active orders");
+
+MarketMaker::MarketMaker(OrderPool *orderPool, double spread)
+    : orderPool_(orderPool), spread_(spread) {};
+
+void MarketMaker::Act(Agent *agent, const BookView &view,
+                      OrderBuffer &orders) {
+  CancelOrders(agent, orders);
+  CreateOrders(agent, view, orders);
 }
 
-OrderPtrs MarketMaker::CreateOrders(Agent *agent) {
+void MarketMaker::CreateOrders(Agent *agent, const BookView &view,
+                               OrderBuffer &orders) {
   if (!agent) {
-    return OrderPtrs{};
+    return;
   }
-  auto bestBidIndex = orderbook_->GetBestBid();
-  auto bestAskIndex = orderbook_->GetBestAsk();
-  if (!bestBidIndex || !bestAskIndex) {
-    return OrderPtrs{};
+  const auto midPrice = view.indicators.MidPrice();
+  if (!midPrice) {
+    return;
   }
   lastMidPrice_ = midPrice_;
-  midPrice_ = (orderbook_->IndexToPrice(*bestAskIndex) +
-               orderbook_->IndexToPrice(*bestBidIndex)) /
-              2.0;
+  midPrice_ = *midPrice;
 
   Price askPrice = midPrice_ + (spread_ / 2.0);
   askPrice = std::round(askPrice * 100.0) / 100.0;
   Price bidPrice = midPrice_ - (spread_ / 2.0);
   bidPrice = std::round(bidPrice * 100.0) / 100.0;
 
-  if ((agent->GetUnits() > 10) &&
-      (agent->GetAvailableCash() / 100.0 > bidPrice * 10)) {
+  const Position position = agent->GetPosition();
+  if ((position.AvailableUnits() > 10) &&
+      (position.AvailableCash() / 100.0 > bidPrice * 10) &&
+      orders.available() >= 2 &&
+      agent->GetNActiveOrders() + 2 <= MARKET_MAKER_MAX_QUOTES) {
 
     PoolIndex sellSideSlot = orderPool_->allocate();
     Order *sellOrder = orderPool_->get_order(sellSideSlot);
     sellOrder->SetOrderId(0);
     sellOrder->SetOrderType(OrderType::LIMIT);
-    sellOrder->GetClientRef(agent->GetClientRef());
     sellOrder->SetSide(Side::Sell);
     sellOrder->SetPrice(askPrice);
-    sellOrder->SetInitialQuantity(10);
     sellOrder->SetRemainingQuantity(10);
     sellOrder->SetIndex(sellSideSlot);
+    *orderPool_->get_info(sellSideSlot) =
+        OrderInfo{agent->GetClientRef(), 10, OrderTimestamp()};
 
     PoolIndex buySideSlot = orderPool_->allocate();
     Order *buyOrder = orderPool_->get_order(buySideSlot);
     buyOrder->SetOrderId(0);
     buyOrder->SetOrderType(OrderType::LIMIT);
-    buyOrder->GetClientRef(agent->GetClientRef());
     buyOrder->SetSide(Side::Buy);
     buyOrder->SetPrice(bidPrice);
-    buyOrder->SetInitialQuantity(10);
     buyOrder->SetRemainingQuantity(10);
     buyOrder->SetIndex(buySideSlot);
+    *orderPool_->get_info(buySideSlot) =
+        OrderInfo{agent->GetClientRef(), 10, OrderTimestamp()};
 
-    return OrderPtrs{buyOrder, sellOrder};
+    orders.Push(buyOrder);
+    orders.Push(sellOrder);
   }
-  return OrderPtrs{};
 }
 
-OrderPtrs MarketMaker::CancelOrders(Agent *agent) {
+// Stale quotes are cancelled with one mass cancel per side and direction from
+// the mid, taking everything from the stale quote nearest the mid outwards,
+// rather than with a cancel per quote
+void MarketMaker::CancelOrders(Agent *agent, OrderBuffer &orders) {
   if (!agent) {
-    return OrderPtrs{};
+    return;
   }
   if (std::abs(midPrice_ - lastMidPrice_) <= spread_) {
-    return OrderPtrs{};
+    return;
   }
-  OrderPtrs orders{};
-  std::vector<PoolIndex> ordersToCancel{};
-  const auto activeOrders = agent->GetActiveOrders();
-  for (const auto &[_, order] : activeOrders) {
-    if (std::abs(order->GetPrice() - midPrice_) <= spread_ * 2) {
+  auto isStale = [&](const Order *order) {
+    return std::abs(order->GetPrice() - midPrice_) > spread_ * 2;
+  };
+  auto group = [&](const Order *order) {
+    return static_cast<std::size_t>(order->GetSide()) * 2 +
+           (order->GetPrice() > midPrice_ ? 1 : 0);
+  };
+  // Buy below, buy above, sell below, sell above
+  std::array<std::optional<PriceTicks>, 4> nearest;
+  agent->EraseActiveOrdersIf([&](Order *order) {
+    if (isStale(order)) {
+      std::optional<PriceTicks> &ticks = nearest[group(order)];
+      const bool above = group(order) % 2 == 1;
+      if (!ticks || (above ? order->GetPriceTicks() < *ticks
+                           : order->GetPriceTicks() > *ticks)) {
+        ticks = order->GetPriceTicks();
+      }
+    }
+    return false;
+  });
+  for (std::size_t i = 0; i < nearest.size(); ++i) {
+    if (!nearest[i]) {
+      continue;
+    }
+    if (orders.full()) {
+      nearest[i].reset();
       continue;
     }
     PoolIndex slot = orderPool_->allocate();
     Order *cancelOrder = orderPool_->get_order(slot);
-    cancelOrder->SetOrderId(order->GetOrderId());
-    cancelOrder->SetOrderType(OrderType::CANCEL);
-    cancelOrder->GetClientRef(agent->GetClientRef());
-    cancelOrder->SetSide(order->GetSide());
-    cancelOrder->SetPrice(order->GetPrice());
-    cancelOrder->SetInitialQuantity(0);
+    cancelOrder->SetOrderId(0);
+    cancelOrder->SetOrderType(OrderType::MASS_CANCEL);
+    cancelOrder->SetSide(i < 2 ? Side::Buy : Side::Sell);
+    cancelOrder->SetPrice(TicksToPrice(*nearest[i]));
+    cancelOrder->SetPriceFilter(i % 2 == 1 ? PriceFilter::AT_OR_ABOVE
+                                           : PriceFilter::AT_OR_BELOW);
     cancelOrder->SetRemainingQuantity(0);
     cancelOrder->SetIndex(slot);
-
-    ordersToCancel.push_back(order->GetIndex());
-    orders.push_back(cancelOrder);
+    *orderPool_->get_info(slot) =
+        OrderInfo{agent->GetClientRef(), 0, OrderTimestamp()};
+    orders.Push(cancelOrder);
   }
-
-  for (const auto &slotIndex : ordersToCancel) {
-    agent->RemoveActiveOrder(slotIndex);
-  }
-
-  return orders;
+  agent->EraseActiveOrdersIf([&](Order *order) {
+    return isStale(order) && nearest[group(order)].has_value();
+  });
 }
 
-MomentumTrader::MomentumTrader(Orderbook *orderbook, OrderPool *orderPool,
-                               double threshold)
-    : orderbook_(orderbook), orderPool_(orderPool), threshold_(threshold) {};
+MomentumTrader::MomentumTrader(OrderPool *orderPool, double threshold)
+    : orderPool_(orderPool), threshold_(threshold) {};
 
-OrderPtrs MomentumTrader::Act(Agent *agent) {
-  OrderPtrs orders{};
-  OrderPtrs activeOrders{CreateOrders(agent)};
-  orders.insert(orders.end(), activeOrders.begin(), activeOrders.end());
-  return orders;
+void MomentumTrader::Act(Agent *agent, const BookView &view,
+                         OrderBuffer &orders) {
+  CreateOrders(agent, view, orders);
 }
 
-OrderPtrs MomentumTrader::CreateOrders(Agent *agent) {
+void MomentumTrader::CreateOrders(Agent *agent, const BookView &view,
+                                  OrderBuffer &orders) {
   if (!agent) {
-    return OrderPtrs{};
-  }
-  auto bestBidIndex = orderbook_->GetBestBid();
-  auto bestAskIndex = orderbook_->GetBestAsk();
-  if (!bestBidIndex || !bestAskIndex) {
-    return OrderPtrs{};
+    return;
   }
-  const double midPrice = (orderbook_->IndexToPrice(*bestAskIndex) +
-                     orderbook_->IndexToPrice(*bestBidIndex)) /
-                    2;
-
-  shortTermObservations_.Push(midPrice);
-  longTermObservations_.Push(midPrice);
-
-  if (!shortTermObservations_.full()) {
-    return OrderPtrs{};
+  // The averages are kept once for every trader by the engine
+  const MarketIndicators &indicators = view.indicators;
+  if (!indicators.AveragesReady()) {
+    return;
   }
+  const double trend = indicators.shortAverage - indicators.longAverage;
 
-  if (!longTermObservations_.full()) {
-    return OrderPtrs{};
+  if (orders.full()) {
+    return;
   }
-  double shortTermLeavingObs{0};
-  shortTermObservations_.Pop(shortTermLeavingObs);
-  shortTermSum_ += (midPrice - shortTermLeavingObs);
-  double shortTermMovingAverage_ =
-      shortTermSum_ / shortTermObservations_.size();
-
-  double longTermLeavingObs{0};
-  longTermObservations_.Pop(longTermLeavingObs);
-  longTermSum_ += (midPrice - longTermLeavingObs);
-  double longTermMovingAverage_ = longTermSum_ / longTermObservations_.size();
-
-  OrderPtrs orders{};
   // Check the we have the maximum amount that could be required
   if (((agent->GetAvailableCash() / 100.0) > (10 * 120)) &&
-      threshold_ <
-          shortTermMovingAverage_ -
-              longTermMovingAverage_) {
+      threshold_ < trend) {
 
     PoolIndex slot = orderPool_->allocate();
     Order *order = orderPool_->get_order(slot);
     order->SetOrderId(0);
     order->SetOrderType(OrderType::MARKET);
-    order->GetClientRef(agent->GetClientRef());
     order->SetSide(Side::Buy);
     order->SetPrice(120);
-    order->SetInitialQuantity(10);
     order->SetRemainingQuantity(10);
     order->SetIndex(slot);
+    *orderPool_->get_info(slot) =
+        OrderInfo{agent->GetClientRef(), 10, OrderTimestamp()};
 
-    return OrderPtrs{order};
+    orders.Push(order);
 
-  } else if ((agent->GetUnits() > 10) &&
-             -threshold_ > shortTermMovingAverage_ - longTermMovingAverage_) {
+  } else if ((agent->GetUnits() > 10) && -threshold_ > trend) {
     PoolIndex slot = orderPool_->allocate();
     Order *order = orderPool_->get_order(slot);
     order->SetOrderId(0);
     order->SetOrderType(OrderType::MARKET);
-    order->GetClientRef(agent->GetClientRef());
     order->SetSide(Side::Sell);
     order->SetPrice(100);
-    order->SetInitialQuantity(10);
     order->SetRemainingQuantity(10);
     order->SetIndex(slot);
+    *orderPool_->get_info(slot) =
+        OrderInfo{agent->GetClientRef(), 10, OrderTimestamp()};
 
-    return OrderPtrs{order};
+    orders.Push(order);
   }
-  return OrderPtrs{};
 }
 
-OrderPtrs MomentumTrader::CancelOrders(Agent *agent) {
+void MomentumTrader::CancelOrders(Agent *agent, OrderBuffer &) {
   // TO-DO
   // Currently MomentumTrader only places Market orders which will be cancelled if they can't find a match
   // Thus, there are no 'active orders' waiting to be filled/cancelled from the MomentumTrader
-  return OrderPtrs{};
 }
 
-Random::Random(Orderbook *orderbook, OrderPool *orderPool, double sigma)
-    : orderbook_(orderbook), orderPool_(orderPool), sigma_(sigma),
-      normal_distribution_(0, sigma), bernoulli_distribution_(0.5) {};
-
-static std::random_device rd;
-static std::mt19937 gen(rd());
-static std::bernoulli_distribution cancelDist =
-    std::bernoulli_distribution(0.05);
-
-OrderPtrs Random::Act(Agent *agent) {
-  OrderPtrs orders{};
-  OrderPtrs cancelOrders{CancelOrders(agent)};
-  OrderPtrs activeOrders{CreateOrders(agent)};
-  orders.insert(orders.end(), activeOrders.begin(), activeOrders.end());
-  orders.insert(orders.end(), cancelOrders.begin(), cancelOrders.end());
-  return orders;
+Random::Random(OrderPool *orderPool, double sigma)
+    : orderPool_(orderPool), sigma_(sigma) {};
+
+// Nearest cent with ties to even. Adding and taking away 1.5 * 2^52 rounds
+// to a whole number of cents with plain adds, which vectorise where
+// std::round does not.
+static double RoundToCents(double price) {
+  constexpr double ROUNDER = 0x1.8p52;
+  return ((price * 100.0 + ROUNDER) - ROUNDER) / 100.0;
 }
 
-OrderPtrs Random::CreateOrders(Agent *agent) {
+// One Philox block per order decision: the low half picks the side and both
+// halves feed Box-Muller. Act and ActBatch draw identically, so an agent
+// makes the same decisions in either stepping mode.
+static void DrawRandomOrder(CounterRng &rng, double &u1, double &u2,
+                            bool &buy) {
+  std::uint64_t lo, hi;
+  rng.NextBlock(lo, hi);
+  u1 = ToUnitDouble(lo);
+  u2 = ToUnitDouble(hi);
+  buy = lo & 1;
+}
+
+void Random::Act(Agent *agent, const BookView &view, OrderBuffer &orders) {
+  CancelOrders(agent, orders);
+  CreateOrders(agent, view, orders);
+}
+
+void Random::CreateOrders(Agent *agent, const BookView &view,
+                          OrderBuffer &orders) {
   if (!agent) {
-    return OrderPtrs{};
-  }
-  auto bestBidIndex = orderbook_->GetBestBid();
-  auto bestAskIndex = orderbook_->GetBestAsk();
-  double midPrice;
-  if (!bestBidIndex || !bestAskIndex) {
-    midPrice = 110;
-  } else {
-    midPrice = (orderbook_->IndexToPrice(*bestAskIndex) +
-                orderbook_->IndexToPrice(*bestBidIndex)) /
-               2.0;
+    return;
   }
+  const double midPrice = view.indicators.MidPrice().value_or(110);
 
-  bool side_result = bernoulli_distribution_(gen);
-  Price price = midPrice + normal_distribution_(gen);
-  price = std::round(price * 100.0) / 100.0;
+  double u1, u2;
+  bool side_result;
+  DrawRandomOrder(agent->GetRng(), u1, u2, side_result);
+  const Price price = RoundToCents(midPrice + sigma_ * BoxMuller(u1, u2));
   Quantity quantity = 10;
 
+  if (orders.full()) {
+    return;
+  }
+
   Side side;
   if (side_result) {
     side = Side::Buy;
     if (agent->GetAvailableCash() / 100.0 < price) {
-      return OrderPtrs{};
+      return;
     }
   } else {
     side = Side::Sell;
     if (agent->GetUnits() < 1) {
-      return OrderPtrs{};
+      return;
     }
   }
 
@@ -251,43 +257,137 @@ OrderPtrs Random::CreateOrders(Agent *agent) {
   Order *order = orderPool_->get_order(slot);
   order->SetOrderId(0);
   order->SetOrderType(OrderType::LIMIT);
-  order->GetClientRef(agent->GetClientRef());
   order->SetSide(side);
   order->SetPrice(price);
-  order->SetInitialQuantity(10);
   order->SetRemainingQuantity(10);
   order->SetIndex(slot);
-  return OrderPtrs{order};
+  *orderPool_->get_info(slot) =
+      OrderInfo{agent->GetClientRef(), 10, OrderTimestamp()};
+  orders.Push(order);
 }
 
-OrderPtrs Random::CancelOrders(Agent *agent) {
-  if (!agent) {
-    return OrderPtrs{};
+static constexpr std::size_t RANDOM_BATCH_LANES = 16;
+
+// Box-Muller price offset, rounding and affordability for a full set of
+// lanes. Straight line arithmetic over flat arrays of doubles, with the log
+// and cos in CounterRng.h written to vectorise, so the whole loop turns into
+// vector code even on baseline SSE2 (which has no 64 bit integer compares,
+// hence the side and result as 0.0 or 1.0). Kept out of line, once inlined
+// into the gather loop GCC no longer vectorizes it.
+[[gnu::noinline]] static void
+RandomOrderKernel(const double *__restrict u1, const double *__restrict u2,
+                  const double *__restrict sigma,
+                  const double *__restrict cash,
+                  const double *__restrict units,
+                  const double *__restrict buy, double midPrice,
+                  double *__restrict price, double *__restrict accept) {
+  for (std::size_t lane = 0; lane < RANDOM_BATCH_LANES; ++lane) {
+    price[lane] =
+        RoundToCents(midPrice + sigma[lane] * BoxMuller(u1[lane], u2[lane]));
+    const double buyHeadroom = cash[lane] - price[lane];
+    const double sellHeadroom = units[lane] - 1.0;
+    const double headroom = buy[lane] != 0.0 ? buyHeadroom : sellHeadroom;
+    accept[lane] = headroom >= 0.0 ? 1.0 : 0.0;
+  }
+}
+
+void Random::ActBatch(std::span<Random> strategies, std::span<Agent> agents,
+                      std::span<const std::size_t> positions,
+                      const BookView &view, OrderBuffer *orders) {
+  const double midPrice = view.indicators.MidPrice().value_or(110);
+  OrderPool *orderPool = strategies[positions[0]].orderPool_;
+
+  // Cancels are decided first, as in Act, so the agent's stream is consumed
+  // in the same order
+  for (std::size_t i = 0; i < positions.size(); ++i) {
+    const std::size_t pos = positions[i];
+    orders[i].clear();
+    strategies[pos].CancelOrders(&agents[pos], orders[i]);
   }
-  OrderPtrs orders{};
-  std::vector<PoolIndex> ordersToCancel{};
-  const auto activeOrders = agent->GetActiveOrders();
-  for (const auto &[_, order] : activeOrders) {
-    if (cancelDist(gen)) {
-      PoolIndex slot = orderPool_->allocate();
-      Order *cancelOrder = orderPool_->get_order(slot);
-      cancelOrder->SetOrderId(order->GetOrderId());
-      cancelOrder->SetOrderType(OrderType::CANCEL);
-      cancelOrder->GetClientRef(agent->GetClientRef());
-      cancelOrder->SetSide(order->GetSide());
-      cancelOrder->SetPrice(order->GetPrice());
-      cancelOrder->SetInitialQuantity(0);
-      cancelOrder->SetRemainingQuantity(0);
-      cancelOrder->SetIndex(slot);
-
-      ordersToCancel.push_back(order->GetIndex());
-      orders.push_back(cancelOrder);
+
+  for (std::size_t base = 0; base < positions.size();
+       base += RANDOM_BATCH_LANES) {
+    const std::size_t lanes =
+        std::min(RANDOM_BATCH_LANES, positions.size() - base);
+
+    alignas(64) double u1[RANDOM_BATCH_LANES];
+    alignas(64) double u2[RANDOM_BATCH_LANES]{};
+    alignas(64) double sigma[RANDOM_BATCH_LANES]{};
+    alignas(64) double cash[RANDOM_BATCH_LANES]{};
+    alignas(64) double units[RANDOM_BATCH_LANES]{};
+    alignas(64) double buy[RANDOM_BATCH_LANES]{};
+    alignas(64) double price[RANDOM_BATCH_LANES];
+    alignas(64) double accept[RANDOM_BATCH_LANES];
+
+    // Gather per agent state, unused lanes are left to produce nothing
+    std::fill_n(u1, RANDOM_BATCH_LANES, 1.0);
+    for (std::size_t lane = 0; lane < lanes; ++lane) {
+      const Random &strategy = strategies[positions[base + lane]];
+      Agent &agent = agents[positions[base + lane]];
+      bool laneBuy;
+      DrawRandomOrder(agent.GetRng(), u1[lane], u2[lane], laneBuy);
+      buy[lane] = laneBuy ? 1.0 : 0.0;
+      sigma[lane] = strategy.sigma_;
+      const Position position = agent.GetPosition();
+      cash[lane] = position.AvailableCash() / 100.0;
+      units[lane] = static_cast<double>(position.AvailableUnits());
+    }
+
+    RandomOrderKernel(u1, u2, sigma, cash, units, buy, midPrice, price,
+                      accept);
+
+    bool taken[RANDOM_BATCH_LANES];
+    std::size_t nAccepted = 0;
+    for (std::size_t lane = 0; lane < lanes; ++lane) {
+      taken[lane] = accept[lane] != 0.0 && !orders[base + lane].full();
+      nAccepted += taken[lane];
+    }
+    PoolIndex slots[RANDOM_BATCH_LANES];
+    orderPool->allocate(slots, nAccepted);
+    const Timestamp created = OrderTimestamp();
+
+    std::size_t next = 0;
+    for (std::size_t lane = 0; lane < lanes; ++lane) {
+      if (!taken[lane]) {
+        continue;
+      }
+      PoolIndex slot = slots[next++];
+      Order *order = orderPool->get_order(slot);
+      order->SetOrderId(0);
+      order->SetOrderType(OrderType::LIMIT);
+      order->SetSide(buy[lane] != 0.0 ? Side::Buy : Side::Sell);
+      order->SetPrice(price[lane]);
+      order->SetRemainingQuantity(10);
+      order->SetIndex(slot);
+      *orderPool->get_info(slot) =
+          OrderInfo{agents[positions[base + lane]].GetClientRef(), 10, created};
+      orders[base + lane].Push(order);
     }
   }
+}
 
-  for (const auto &slotIndex : ordersToCancel) {
-    agent->RemoveActiveOrder(slotIndex);
+void Random::CancelOrders(Agent *agent, OrderBuffer &orders) {
+  if (!agent) {
+    return;
   }
+  CounterRng &rng = agent->GetRng();
+  agent->EraseActiveOrdersIf([&](Order *order) {
+    // Always draw, so a full buffer doesn't shift the agent's stream
+    if (!rng.Bernoulli(0.05) || orders.full()) {
+      return false;
+    }
+    PoolIndex slot = orderPool_->allocate();
+    Order *cancelOrder = orderPool_->get_order(slot);
+    cancelOrder->SetOrderId(order->GetOrderId());
+    cancelOrder->SetOrderType(OrderType::CANCEL);
+    cancelOrder->SetSide(order->GetSide());
+    cancelOrder->SetPrice(order->GetPrice());
+    cancelOrder->SetRemainingQuantity(0);
+    cancelOrder->SetIndex(slot);
+    *orderPool_->get_info(slot) =
+        OrderInfo{agent->GetClientRef(), 0, OrderTimestamp()};
 
-  return orders;
+    orders.Push(cancelOrder);
+    return true;
+  });
 }
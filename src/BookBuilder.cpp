@@ -0,0 +1,120 @@
+#include "BookBuilder.h"
+#include "MarketData.h"
+#include "MarketDataFeed.h"
+#include <cstddef>
+#include <cstdint>
+
+BookBuilder::BookBuilder(MarketDataFeed &feed, std::size_t subscriber)
+    : feed_(feed), subscriber_(subscriber) {}
+
+// An order's updates are published with one release store unless the stream
+// was full, so if a poll ends part way through an order the rest is already
+// on its way and is waited for, unless the engine drops this subscriber
+std::size_t BookBuilder::Poll() {
+  std::size_t applied = 0;
+  while (true) {
+    if (feed_.IsLagging(subscriber_)) {
+      if (synced_ || midSeq_) {
+        Resync();
+      }
+      // Asked on every poll, since a request can be used up by a snapshot
+      // the builder was dropped from again before it arrived
+      feed_.RequestResync(subscriber_);
+      return applied;
+    }
+    const std::size_t popped =
+        feed_.Poll(subscriber_, scratch_.data(), scratch_.size());
+    for (std::size_t i = 0; i < popped; ++i) {
+      Apply(scratch_[i]);
+    }
+    applied += popped;
+    if (popped < scratch_.size() && !midSeq_) {
+      return applied;
+    }
+  }
+}
+
+void BookBuilder::Apply(const MarketDataUpdate &update) {
+  switch (update.type) {
+  case MarketDataType::LEVEL_ADD:
+  case MarketDataType::LEVEL_CHANGE:
+  case MarketDataType::SNAPSHOT:
+    SetLevel(update.side, update.level, update.price, update.quantity);
+    break;
+  case MarketDataType::LEVEL_DELETE:
+    SetLevel(update.side, update.level, update.price, 0);
+    break;
+  case MarketDataType::TRADE:
+    lastTradePrice_ = update.price;
+    lastTradeQuantity_ = update.quantity;
+    break;
+  }
+  seq_ = update.seq;
+  midSeq_ = !update.lastInSeq;
+  if (update.type == MarketDataType::SNAPSHOT && update.lastInSeq) {
+    synced_ = true;
+  }
+}
+
+// Whatever was applied since the drop can't be trusted, so start from an
+// empty book and wait for the image
+void BookBuilder::Resync() {
+  bids_.fill(0);
+  asks_.fill(0);
+  bestBid_ = INVALID_BOOK_LEVEL;
+  bestAsk_ = INVALID_BOOK_LEVEL;
+  midSeq_ = false;
+  synced_ = false;
+  ++resyncs_;
+}
+
+void BookBuilder::SetLevel(Side side, std::uint32_t level, Price price,
+                           Quantity quantity) {
+  prices_[level] = price;
+  if (side == Side::Buy) {
+    bids_[level] = quantity;
+    if (quantity > 0) {
+      if (bestBid_ == INVALID_BOOK_LEVEL || level > bestBid_) {
+        bestBid_ = level;
+      }
+    } else if (level == bestBid_) {
+      while (bestBid_ > 0 && bids_[bestBid_] == 0) {
+        --bestBid_;
+      }
+      if (bids_[bestBid_] == 0) {
+        bestBid_ = INVALID_BOOK_LEVEL;
+      }
+    }
+  } else {
+    asks_[level] = quantity;
+    if (quantity > 0) {
+      if (bestAsk_ == INVALID_BOOK_LEVEL || level < bestAsk_) {
+        bestAsk_ = level;
+      }
+    } else if (level == bestAsk_) {
+      while (bestAsk_ < MAX_PRICE_LEVELS - 1 && asks_[bestAsk_] == 0) {
+        ++bestAsk_;
+      }
+      if (asks_[bestAsk_] == 0) {
+        bestAsk_ = INVALID_BOOK_LEVEL;
+      }
+    }
+  }
+}
+
+BookView BookBuilder::GetBookView() const {
+  BookView view;
+  if (bestBid_ != INVALID_BOOK_LEVEL) {
+    view.bestBid = prices_[bestBid_];
+    view.bidSize = bids_[bestBid_];
+  }
+  if (bestAsk_ != INVALID_BOOK_LEVEL) {
+    view.bestAsk = prices_[bestAsk_];
+    view.askSize = asks_[bestAsk_];
+  }
+  if (lastTradeQuantity_ > 0) {
+    view.lastTradePrice = lastTradePrice_;
+  }
+  view.seq = seq_;
+  return view;
+}
@@ -0,0 +1,12 @@
+#include "FeedFile.h"
+#include <stdexcept>
+#include <string>
+
+FeedReader::FeedReader(const std::string &path)
+    : file_(path),
+      header_(reinterpret_cast<const FeedFileHeader *>(file_.data())) {
+  if (file_.size() < sizeof(FeedFileHeader) || header_->magic != FEED_MAGIC ||
+      header_->version != FEED_VERSION) {
+    throw std::runtime_error("Not a feed file " + path);
+  }
+}
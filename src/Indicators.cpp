@@ -0,0 +1,83 @@
+#include "Indicators.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+void IndicatorService::OnTrade(PriceTicks price, Quantity quantity) {
+  tradedValue_ += static_cast<std::int64_t>(price) * quantity;
+  tradedQuantity_ += quantity;
+  current_.vwap = static_cast<double>(tradedValue_) /
+                  (static_cast<double>(tradedQuantity_) *
+                   PRICE_TICKS_PER_UNIT);
+}
+
+void IndicatorService::AddMid(std::int64_t twiceMid) {
+  const std::uint64_t n = nSamples_++;
+  const std::size_t slot = n % LONG_AVERAGE_WINDOW;
+  if (n >= SHORT_AVERAGE_WINDOW) {
+    shortSum_ -= mids_[(n - SHORT_AVERAGE_WINDOW) % LONG_AVERAGE_WINDOW];
+  }
+  if (n >= LONG_AVERAGE_WINDOW) {
+    longSum_ -= mids_[slot];
+  }
+  mids_[slot] = twiceMid;
+  shortSum_ += twiceMid;
+  longSum_ += twiceMid;
+
+  if (n > 0) {
+    const double ret = static_cast<double>(twiceMid - lastTwiceMid_) /
+                       static_cast<double>(lastTwiceMid_);
+    variance_ =
+        VOLATILITY_DECAY * variance_ + (1 - VOLATILITY_DECAY) * ret * ret;
+  }
+  lastTwiceMid_ = twiceMid;
+
+  constexpr double TWICE_TICKS = 2 * PRICE_TICKS_PER_UNIT;
+  const std::uint64_t nShort =
+      std::min<std::uint64_t>(n + 1, SHORT_AVERAGE_WINDOW);
+  const std::uint64_t nLong =
+      std::min<std::uint64_t>(n + 1, LONG_AVERAGE_WINDOW);
+  current_.nMids = nLong;
+  current_.shortAverage = shortSum_ / (TWICE_TICKS * nShort);
+  current_.longAverage = longSum_ / (TWICE_TICKS * nLong);
+  current_.volatility = std::sqrt(variance_);
+}
+
+void IndicatorService::OnTop(const TopOfBook &top, std::uint64_t seq) {
+  const bool quoted = top.bidSize > 0 && top.askSize > 0;
+  if (quoted) {
+    // The mid and spread follow every quoted top, only the averages and
+    // volatility are fed samples
+    const std::int64_t twiceMid =
+        static_cast<std::int64_t>(PriceToTicks(top.bid)) +
+        PriceToTicks(top.ask);
+    if (seq >= nextSample_) {
+      AddMid(twiceMid);
+      nextSample_ = seq + MID_SAMPLE_INTERVAL;
+    }
+    current_.mid = twiceMid / (2.0 * PRICE_TICKS_PER_UNIT);
+    current_.spread = top.ask - top.bid;
+  }
+  if (quoted != current_.quoted || top.bidSize != bidSize_ ||
+      top.askSize != askSize_) {
+    current_.quoted = quoted;
+    bidSize_ = top.bidSize;
+    askSize_ = top.askSize;
+    const double depth = static_cast<double>(bidSize_) + askSize_;
+    current_.imbalance =
+        depth > 0 ? (static_cast<double>(bidSize_) - askSize_) / depth : 0;
+  }
+  current_.seq = top.seq;
+  if (current_.seq == stored_.seq && current_.mid == stored_.mid &&
+      current_.spread == stored_.spread &&
+      current_.shortAverage == stored_.shortAverage &&
+      current_.longAverage == stored_.longAverage &&
+      current_.volatility == stored_.volatility &&
+      current_.vwap == stored_.vwap &&
+      current_.imbalance == stored_.imbalance &&
+      current_.nMids == stored_.nMids && current_.quoted == stored_.quoted) {
+    return;
+  }
+  stored_ = current_;
+  published_.Store(current_);
+}
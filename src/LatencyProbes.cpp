@@ -0,0 +1,123 @@
+#include "LatencyProbes.h"
+#include "HdrHistogram.h"
+#include "Tsc.h"
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+using ProbeSet = std::array<HdrHistogram, N_PROBE_STAGES>;
+
+constexpr int LABEL_WIDTH = 32;
+
+constexpr const char *STAGE_NAMES[N_PROBE_STAGES] = {
+    "Agent act", "Ring push",      "Engine pop", "Match",
+    "Dispatch",  "Engine sojourn", "Pop trade",
+};
+
+// Sets outlive their threads so a report can be printed after they join
+std::mutex registryMutex;
+std::vector<std::unique_ptr<ProbeSet>> registry;
+
+ProbeSet *RegisterProbeSet() {
+  std::lock_guard<std::mutex> lock(registryMutex);
+  registry.push_back(std::make_unique<ProbeSet>());
+  return registry.back().get();
+}
+
+} // namespace
+
+double TscTicksPerNs() {
+  static const double ticksPerNs = [] {
+    using Clock = std::chrono::steady_clock;
+    const auto wallStart = Clock::now();
+    const std::uint64_t tscStart = ReadTsc();
+    while (Clock::now() - wallStart < std::chrono::milliseconds(20)) {
+    }
+    const std::uint64_t tscEnd = ReadTscp();
+    const auto wallEnd = Clock::now();
+    const double ns =
+        std::chrono::duration<double, std::nano>(wallEnd - wallStart).count();
+    return static_cast<double>(tscEnd - tscStart) / ns;
+  }();
+  return ticksPerNs;
+}
+
+void RecordLatency(ProbeStage stage, std::uint64_t ticks) {
+  thread_local ProbeSet *probeSet = RegisterProbeSet();
+  (*probeSet)[static_cast<std::size_t>(stage)].Record(ticks);
+}
+
+HdrHistogram GetLatency(ProbeStage stage) {
+  HdrHistogram merged;
+  std::lock_guard<std::mutex> lock(registryMutex);
+  for (const auto &probeSet : registry) {
+    merged.Merge((*probeSet)[static_cast<std::size_t>(stage)]);
+  }
+  return merged;
+}
+
+void ResetLatencyProbes() {
+  std::lock_guard<std::mutex> lock(registryMutex);
+  for (const auto &probeSet : registry) {
+    for (HdrHistogram &histogram : *probeSet) {
+      histogram.Reset();
+    }
+  }
+}
+
+void PrintLatencyHeader(std::string_view title) {
+  std::cout << "+----------------------------------------------------------+\n";
+  std::cout << "| " << std::left << std::setw(57) << title << "|\n";
+  std::cout << "+----------------------------------------------------------+\n";
+  std::cout << std::left << std::setw(LABEL_WIDTH) << "" << std::right
+            << ' ' << std::setw(12) << "Count";
+  for (const char *column : {"p50", "p90", "p99", "p99.9", "p99.99"}) {
+    std::cout << ' ' << std::setw(9) << column;
+  }
+  std::cout << ' ' << std::setw(10) << "Max" << '\n';
+}
+
+void PrintLatencyRow(std::string_view label, const HdrHistogram &histogram) {
+  if (histogram.count() == 0) {
+    return;
+  }
+  // Every field is preceded by a space so values wider than their column
+  // still stay apart
+  std::cout << std::left << std::setw(LABEL_WIDTH) << label << std::right
+            << ' ' << std::setw(12) << histogram.count() << std::fixed
+            << std::setprecision(0);
+  for (double percentile : {50.0, 90.0, 99.0, 99.9, 99.99}) {
+    std::cout << ' ' << std::setw(9)
+              << TscToNs(histogram.ValueAtPercentile(percentile));
+  }
+  std::cout << ' ' << std::setw(10) << TscToNs(histogram.max()) << '\n'
+            << std::defaultfloat << std::setprecision(6);
+}
+
+void PrintLatencyReport() {
+  if constexpr (!LATENCY_PROBES_ENABLED) {
+    return;
+  }
+  ProbeSet merged;
+  {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (const auto &probeSet : registry) {
+      for (std::size_t i = 0; i < N_PROBE_STAGES; ++i) {
+        merged[i].Merge((*probeSet)[i]);
+      }
+    }
+  }
+
+  PrintLatencyHeader("Stage Latency (ns)");
+  for (std::size_t i = 0; i < N_PROBE_STAGES; ++i) {
+    PrintLatencyRow(STAGE_NAMES[i], merged[i]);
+  }
+}
@@ -0,0 +1,88 @@
+#include "Ledger.h"
+#include <cstdint>
+
+void Ledger::Open(ClientRef clientRef, std::int64_t cash,
+                  std::int64_t units) {
+  if (clientRef >= open_.size()) {
+    positions_.resize(clientRef + 1);
+    open_.resize(clientRef + 1);
+    touched_.resize(clientRef + 1);
+  }
+  while (snapshots_.size() <= clientRef) {
+    snapshots_.emplace_back();
+  }
+  open_[clientRef] = 1;
+  positions_[clientRef] = Position{cash, units, 0, 0};
+  snapshots_[clientRef].Store(positions_[clientRef]);
+}
+
+bool Ledger::CanAfford(ClientRef clientRef, Side side, PriceTicks price,
+                       Quantity quantity) const {
+  if (!IsOpen(clientRef)) {
+    return true;
+  }
+  const Position &position = positions_[clientRef];
+  if (side == Side::Buy) {
+    return position.AvailableCash() >=
+           static_cast<std::int64_t>(price) * quantity;
+  }
+  return position.AvailableUnits() >= quantity;
+}
+
+Position *Ledger::Touch(ClientRef clientRef) {
+  if (!IsOpen(clientRef)) {
+    return nullptr;
+  }
+  if (!touched_[clientRef]) {
+    touched_[clientRef] = 1;
+    changed_.push_back(clientRef);
+  }
+  return &positions_[clientRef];
+}
+
+void Ledger::Hold(ClientRef clientRef, Side side, PriceTicks price,
+                  Quantity quantity) {
+  Position *position = Touch(clientRef);
+  if (!position) {
+    return;
+  }
+  if (side == Side::Buy) {
+    position->heldCash += static_cast<std::int64_t>(price) * quantity;
+  } else {
+    position->heldUnits += quantity;
+  }
+}
+
+void Ledger::Release(ClientRef clientRef, Side side, PriceTicks price,
+                     Quantity quantity) {
+  Position *position = Touch(clientRef);
+  if (!position) {
+    return;
+  }
+  if (side == Side::Buy) {
+    position->heldCash -= static_cast<std::int64_t>(price) * quantity;
+  } else {
+    position->heldUnits -= quantity;
+  }
+}
+
+void Ledger::Settle(ClientRef buyer, ClientRef seller, PriceTicks price,
+                    Quantity quantity) {
+  const std::int64_t value = static_cast<std::int64_t>(price) * quantity;
+  if (Position *position = Touch(buyer)) {
+    position->cash -= value;
+    position->units += quantity;
+  }
+  if (Position *position = Touch(seller)) {
+    position->cash += value;
+    position->units -= quantity;
+  }
+}
+
+void Ledger::Publish() {
+  for (const ClientRef clientRef : changed_) {
+    snapshots_[clientRef].Store(positions_[clientRef]);
+    touched_[clientRef] = 0;
+  }
+  changed_.clear();
+}
@@ -0,0 +1,33 @@
+#include "MappedFile.h"
+#include <cstddef>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string &path) {
+  fd_ = ::open(path.c_str(), O_RDONLY);
+  if (fd_ < 0) {
+    throw std::runtime_error("Could not open " + path);
+  }
+  struct stat st;
+  if (::fstat(fd_, &st) != 0 || st.st_size == 0) {
+    ::close(fd_);
+    throw std::runtime_error("Empty or unreadable file " + path);
+  }
+  size_ = static_cast<std::size_t>(st.st_size);
+  void *map = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+  if (map == MAP_FAILED) {
+    ::close(fd_);
+    throw std::runtime_error("Could not map " + path);
+  }
+  data_ = static_cast<std::byte *>(map);
+  ::madvise(map, size_, MADV_SEQUENTIAL);
+}
+
+MappedFile::~MappedFile() {
+  ::munmap(data_, size_);
+  ::close(fd_);
+}
@@ -0,0 +1,49 @@
+#include "MarketDataFeed.h"
+#include "MarketData.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+MarketDataFeed::MarketDataFeed(std::size_t nSubscribers)
+    : stream_(std::make_unique<MarketDataStream>(nSubscribers)),
+      resyncRequested_(
+          std::make_unique<std::atomic<bool>[]>(nSubscribers)) {}
+
+void MarketDataFeed::Publish(MarketDataBatch &batch, std::uint64_t seq) {
+  batch.Seal(seq);
+  std::size_t pushed = stream_->Push(batch.data(), batch.size());
+  if (pushed < batch.size()) {
+    // Whoever is holding the engine up is dropped rather than waited for
+    const std::size_t dropped = stream_->DetachLaggards(batch.size() - pushed);
+    dropped_.store(dropped_.load(std::memory_order_relaxed) + dropped,
+                   std::memory_order_relaxed);
+    stream_->Push(batch.data() + pushed, batch.size() - pushed);
+  }
+}
+
+void MarketDataFeed::PublishSnapshot(MarketDataBatch &image,
+                                     std::uint64_t seq) {
+  for (std::size_t i = 0; i < stream_->consumers(); ++i) {
+    if (resyncRequested_[i].exchange(false, std::memory_order_acquire)) {
+      pendingResyncs_.fetch_sub(1, std::memory_order_relaxed);
+      if (stream_->IsDetached(i)) {
+        stream_->Reattach(i);
+      }
+    }
+  }
+  Publish(image, seq);
+}
+
+void MarketDataFeed::RequestResync(std::size_t subscriber) {
+  if (!resyncRequested_[subscriber].exchange(true,
+                                             std::memory_order_release)) {
+    pendingResyncs_.fetch_add(1, std::memory_order_release);
+  }
+}
+
+std::size_t MarketDataFeed::Poll(std::size_t subscriber,
+                                 MarketDataUpdate *updates,
+                                 std::size_t maxUpdates) {
+  return stream_->Pop(subscriber, updates, maxUpdates);
+}
@@ -1,37 +1,137 @@
 #include "MatchingEngine.h"
+#include "LatencyProbes.h"
+#include "PerfCounters.h"
+#include "ThreadPlacement.h"
 #include "Order.h"
+#include <algorithm>
+#include <array>
 #include <utility>
 
 void MatchingEngine::Start() {
+  PinThread(PipelineRole::ENGINE);
+  ThreadPerfCounters counters("Matching engine");
   running_ = true;
-  Order *order = nullptr;
   while (running_) {
-    if (orders_.Pop(order)) {
-      order->SetOrderId(++counter_);
-      ProcessOrder(std::move(order));
+    while (SequenceBatch() > 0) {
     }
   }
 }
 
+std::size_t MatchingEngine::Drain() {
+  std::size_t n = 0;
+  while (const std::size_t sequenced = SequenceBatch()) {
+    n += sequenced;
+  }
+  return n;
+}
+
+void MatchingEngine::SetDrainBatch(std::size_t drainBatch) {
+  drainBatch_ = std::clamp<std::size_t>(drainBatch, 1, ENGINE_DRAIN_BATCH);
+}
+
+// Pops up to a batch of orders and sequences them in turn. While one order
+// is matched, the one after it has its info, price level and index slot
+// prefetched, and the order two ahead is pulled in so its fields are warm
+// by the time they are needed for those prefetches.
+std::size_t MatchingEngine::SequenceBatch() {
+  std::array<Order *, ENGINE_DRAIN_BATCH> batch;
+  // An idle engine polls constantly, so an empty poll isn't timed
+  if constexpr (LATENCY_PROBES_ENABLED) {
+    if (orders_.empty()) {
+      return 0;
+    }
+  }
+  const std::uint64_t start = ProbeStart();
+  const std::size_t n = orders_.Pop(batch.data(), drainBatch_);
+  if (n == 0) {
+    return 0;
+  }
+  ProbeEnd(ProbeStage::ENGINE_POP, start);
+  if (n > 1) {
+    __builtin_prefetch(batch[1]);
+  }
+  for (std::size_t i = 0; i < n; ++i) {
+    if (i + 2 < n) {
+      __builtin_prefetch(batch[i + 2]);
+    }
+    if (i + 1 < n) {
+      const Order *next = batch[i + 1];
+      __builtin_prefetch(orderPool_->get_info(next->GetIndex()));
+      // Sequenced right after this one
+      orderbook_.Prefetch(next, counter_ + 2);
+    }
+    Timestamp stamp = 0;
+    if constexpr (LATENCY_PROBES_ENABLED) {
+      stamp = orderPool_->get_info(batch[i]->GetIndex())->timestamp;
+    }
+    SequenceOrder(batch[i]);
+    if (stamp != 0) {
+      ProbeEnd(ProbeStage::SOJOURN, stamp);
+    }
+  }
+  return n;
+}
+
+void MatchingEngine::SequenceOrder(Order *order) {
+  order->SetOrderId(++counter_);
+  if (journal_) {
+    journal_->Append(*order, *orderPool_->get_info(order->GetIndex()));
+  }
+  ProcessOrder(std::move(order));
+}
+
 void MatchingEngine::Stop() {
   while (!orders_.empty()) {
   }
   running_ = false;
 }
 
+void MatchingEngine::AttachJournal(OrderJournal *journal) {
+  journal_ = journal;
+  tradeDigest_ = &journal->GetTradeDigest();
+}
+
+void MatchingEngine::AttachTradeDigest(TradeDigest *tradeDigest) {
+  tradeDigest_ = tradeDigest;
+}
+
 void MatchingEngine::ProcessOrder(Order *order) {
   ++ordersProcessed_;
+  std::uint64_t start = ProbeStart();
   switch (order->GetOrderType()) {
   case OrderType::LIMIT:
+    if (!CanAfford(order)) {
+      RejectOrder(order);
+      break;
+    }
     MatchLimitOrder(std::move(order));
     break;
   case OrderType::MARKET:
+    if (!CanAfford(order)) {
+      RejectOrder(order);
+      break;
+    }
     MatchMarketOrder(std::move(order));
     break;
   case OrderType::CANCEL:
     CancelOrder(std::move(order));
     break;
+  case OrderType::MASS_CANCEL:
+    orderbook_.MassCancel(order);
+    orderPool_->deallocate(order->GetIndex());
+    break;
   }
+  ProbeEnd(ProbeStage::MATCH, start);
+  start = ProbeStart();
+  if (tradeDigest_) {
+    tradeDigest_->Add(orderbook_.GetTradeBatch());
+  }
+  orderbook_.DispatchTrades();
+  orderbook_.PublishMarketData(ordersProcessed_);
+  orderbook_.PublishTopOfBook(ordersProcessed_);
+  orderbook_.PublishTape(ordersProcessed_);
+  ledger_.Publish();
+  ProbeEnd(ProbeStage::DISPATCH, start);
 }
 
 void MatchingEngine::MatchLimitOrder(Order *order) {
@@ -39,12 +139,11 @@ void MatchingEngine::MatchLimitOrder(Order *order) {
     while (order->GetRemainingQuantity() > 0) {
       auto index = orderbook_.GetBestAsk();
       if (!index) {
-        orderbook_.AddOrder(std::move(order));
+        RestLimitOrder(order);
         return;
       }
-      Price price = orderbook_.IndexToPrice(*index);
-      if (price > order->GetPrice()) {
-        orderbook_.AddOrder(std::move(order));
+      if (orderbook_.IndexToTicks(*index) > order->GetPriceTicks()) {
+        RestLimitOrder(order);
         return;
       }
       orderbook_.FillOrder(order, *index);
@@ -54,12 +153,11 @@ void MatchingEngine::MatchLimitOrder(Order *order) {
     while (order->GetRemainingQuantity() > 0) {
       auto index = orderbook_.GetBestBid();
       if (!index) {
-        orderbook_.AddOrder(std::move(order));
+        RestLimitOrder(order);
         return;
       }
-      Price price = orderbook_.IndexToPrice(*index);
-      if (price < order->GetPrice()) {
-        orderbook_.AddOrder(std::move(order));
+      if (orderbook_.IndexToTicks(*index) < order->GetPriceTicks()) {
+        RestLimitOrder(order);
         return;
       }
       orderbook_.FillOrder(order, *index);
@@ -68,13 +166,21 @@ void MatchingEngine::MatchLimitOrder(Order *order) {
   }
 }
 
+void MatchingEngine::RestLimitOrder(Order *order) {
+  orderbook_.AddOrder(order);
+  orderbook_.AckOrder(order);
+}
+
 //TO-DO
 //Improve cancelling market orders that can't find any matching orders
 void MatchingEngine::MatchMarketOrder(Order *order) {
   Side side = order->GetSide();
   while (order->GetRemainingQuantity() > 0) {
     auto index = (side == Side::Buy) ? orderbook_.GetBestAsk() : orderbook_.GetBestBid(); 
-    if (!index) {
+    // Cancelled like one that runs out of liquidity once the buyer can't
+    // pay for the next fill
+    if (!index ||
+        (side == Side::Buy && !CanAffordFill(order, *index))) {
       Order* cancelOrder = CreateCancelOrder(order);
       orderbook_.AddOrder(std::move(order));
       CancelOrder(cancelOrder);
@@ -85,6 +191,32 @@ void MatchingEngine::MatchMarketOrder(Order *order) {
   orderPool_->deallocate(order->GetIndex());
 }
 
+// A limit buy must be covered at its limit, the most it can pay per unit,
+// and a sell by units not already committed to the book. A market buy has no
+// limit, so its cash is checked fill by fill instead.
+bool MatchingEngine::CanAfford(const Order *order) const {
+  if (order->GetOrderType() == OrderType::MARKET &&
+      order->GetSide() == Side::Buy) {
+    return true;
+  }
+  return ledger_.CanAfford(orderPool_->get_info(order->GetIndex())->clientRef,
+                           order->GetSide(), order->GetPriceTicks(),
+                           order->GetRemainingQuantity());
+}
+
+bool MatchingEngine::CanAffordFill(const Order *order,
+                                   std::uint64_t index) const {
+  return ledger_.CanAfford(orderPool_->get_info(order->GetIndex())->clientRef,
+                           order->GetSide(), orderbook_.IndexToTicks(index),
+                           orderbook_.GetFillQuantity(order, index));
+}
+
+void MatchingEngine::RejectOrder(Order *order) {
+  ++ordersRejected_;
+  orderbook_.RejectOrder(order);
+  orderPool_->deallocate(order->GetIndex());
+}
+
 void MatchingEngine::CancelOrder(Order *order) {
   orderbook_.CancelOrder(order);
   orderPool_->deallocate(order->GetIndex());
@@ -95,11 +227,12 @@ Order* MatchingEngine::CreateCancelOrder(Order * order) {
   Order *cancelOrder = orderPool_->get_order(slot);
   cancelOrder->SetOrderId(order->GetOrderId());
   cancelOrder->SetOrderType(OrderType::CANCEL);
-  cancelOrder->GetClientRef(order->GetClientRef());
   cancelOrder->SetSide(order->GetSide());
   cancelOrder->SetPrice(order->GetPrice());
-  cancelOrder->SetInitialQuantity(0);
   cancelOrder->SetRemainingQuantity(0);
   cancelOrder->SetIndex(slot);
+  // The cancel answers the market order, so it carries the market order's stamp
+  const OrderInfo &info = *orderPool_->get_info(order->GetIndex());
+  *orderPool_->get_info(slot) = OrderInfo{info.clientRef, 0, info.timestamp};
   return cancelOrder;
 };
@@ -0,0 +1,158 @@
+#include "OrderJournal.h"
+#include "CounterRng.h"
+#include "Order.h"
+#include "PerfCounters.h"
+#include "ThreadPlacement.h"
+#include "Trade.h"
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+
+void TradeDigest::Add(const TradeBatch &batch) {
+  auto mix = [this](std::uint64_t x) { digest_ = SplitMix64(digest_ ^ x); };
+  for (std::size_t i = 0; i < batch.size(); ++i) {
+    const TradeInfo &report = batch.data()[i];
+    mix(report.orderId);
+    mix(report.clientRef);
+    mix(std::bit_cast<std::uint64_t>(report.price));
+    mix(static_cast<std::uint64_t>(report.quantity) << 32 |
+        static_cast<std::uint64_t>(report.type) << 16 |
+        static_cast<std::uint64_t>(report.orderType) << 8 |
+        static_cast<std::uint64_t>(report.side));
+  }
+  nReports_ += batch.size();
+}
+
+OrderJournal::OrderJournal(const std::string &path, std::size_t maxRecords)
+    : mapSize_(sizeof(JournalHeader) + maxRecords * sizeof(JournalRecord)),
+      maxRecords_(maxRecords) {
+  fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd_ < 0) {
+    throw std::runtime_error("Could not open journal " + path);
+  }
+  if (::ftruncate(fd_, static_cast<off_t>(mapSize_)) != 0) {
+    ::close(fd_);
+    throw std::runtime_error("Could not size journal " + path);
+  }
+  void *map =
+      ::mmap(nullptr, mapSize_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (map == MAP_FAILED) {
+    ::close(fd_);
+    throw std::runtime_error("Could not map journal " + path);
+  }
+  map_ = static_cast<std::byte *>(map);
+  records_ = reinterpret_cast<JournalRecord *>(map_ + sizeof(JournalHeader));
+  ::posix_fallocate(fd_, 0,
+                    static_cast<off_t>(
+                        std::min(mapSize_, JOURNAL_ALLOCATE_AHEAD)));
+
+  running_ = true;
+  flusher_ = std::thread(&OrderJournal::RunFlusher, this);
+}
+
+OrderJournal::~OrderJournal() { Close(); }
+
+void OrderJournal::Append(const Order &order, const OrderInfo &info) {
+  if (full_) {
+    return;
+  }
+  const std::uint64_t n = nRecords_.load(std::memory_order_relaxed);
+  if (n == maxRecords_) {
+    full_ = true;
+    fullDigest_ = tradeDigest_;
+    return;
+  }
+  records_[n] = JournalRecord{order.GetOrderId(),
+                              info.clientRef,
+                              order.GetPrice(),
+                              order.GetRemainingQuantity(),
+                              static_cast<std::uint8_t>(order.GetOrderType()),
+                              static_cast<std::uint8_t>(order.GetSide()),
+                              static_cast<std::uint8_t>(order.GetPriceFilter()),
+                              0};
+  nRecords_.store(n + 1, std::memory_order_release);
+}
+
+// Keeps disk space reserved ahead of the matching thread so its page faults
+// never wait on the filesystem, and starts write back of completed pages so
+// Close has little left to do
+void OrderJournal::RunFlusher() {
+  PinThread(PipelineRole::IO);
+  ThreadPerfCounters counters("Journal flusher");
+  const std::size_t pageSize =
+      static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+  std::size_t allocated = std::min(mapSize_, JOURNAL_ALLOCATE_AHEAD);
+  std::size_t flushed = 0;
+  while (running_) {
+    const std::size_t written =
+        sizeof(JournalHeader) +
+        nRecords_.load(std::memory_order_acquire) * sizeof(JournalRecord);
+    if (allocated < mapSize_ &&
+        written + JOURNAL_ALLOCATE_AHEAD / 2 > allocated) {
+      const std::size_t length =
+          std::min(JOURNAL_ALLOCATE_AHEAD, mapSize_ - allocated);
+      ::posix_fallocate(fd_, static_cast<off_t>(allocated),
+                        static_cast<off_t>(length));
+      allocated += length;
+    }
+    const std::size_t complete = written / pageSize * pageSize;
+    if (complete > flushed) {
+      ::msync(map_ + flushed, complete - flushed, MS_ASYNC);
+      flushed = complete;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+void OrderJournal::Close() {
+  if (fd_ < 0) {
+    return;
+  }
+  running_ = false;
+  if (flusher_.joinable()) {
+    flusher_.join();
+  }
+
+  const TradeDigest &digest = full_ ? fullDigest_ : tradeDigest_;
+  const std::uint64_t n = nRecords_.load(std::memory_order_acquire);
+  JournalHeader header{};
+  header.magic = JOURNAL_MAGIC;
+  header.version = JOURNAL_VERSION;
+  header.recordSize = sizeof(JournalRecord);
+  header.nRecords = n;
+  header.nReports = digest.GetNReports();
+  header.tradeDigest = digest.GetDigest();
+  *reinterpret_cast<JournalHeader *>(map_) = header;
+
+  const std::size_t used = sizeof(JournalHeader) + n * sizeof(JournalRecord);
+  ::msync(map_, used, MS_SYNC);
+  ::munmap(map_, mapSize_);
+  ::ftruncate(fd_, static_cast<off_t>(used));
+  ::close(fd_);
+  map_ = nullptr;
+  records_ = nullptr;
+  fd_ = -1;
+}
+
+JournalReader::JournalReader(const std::string &path) : file_(path) {
+  header_ = reinterpret_cast<const JournalHeader *>(file_.data());
+  if (file_.size() < sizeof(JournalHeader) || header_->magic != JOURNAL_MAGIC ||
+      header_->version != JOURNAL_VERSION ||
+      header_->recordSize != sizeof(JournalRecord) ||
+      file_.size() < sizeof(JournalHeader) +
+                         header_->nRecords * sizeof(JournalRecord)) {
+    throw std::runtime_error("Not a journal " + path);
+  }
+  records_ = std::span<const JournalRecord>(
+      reinterpret_cast<const JournalRecord *>(file_.data() +
+                                              sizeof(JournalHeader)),
+      header_->nRecords);
+}
@@ -1,9 +1,12 @@
 #include "Orderbook.h"
+#include "MarketData.h"
+#include "MarketDataFeed.h"
 #include "Order.h"
 #include "OrderPool.h"
 #include "PriceLevel.h"
 #include "Trade.h"
 #include "TradeDispatcher.h"
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <cstdint>
@@ -11,8 +14,10 @@
 #include <iostream>
 #include <optional>
 
-Orderbook::Orderbook(OrderPool *orderPool, TradeDispatcher &tradeDispatcher)
-    : orderPool_(orderPool), tradeDispatcher_(tradeDispatcher) {};
+Orderbook::Orderbook(OrderPool *orderPool, TradeDispatcher &tradeDispatcher,
+                     std::size_t orderMapCapacity)
+    : orderMap_(orderMapCapacity), tradeDispatcher_(tradeDispatcher),
+      orderPool_(orderPool) {};
 
 void Orderbook::setBidBit(const uint64_t index) {
   bids_bitmap_[index / 64] |= (1ULL << (index % 64));
@@ -68,6 +73,20 @@ std::optional<uint64_t> Orderbook::GetBestAsk() {
   return bestAskIndex_;
 }
 
+// The top and the indicators sit behind separate seqlocks, read both until
+// the indicators are the ones computed with that top
+BookView Orderbook::GetBookView() const {
+  TopOfBook top = topOfBook_.Load();
+  MarketIndicators indicators = indicators_.Load();
+  while (indicators.seq != top.seq) {
+    top = topOfBook_.Load();
+    indicators = indicators_.Load();
+  }
+  BookView view = MakeBookView(top);
+  view.indicators = indicators;
+  return view;
+}
+
 uint64_t Orderbook::PriceToIndex(Price price) const {
   // assert(price >= 100 && price <= 120);
   if (price < 100) {
@@ -91,15 +110,26 @@ Price Orderbook::IndexToPrice(uint64_t index) const {
   return min_price_ + index * tick_size_;
 }
 
+uint64_t Orderbook::TicksToIndex(PriceTicks ticks) const {
+  ticks = std::clamp(ticks, MIN_PRICE_TICKS,
+                     MIN_PRICE_TICKS + MAX_PRICE_LEVELS - 1);
+  return static_cast<uint64_t>(ticks - MIN_PRICE_TICKS);
+}
+
+PriceTicks Orderbook::IndexToTicks(uint64_t index) const {
+  return MIN_PRICE_TICKS + static_cast<PriceTicks>(index);
+}
+
 void Orderbook::AddOrder(Order *order) {
-  const uint64_t &index = PriceToIndex(order->GetPrice());
+  const uint64_t &index = TicksToIndex(order->GetPriceTicks());
   const Side side = order->GetSide();
   auto &priceLevel = (side == Side::Buy) ? bids_[index] : asks_[index];
 
   const PoolIndex poolIndex = order->GetIndex();
   Order *oldTail = nullptr;
+  const bool newLevel = priceLevel.empty();
 
-  if (!priceLevel.empty()) {
+  if (!newLevel) {
     oldTail = orderPool_->get_order(priceLevel.tail_);
     order->SetPrev(priceLevel.tail_);
     order->SetNext(-1);
@@ -116,11 +146,31 @@ void Orderbook::AddOrder(Order *order) {
       setAskBit(index);
     }
   }
+  priceLevel.quantity_ += order->GetRemainingQuantity();
+  OrderInfo &info = *orderPool_->get_info(poolIndex);
+  LinkClientOrder(poolIndex, info);
+  if (ledger_) {
+    ledger_->Hold(info.clientRef, side, order->GetPriceTicks(),
+                  order->GetRemainingQuantity());
+  }
+  RecordLevel(side, index,
+              newLevel ? MarketDataType::LEVEL_ADD
+                       : MarketDataType::LEVEL_CHANGE);
   orderMap_.insert({order->GetOrderId(), poolIndex});
 }
 
+void Orderbook::Prefetch(const Order *order, OrderId orderId) const {
+  const OrderType type = order->GetOrderType();
+  if (type == OrderType::LIMIT || type == OrderType::CANCEL) {
+    const uint64_t index = TicksToIndex(order->GetPriceTicks());
+    __builtin_prefetch(order->GetSide() == Side::Buy ? &bids_[index]
+                                                     : &asks_[index]);
+  }
+  orderMap_.prefetch(orderId);
+}
+
 void Orderbook::RemoveOrder(Order *order) {
-  const uint64_t &index = PriceToIndex(order->GetPrice());
+  const uint64_t &index = TicksToIndex(order->GetPriceTicks());
   auto &priceLevel =
       (order->GetSide() == Side::Buy) ? bids_[index] : asks_[index];
 
@@ -144,12 +194,23 @@ void Orderbook::RemoveOrder(Order *order) {
     priceLevel.tail_ = prev;
   }
 
+  priceLevel.quantity_ -= order->GetRemainingQuantity();
+  OrderInfo &info = *orderPool_->get_info(poolIndex);
+  UnlinkClientOrder(info);
+  if (ledger_ && order->GetRemainingQuantity() > 0) {
+    ledger_->Release(info.clientRef, order->GetSide(), order->GetPriceTicks(),
+                     order->GetRemainingQuantity());
+  }
   if (priceLevel.empty()) {
     if (order->GetSide() == Side::Buy) {
       clearBidBit(index);
     } else {
       clearAskBit(index);
     }
+    RecordLevel(order->GetSide(), index, MarketDataType::LEVEL_DELETE);
+  } else if (order->GetRemainingQuantity() > 0) {
+    // Filled orders had their quantity taken off as they were filled
+    RecordLevel(order->GetSide(), index, MarketDataType::LEVEL_CHANGE);
   }
 
   orderMap_.erase(order->GetOrderId());
@@ -157,7 +218,7 @@ void Orderbook::RemoveOrder(Order *order) {
 }
 
 void Orderbook::CancelOrder(Order *cancelOrder) {
-  const std::uint64_t &index{PriceToIndex(cancelOrder->GetPrice())};
+  const std::uint64_t &index{TicksToIndex(cancelOrder->GetPriceTicks())};
   if (cancelOrder->GetSide() == Side::Buy) {
     auto &priceLevel = bids_[index];
     const PoolIndex *ptr = orderMap_.find(cancelOrder->GetOrderId());
@@ -168,17 +229,20 @@ void Orderbook::CancelOrder(Order *cancelOrder) {
     // cancelOrder->GetOrderId() << std::endl;
     PoolIndex poolIndex = *ptr;
     Order *order = orderPool_->get_order(poolIndex);
+    const OrderInfo &cancelInfo =
+        *orderPool_->get_info(cancelOrder->GetIndex());
     TradeInfo bidTrade(order->GetOrderId(), order->GetOrderType(),
-                       order->GetClientRef(), Side::Buy, order->GetPrice(),
-                       order->GetRemainingQuantity(), *cancelOrder,
-                       ExecutionType::CANCEL);
+                       orderPool_->get_info(poolIndex)->clientRef, Side::Buy,
+                       order->GetPrice(), order->GetRemainingQuantity(),
+                       *cancelOrder, ExecutionType::CANCEL,
+                       cancelInfo.timestamp);
     TradeInfo askTrade(
         cancelOrder->GetOrderId(), OrderType::CANCEL,
-        cancelOrder->GetClientRef(), Side::Sell, 110, 0, *cancelOrder,
-        ExecutionType::INVALID); // Maybe trades should be refactored for better
+        cancelInfo.clientRef, Side::Sell, 110, 0, *cancelOrder,
+        ExecutionType::INVALID, 0); // Maybe trades should be refactored for better
                                  // integration with cancels?
     Trade trade(askTrade, bidTrade);
-    tradeDispatcher_.PushTradeInfo(std::move(trade));
+    tradeBatch_.Add(std::move(trade));
     RemoveOrder(std::move(order));
   } else {
     auto &priceLevel = asks_[index];
@@ -191,28 +255,92 @@ void Orderbook::CancelOrder(Order *cancelOrder) {
     PoolIndex poolIndex = *ptr;
 
     Order *order = orderPool_->get_order(poolIndex);
+    const OrderInfo &cancelInfo =
+        *orderPool_->get_info(cancelOrder->GetIndex());
     TradeInfo askTrade(order->GetOrderId(), order->GetOrderType(),
-                       order->GetClientRef(), Side::Sell, order->GetPrice(),
-                       order->GetRemainingQuantity(), *cancelOrder,
-                       ExecutionType::CANCEL);
+                       orderPool_->get_info(poolIndex)->clientRef, Side::Sell,
+                       order->GetPrice(), order->GetRemainingQuantity(),
+                       *cancelOrder, ExecutionType::CANCEL,
+                       cancelInfo.timestamp);
     TradeInfo bidTrade(
         cancelOrder->GetOrderId(), OrderType::CANCEL,
-        cancelOrder->GetClientRef(), Side::Buy, 110, 0, *cancelOrder,
-        ExecutionType::INVALID); // Maybe trades should be refactored for better
+        cancelInfo.clientRef, Side::Buy, 110, 0, *cancelOrder,
+        ExecutionType::INVALID, 0); // Maybe trades should be refactored for better
                                  // integration with cancels?
     Trade trade(askTrade, bidTrade);
-    tradeDispatcher_.PushTradeInfo(std::move(trade));
+    tradeBatch_.Add(std::move(trade));
     RemoveOrder(std::move(order));
   }
 }
 
+void Orderbook::MassCancel(Order *massCancel) {
+  const OrderInfo &massCancelInfo =
+      *orderPool_->get_info(massCancel->GetIndex());
+  const ClientRef clientRef = massCancelInfo.clientRef;
+  Quantity nCancelled = 0;
+  PoolIndex poolIndex = clientRef < clientOrders_.size()
+                            ? clientOrders_[clientRef]
+                            : INVALID_POOL_INDEX;
+  while (poolIndex != INVALID_POOL_INDEX) {
+    Order *order = orderPool_->get_order(poolIndex);
+    // Removing the order unlinks it
+    const PoolIndex next = orderPool_->get_info(poolIndex)->clientNext;
+    if (order->MatchesMassCancel(*massCancel)) {
+      // Only the summary answers the request, so only it carries the stamp
+      tradeBatch_.Add(TradeInfo{order->GetOrderId(), order->GetOrderType(),
+                                clientRef, order->GetSide(), order->GetPrice(),
+                                order->GetRemainingQuantity(), *order,
+                                ExecutionType::CANCEL, 0});
+      RemoveOrder(order);
+      ++nCancelled;
+    }
+    poolIndex = next;
+  }
+  tradeBatch_.Add(TradeInfo{massCancel->GetOrderId(), OrderType::MASS_CANCEL,
+                            clientRef, massCancel->GetSide(),
+                            massCancel->GetPrice(), nCancelled, *massCancel,
+                            ExecutionType::MASS_CANCEL,
+                            massCancelInfo.timestamp});
+}
+
 void Orderbook::FillOrder(Order *order, std::uint64_t index) {
   auto &matchedPriceLevel =
       (order->GetSide() == Side::Buy) ? asks_[index] : bids_[index];
   const PoolIndex matchedIndex = matchedPriceLevel.head_;
   Order *matchedOrder = orderPool_->get_order(matchedIndex);
   assert(matchedOrder != order);
+  // The cold halves are only needed for the reports
+  const OrderInfo &orderInfo = *orderPool_->get_info(order->GetIndex());
+  const OrderInfo &matchedInfo = *orderPool_->get_info(matchedIndex);
   Quantity filledQuantity = matchedOrder->Fill(*order);
+  matchedPriceLevel.quantity_ -= filledQuantity;
+  lastTradePrice_ = matchedOrder->GetPrice();
+  lastTradeQuantity_ = filledQuantity;
+  indicators_.OnTrade(matchedOrder->GetPriceTicks(), filledQuantity);
+  if (ledger_) {
+    const bool buying = order->GetSide() == Side::Buy;
+    ledger_->Release(matchedInfo.clientRef, matchedOrder->GetSide(),
+                     matchedOrder->GetPriceTicks(), filledQuantity);
+    ledger_->Settle((buying ? orderInfo : matchedInfo).clientRef,
+                    (buying ? matchedInfo : orderInfo).clientRef,
+                    matchedOrder->GetPriceTicks(), filledQuantity);
+  }
+  if (tape_) {
+    const bool buying = order->GetSide() == Side::Buy;
+    tape_->AddTrade(matchedOrder->GetPrice(), filledQuantity, order->GetSide(),
+                    (buying ? orderInfo : matchedInfo).clientRef,
+                    (buying ? matchedInfo : orderInfo).clientRef);
+  }
+  if (marketDataFeed_) {
+    marketDataBatch_.Add(MarketDataType::TRADE, order->GetSide(),
+                         static_cast<std::uint32_t>(index),
+                         matchedOrder->GetPrice(), filledQuantity);
+    // A level emptied by this fill is deleted when the order is removed
+    if (matchedPriceLevel.quantity_ > 0) {
+      RecordLevel(matchedOrder->GetSide(), index,
+                  MarketDataType::LEVEL_CHANGE);
+    }
+  }
 
   ExecutionType orderExecutionType;
   ExecutionType matchedOrderExecutionType;
@@ -231,26 +359,26 @@ void Orderbook::FillOrder(Order *order, std::uint64_t index) {
 
   if (order->GetSide() == Side::Buy) {
     TradeInfo bidTrade(order->GetOrderId(), order->GetOrderType(),
-                       order->GetClientRef(), Side::Buy,
+                       orderInfo.clientRef, Side::Buy,
                        matchedOrder->GetPrice(), filledQuantity, *matchedOrder,
-                       orderExecutionType);
+                       orderExecutionType, orderInfo.timestamp);
     TradeInfo askTrade(matchedOrder->GetOrderId(), matchedOrder->GetOrderType(),
-                       matchedOrder->GetClientRef(), Side::Sell,
+                       matchedInfo.clientRef, Side::Sell,
                        matchedOrder->GetPrice(), filledQuantity, *order,
-                       matchedOrderExecutionType);
+                       matchedOrderExecutionType, 0);
     Trade trade(askTrade, bidTrade);
-    tradeDispatcher_.PushTradeInfo(std::move(trade));
+    tradeBatch_.Add(std::move(trade));
   } else {
     TradeInfo bidTrade(matchedOrder->GetOrderId(), matchedOrder->GetOrderType(),
-                       matchedOrder->GetClientRef(), Side::Buy,
+                       matchedInfo.clientRef, Side::Buy,
                        matchedOrder->GetPrice(), filledQuantity, *order,
-                       matchedOrderExecutionType);
+                       matchedOrderExecutionType, 0);
     TradeInfo askTrade(order->GetOrderId(), order->GetOrderType(),
-                       order->GetClientRef(), Side::Sell,
+                       orderInfo.clientRef, Side::Sell,
                        matchedOrder->GetPrice(), filledQuantity, *matchedOrder,
-                       orderExecutionType);
+                       orderExecutionType, orderInfo.timestamp);
     Trade trade(askTrade, bidTrade);
-    tradeDispatcher_.PushTradeInfo(std::move(trade));
+    tradeBatch_.Add(std::move(trade));
   }
 
   if (matchedOrder->isFilled()) {
@@ -258,6 +386,170 @@ void Orderbook::FillOrder(Order *order, std::uint64_t index) {
   }
 }
 
+void Orderbook::AckOrder(const Order *order) {
+  const OrderInfo &info = *orderPool_->get_info(order->GetIndex());
+  tradeBatch_.Add(TradeInfo(order->GetOrderId(), order->GetOrderType(),
+                            info.clientRef, order->GetSide(), order->GetPrice(),
+                            order->GetRemainingQuantity(), *order,
+                            ExecutionType::ACK, info.timestamp));
+}
+
+void Orderbook::RejectOrder(Order *order) {
+  const OrderInfo &info = *orderPool_->get_info(order->GetIndex());
+  TradeInfo rejected(order->GetOrderId(), order->GetOrderType(),
+                     info.clientRef, order->GetSide(), order->GetPrice(),
+                     order->GetRemainingQuantity(), *order,
+                     ExecutionType::REJECT, info.timestamp);
+  TradeInfo none(order->GetOrderId(), OrderType::CANCEL, info.clientRef,
+                 order->GetSide() == Side::Buy ? Side::Sell : Side::Buy, 110,
+                 0, *order, ExecutionType::INVALID, 0);
+  if (order->GetSide() == Side::Buy) {
+    tradeBatch_.Add(Trade(none, rejected));
+  } else {
+    tradeBatch_.Add(Trade(rejected, none));
+  }
+}
+
+// Hands every report produced by the current incoming order to the dispatcher
+void Orderbook::DispatchTrades() {
+  if (tradeBatch_.empty()) {
+    return;
+  }
+  tradeDispatcher_.PushTradeBatch(tradeBatch_);
+  tradeBatch_.clear();
+}
+
+void Orderbook::AttachMarketDataFeed(MarketDataFeed *marketDataFeed) {
+  marketDataFeed_ = marketDataFeed;
+}
+
+void Orderbook::AttachTape(TapeWriter *tape) { tape_ = tape; }
+
+void Orderbook::AttachLedger(Ledger *ledger) { ledger_ = ledger; }
+
+void Orderbook::PublishTape(std::uint64_t seq) {
+  if (tape_) {
+    tape_->Publish(seq);
+  }
+}
+
+void Orderbook::LinkClientOrder(PoolIndex poolIndex, OrderInfo &info) {
+  if (info.clientRef >= clientOrders_.size()) {
+    clientOrders_.resize(info.clientRef + 1, INVALID_POOL_INDEX);
+  }
+  PoolIndex &head = clientOrders_[info.clientRef];
+  info.clientPrev = INVALID_POOL_INDEX;
+  info.clientNext = head;
+  if (head != INVALID_POOL_INDEX) {
+    orderPool_->get_info(head)->clientPrev = poolIndex;
+  }
+  head = poolIndex;
+}
+
+void Orderbook::UnlinkClientOrder(OrderInfo &info) {
+  if (info.clientPrev != INVALID_POOL_INDEX) {
+    orderPool_->get_info(info.clientPrev)->clientNext = info.clientNext;
+  } else {
+    clientOrders_[info.clientRef] = info.clientNext;
+  }
+  if (info.clientNext != INVALID_POOL_INDEX) {
+    orderPool_->get_info(info.clientNext)->clientPrev = info.clientPrev;
+  }
+}
+
+void Orderbook::RecordLevel(Side side, uint64_t index, MarketDataType type) {
+  if (!marketDataFeed_) {
+    return;
+  }
+  const auto &priceLevel = (side == Side::Buy) ? bids_[index] : asks_[index];
+  marketDataBatch_.Add(type, side, static_cast<std::uint32_t>(index),
+                       IndexToPrice(index), priceLevel.quantity_);
+}
+
+void Orderbook::PublishMarketData(std::uint64_t seq) {
+  if (!marketDataFeed_) {
+    return;
+  }
+  if (!marketDataBatch_.empty()) {
+    marketDataFeed_->Publish(marketDataBatch_, seq);
+    marketDataBatch_.clear();
+  }
+  if (marketDataFeed_->ResyncPending()) {
+    PublishBookImage(seq);
+  }
+}
+
+// Every resting level as it stands after order seq, for subscribers that
+// were dropped and have asked to resync
+void Orderbook::PublishBookImage(std::uint64_t seq) {
+  for (const Side side : {Side::Buy, Side::Sell}) {
+    const uint64_t *bitmap = side == Side::Buy ? bids_bitmap_ : asks_bitmap_;
+    const auto &levels = side == Side::Buy ? bids_ : asks_;
+    for (uint64_t word = 0; word < BITMAP_SIZE; ++word) {
+      for (uint64_t present = bitmap[word]; present != 0;
+           present &= present - 1) {
+        const uint64_t index = word * 64 + __builtin_ctzll(present);
+        marketDataBatch_.Add(MarketDataType::SNAPSHOT, side,
+                             static_cast<std::uint32_t>(index),
+                             IndexToPrice(index), levels[index].quantity_);
+      }
+    }
+  }
+  if (marketDataBatch_.empty()) {
+    marketDataBatch_.Add(MarketDataType::SNAPSHOT, Side::Buy, 0,
+                         IndexToPrice(0), 0);
+  }
+  marketDataFeed_->PublishSnapshot(marketDataBatch_, seq);
+  marketDataBatch_.clear();
+}
+
+Quantity Orderbook::GetLevelQuantity(Side side, uint64_t index) const {
+  return side == Side::Buy ? bids_[index].quantity_ : asks_[index].quantity_;
+}
+
+Quantity Orderbook::GetFillQuantity(const Order *order, uint64_t index) const {
+  const auto &matchedPriceLevel =
+      (order->GetSide() == Side::Buy) ? asks_[index] : bids_[index];
+  const Order *matchedOrder = orderPool_->get_order(matchedPriceLevel.head_);
+  return std::min(matchedOrder->GetRemainingQuantity(),
+                  order->GetRemainingQuantity());
+}
+
+void Orderbook::PublishTopOfBook(std::uint64_t seq) {
+  TopOfBook top{};
+  if (bestBidIndex_ != INVALID_PRICE_LEVEL_INDEX) {
+    top.bid = IndexToPrice(bestBidIndex_);
+    top.bidSize = bids_[bestBidIndex_].quantity_;
+  }
+  if (bestAskIndex_ != INVALID_PRICE_LEVEL_INDEX) {
+    top.ask = IndexToPrice(bestAskIndex_);
+    top.askSize = asks_[bestAskIndex_].quantity_;
+  }
+  top.lastTradePrice = lastTradePrice_;
+  top.lastTradeQuantity = lastTradeQuantity_;
+
+  // Trades are already on the trade tape, only quote changes are taped here
+  if (tape_ && (top.bid != publishedTop_.bid || top.ask != publishedTop_.ask ||
+                top.bidSize != publishedTop_.bidSize ||
+                top.askSize != publishedTop_.askSize)) {
+    tape_->AddTop(top.bid, top.ask, top.bidSize, top.askSize);
+  }
+  // Most orders leave the top alone, skip the write so readers' cached copy
+  // of the line stays valid
+  if (top.bid != publishedTop_.bid || top.ask != publishedTop_.ask ||
+      top.bidSize != publishedTop_.bidSize ||
+      top.askSize != publishedTop_.askSize ||
+      top.lastTradePrice != publishedTop_.lastTradePrice ||
+      top.lastTradeQuantity != publishedTop_.lastTradeQuantity) {
+    top.seq = seq;
+    publishedTop_ = top;
+    topOfBook_.Store(top);
+  }
+  // After the top, so a reader that sees these indicators can also see the
+  // top they carry the seq of
+  indicators_.OnTop(publishedTop_, seq);
+}
+
 void Orderbook::PrintBook() {
   std::cout << "\n====== ASKS ======\n";
   for (size_t level = MAX_PRICE_LEVELS; level > 0; --level) {
@@ -0,0 +1,278 @@
+#include "PerfCounters.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#if defined(PERF_COUNTERS) && defined(__linux__)
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr const char *EVENT_NAMES[N_PERF_EVENTS] = {
+    "Cycles",        "Instructions", "L1D misses",    "LLC misses",
+    "Branch misses", "dTLB misses",  "Page faults",   "Context switches",
+};
+
+// Fixed so a thread filing its report never allocates, later threads past
+// the capacity go unreported
+constexpr std::size_t MAX_THREAD_REPORTS = 64;
+
+std::mutex threadReportMutex;
+std::array<std::pair<std::string_view, PerfSample>, MAX_THREAD_REPORTS>
+    threadReports;
+std::size_t nThreadReports = 0;
+
+#if defined(PERF_COUNTERS) && defined(__linux__)
+
+struct EventConfig {
+  std::uint32_t type;
+  std::uint64_t config;
+};
+
+constexpr std::uint64_t CacheConfig(std::uint64_t cache, std::uint64_t op,
+                                    std::uint64_t result) {
+  return cache | (op << 8) | (result << 16);
+}
+
+constexpr EventConfig EVENT_CONFIGS[N_PERF_EVENTS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE,
+     CacheConfig(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ,
+                 PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_HW_CACHE,
+     CacheConfig(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ,
+                 PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+};
+
+int OpenEvent(const EventConfig &event, bool inherit) {
+  perf_event_attr attr;
+  std::memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = event.type;
+  attr.config = event.config;
+  attr.disabled = 1;
+  attr.inherit = inherit ? 1 : 0;
+  // Software events such as context switches only ever happen in the kernel
+  attr.exclude_kernel = event.type == PERF_TYPE_SOFTWARE ? 0 : 1;
+  attr.exclude_hv = 1;
+  attr.read_format =
+      PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return static_cast<int>(
+      ::syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+#endif
+
+} // namespace
+
+bool PerfSample::empty() const {
+  for (bool v : valid) {
+    if (v) {
+      return false;
+    }
+  }
+  return true;
+}
+
+#if defined(PERF_COUNTERS) && defined(__linux__)
+
+PerfCounters::PerfCounters(bool inherit) {
+  for (std::size_t i = 0; i < N_PERF_EVENTS; ++i) {
+    fds_[i] = OpenEvent(EVENT_CONFIGS[i], inherit);
+  }
+}
+
+PerfCounters::~PerfCounters() {
+  for (int fd : fds_) {
+    if (fd >= 0) {
+      ::close(fd);
+    }
+  }
+}
+
+void PerfCounters::Start() {
+  for (int fd : fds_) {
+    if (fd >= 0) {
+      ::ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+      ::ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+}
+
+void PerfCounters::Stop() {
+  for (int fd : fds_) {
+    if (fd >= 0) {
+      ::ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    }
+  }
+}
+
+PerfSample PerfCounters::Read() const {
+  PerfSample sample;
+  for (std::size_t i = 0; i < N_PERF_EVENTS; ++i) {
+    std::uint64_t data[3]; // value, time enabled, time running
+    if (fds_[i] < 0 || ::read(fds_[i], data, sizeof(data)) != sizeof(data)) {
+      continue;
+    }
+    sample.valid[i] = true;
+    sample.values[i] =
+        (data[2] > 0 && data[2] < data[1])
+            ? static_cast<std::uint64_t>(static_cast<double>(data[0]) *
+                                         data[1] / data[2])
+            : data[0];
+  }
+  return sample;
+}
+
+#else
+
+PerfCounters::PerfCounters(bool) { fds_.fill(-1); }
+PerfCounters::~PerfCounters() {}
+void PerfCounters::Start() {}
+void PerfCounters::Stop() {}
+PerfSample PerfCounters::Read() const { return PerfSample{}; }
+
+#endif
+
+ThreadPerfCounters::ThreadPerfCounters(std::string_view name) : name_(name) {
+  counters_.Start();
+}
+
+ThreadPerfCounters::~ThreadPerfCounters() {
+  counters_.Stop();
+  PerfSample sample = counters_.Read();
+  if (sample.empty()) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(threadReportMutex);
+  if (nThreadReports < threadReports.size()) {
+    threadReports[nThreadReports++] = {name_, sample};
+  }
+}
+
+void PrintPerfReport(std::string_view phase, const PerfSample &sample,
+                     std::uint64_t nOperations) {
+  if constexpr (!PERF_COUNTERS_ENABLED) {
+    return;
+  }
+  std::cout << "+---------------------------------------+" << std::endl;
+  std::cout << "| Counters per operation: " << phase << std::endl;
+  if (sample.empty()) {
+    std::cout << "|   Hardware counters unavailable" << std::endl;
+    std::cout << "+---------------------------------------+" << std::endl;
+    return;
+  }
+  const double ops = nOperations ? static_cast<double>(nOperations) : 1.0;
+  for (std::size_t i = 0; i < N_PERF_EVENTS; ++i) {
+    std::cout << "|   " << std::left << std::setw(18)
+              << (std::string(EVENT_NAMES[i]) + ":") << std::right;
+    if (sample.valid[i]) {
+      std::cout << std::setw(12) << std::fixed << std::setprecision(3)
+                << static_cast<double>(sample.values[i]) / ops;
+    } else {
+      std::cout << std::setw(12) << "n/a";
+    }
+    std::cout << std::endl;
+  }
+  std::cout << "|   " << std::left << std::setw(18) << "IPC:" << std::right
+            << std::setw(12);
+  if (sample.Has(PerfEvent::CYCLES) && sample.Has(PerfEvent::INSTRUCTIONS) &&
+      sample.Get(PerfEvent::CYCLES) > 0) {
+    std::cout << std::fixed << std::setprecision(3)
+              << static_cast<double>(sample.Get(PerfEvent::INSTRUCTIONS)) /
+                     static_cast<double>(sample.Get(PerfEvent::CYCLES));
+  } else {
+    std::cout << "n/a";
+  }
+  std::cout << std::endl;
+  std::cout << "+---------------------------------------+" << std::endl;
+  std::cout << std::defaultfloat << std::setprecision(6);
+}
+
+void PrintThreadPerfReport() {
+  if constexpr (!PERF_COUNTERS_ENABLED) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(threadReportMutex);
+  std::cout << "+----------------------------------------------------------+\n";
+  std::cout << "| Thread Counters (misses per 1k instructions)             |\n";
+  std::cout << "+----------------------------------------------------------+\n";
+  if (nThreadReports == 0) {
+    std::cout << "Hardware counters unavailable\n";
+    return;
+  }
+  std::cout << std::left << std::setw(20) << "Thread" << std::right
+            << std::setw(14) << "Instructions" << std::setw(7) << "IPC"
+            << std::setw(8) << "L1D" << std::setw(8) << "LLC"
+            << std::setw(8) << "Branch" << std::setw(8) << "dTLB"
+            << std::setw(8) << "Faults" << std::setw(9) << "Switches"
+            << '\n';
+  auto cell = [](const PerfSample &sample, PerfEvent event, double scale,
+                 int width) {
+    if (sample.Has(event)) {
+      std::cout << std::setw(width)
+                << static_cast<double>(sample.Get(event)) * scale;
+    } else {
+      std::cout << std::setw(width) << "-";
+    }
+  };
+  std::cout << std::fixed << std::setprecision(2);
+  for (std::size_t i = 0; i < nThreadReports; ++i) {
+    const auto &[name, sample] = threadReports[i];
+    const bool hasInstructions = sample.Has(PerfEvent::INSTRUCTIONS) &&
+                                 sample.Get(PerfEvent::INSTRUCTIONS) > 0;
+    const double perKilo =
+        hasInstructions
+            ? 1000.0 / static_cast<double>(sample.Get(PerfEvent::INSTRUCTIONS))
+            : 0.0;
+    std::cout << std::left << std::setw(20) << name << std::right;
+    if (hasInstructions) {
+      std::cout << std::setw(14) << sample.Get(PerfEvent::INSTRUCTIONS);
+    } else {
+      std::cout << std::setw(14) << "-";
+    }
+    if (hasInstructions && sample.Has(PerfEvent::CYCLES) &&
+        sample.Get(PerfEvent::CYCLES) > 0) {
+      std::cout << std::setw(7)
+                << static_cast<double>(sample.Get(PerfEvent::INSTRUCTIONS)) /
+                       static_cast<double>(sample.Get(PerfEvent::CYCLES));
+    } else {
+      std::cout << std::setw(7) << "-";
+    }
+    for (PerfEvent event : {PerfEvent::L1D_MISSES, PerfEvent::LLC_MISSES,
+                            PerfEvent::BRANCH_MISSES,
+                            PerfEvent::DTLB_MISSES}) {
+      if (hasInstructions) {
+        cell(sample, event, perKilo, 8);
+      } else {
+        std::cout << std::setw(8) << "-";
+      }
+    }
+    std::cout << std::setprecision(0);
+    cell(sample, PerfEvent::PAGE_FAULTS, 1.0, 8);
+    cell(sample, PerfEvent::CONTEXT_SWITCHES, 1.0, 9);
+    std::cout << std::setprecision(2) << '\n';
+  }
+  std::cout << std::defaultfloat << std::setprecision(6);
+}
+
+void ResetThreadPerfReports() {
+  std::lock_guard<std::mutex> lock(threadReportMutex);
+  nThreadReports = 0;
+}
@@ -0,0 +1,287 @@
+#include "Tape.h"
+#include "MappedFile.h"
+#include "Order.h"
+#include "PerfCounters.h"
+#include "ThreadPlacement.h"
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace {
+
+constexpr std::size_t TRADE_COLUMNS = 6; // seq price quantity side buyer seller
+constexpr std::size_t TOP_COLUMNS = 5;   // seq bid ask bidSize askSize
+
+struct TapeFileHeader {
+  std::uint64_t magic;
+  std::uint32_t version;
+  std::uint32_t reserved;
+};
+
+struct TapeBlockHeader {
+  std::uint8_t type; // TapeEventType
+  std::uint8_t reserved[3];
+  std::uint32_t rows;
+  std::uint32_t bytes; // Encoded columns following the header
+};
+
+std::int64_t ToCents(Price price) { return std::llround(price * 100.0); }
+
+void PutVarint(std::vector<std::uint8_t> &out, std::uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<std::uint8_t>(value) | 0x80);
+    value >>= 7;
+  }
+  out.push_back(static_cast<std::uint8_t>(value));
+}
+
+std::uint64_t GetVarint(const std::uint8_t *&p, const std::uint8_t *end) {
+  std::uint64_t value = 0;
+  for (unsigned shift = 0; p < end && shift < 64; shift += 7) {
+    const std::uint8_t byte = *p++;
+    value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return value;
+    }
+  }
+  throw std::runtime_error("Truncated tape block");
+}
+
+std::uint64_t ZigZag(std::int64_t value) {
+  return (static_cast<std::uint64_t>(value) << 1) ^
+         static_cast<std::uint64_t>(value >> 63);
+}
+
+std::int64_t UnZigZag(std::uint64_t value) {
+  return static_cast<std::int64_t>(value >> 1) ^
+         -static_cast<std::int64_t>(value & 1);
+}
+
+// Trade quantity and side don't trend so they are stored as they are
+bool IsDeltaColumn(TapeEventType type, std::size_t column) {
+  return type == TapeEventType::TOP || (column != 2 && column != 3);
+}
+
+} // namespace
+
+TapeWriter::TapeWriter(const std::string &path)
+    : queue_(std::make_unique<RingBuffer<TapeEvent, TAPE_BUFFER_SIZE>>()) {
+  file_ = std::fopen(path.c_str(), "wb");
+  if (!file_) {
+    throw std::runtime_error("Could not open tape " + path);
+  }
+  const TapeFileHeader header{TAPE_MAGIC, TAPE_VERSION, 0};
+  if (std::fwrite(&header, sizeof(header), 1, file_) != 1) {
+    std::fclose(file_);
+    throw std::runtime_error("Could not write tape " + path);
+  }
+  pending_.reserve(64);
+  for (auto &column : trades_.values) {
+    column.reserve(TAPE_BLOCK_EVENTS);
+  }
+  for (auto &column : tops_.values) {
+    column.reserve(TAPE_BLOCK_EVENTS);
+  }
+  running_ = true;
+  writer_ = std::thread(&TapeWriter::RunWriter, this);
+}
+
+TapeWriter::~TapeWriter() { Close(); }
+
+void TapeWriter::AddTrade(Price price, Quantity quantity, Side side,
+                          ClientRef buyer, ClientRef seller) {
+  pending_.push_back(TapeEvent{0, TapeEventType::TRADE, side, price, 0,
+                               quantity, 0, buyer, seller});
+}
+
+void TapeWriter::AddTop(Price bid, Price ask, Quantity bidSize,
+                        Quantity askSize) {
+  pending_.push_back(TapeEvent{0, TapeEventType::TOP, Side::Buy, bid, ask,
+                               bidSize, askSize, 0, 0});
+}
+
+void TapeWriter::Publish(std::uint64_t seq) {
+  if (pending_.empty()) {
+    return;
+  }
+  for (auto &event : pending_) {
+    event.seq = seq;
+  }
+  std::size_t pushed = queue_->Push(pending_.data(), pending_.size());
+  while (pushed < pending_.size()) {
+    // The writer has fallen a full queue behind
+    std::this_thread::yield();
+    pushed += queue_->Push(pending_.data() + pushed, pending_.size() - pushed);
+  }
+  pending_.clear();
+}
+
+void TapeWriter::RunWriter() {
+  PinThread(PipelineRole::IO);
+  ThreadPerfCounters counters("Tape writer");
+  TapeEvent event;
+  while (true) {
+    if (queue_->Pop(event)) {
+      Append(event);
+    } else if (running_.load(std::memory_order_acquire)) {
+      std::this_thread::yield();
+    } else if (queue_->empty()) {
+      break;
+    }
+  }
+  WriteBlock(TapeEventType::TRADE, trades_, TRADE_COLUMNS);
+  WriteBlock(TapeEventType::TOP, tops_, TOP_COLUMNS);
+}
+
+void TapeWriter::Append(const TapeEvent &event) {
+  if (event.type == TapeEventType::TRADE) {
+    const std::int64_t row[TRADE_COLUMNS] = {
+        static_cast<std::int64_t>(event.seq),
+        ToCents(event.price),
+        event.quantity,
+        event.side == Side::Buy ? 0 : 1,
+        static_cast<std::int64_t>(event.buyer),
+        static_cast<std::int64_t>(event.seller)};
+    for (std::size_t c = 0; c < TRADE_COLUMNS; ++c) {
+      trades_.values[c].push_back(row[c]);
+    }
+    ++nTrades_;
+    if (++trades_.rows == TAPE_BLOCK_EVENTS) {
+      WriteBlock(TapeEventType::TRADE, trades_, TRADE_COLUMNS);
+    }
+  } else {
+    const std::int64_t row[TOP_COLUMNS] = {
+        static_cast<std::int64_t>(event.seq), ToCents(event.price),
+        ToCents(event.ask), event.quantity, event.askSize};
+    for (std::size_t c = 0; c < TOP_COLUMNS; ++c) {
+      tops_.values[c].push_back(row[c]);
+    }
+    ++nTops_;
+    if (++tops_.rows == TAPE_BLOCK_EVENTS) {
+      WriteBlock(TapeEventType::TOP, tops_, TOP_COLUMNS);
+    }
+  }
+}
+
+void TapeWriter::WriteBlock(TapeEventType type, Columns &columns,
+                            std::size_t nColumns) {
+  if (columns.rows == 0) {
+    return;
+  }
+  encoded_.clear();
+  for (std::size_t c = 0; c < nColumns; ++c) {
+    std::int64_t previous = 0;
+    for (std::int64_t value : columns.values[c]) {
+      if (IsDeltaColumn(type, c)) {
+        PutVarint(encoded_, ZigZag(value - previous));
+        previous = value;
+      } else {
+        PutVarint(encoded_, static_cast<std::uint64_t>(value));
+      }
+    }
+    columns.values[c].clear();
+  }
+  const TapeBlockHeader header{static_cast<std::uint8_t>(type),
+                               {},
+                               static_cast<std::uint32_t>(columns.rows),
+                               static_cast<std::uint32_t>(encoded_.size())};
+  if (!failed_ &&
+      (std::fwrite(&header, sizeof(header), 1, file_) != 1 ||
+       std::fwrite(encoded_.data(), 1, encoded_.size(), file_) !=
+           encoded_.size())) {
+    failed_ = true;
+  }
+  columns.rows = 0;
+}
+
+void TapeWriter::Close() {
+  if (!file_) {
+    return;
+  }
+  running_.store(false, std::memory_order_release);
+  if (writer_.joinable()) {
+    writer_.join();
+  }
+  if (std::fclose(file_) != 0) {
+    failed_ = true;
+  }
+  file_ = nullptr;
+}
+
+TapeReader::TapeReader(const std::string &path) : file_(path), path_(path) {
+  TapeFileHeader header;
+  if (file_.size() < sizeof(header)) {
+    throw std::runtime_error("Not a tape " + path);
+  }
+  std::memcpy(&header, file_.data(), sizeof(header));
+  if (header.magic != TAPE_MAGIC || header.version != TAPE_VERSION) {
+    throw std::runtime_error("Not a tape " + path);
+  }
+  firstBlock_ = sizeof(header);
+  for (auto &column : values_) {
+    column.resize(TAPE_BLOCK_EVENTS);
+  }
+  trades_.reserve(TAPE_BLOCK_EVENTS);
+  tops_.reserve(TAPE_BLOCK_EVENTS);
+}
+
+// Blocks of the other tape are stepped over by their header without being
+// decoded
+std::size_t TapeReader::NextBlock(TapeEventType type, std::size_t &offset) {
+  const auto *base = reinterpret_cast<const std::uint8_t *>(file_.data());
+  const std::uint8_t *end = base + file_.size();
+  while (offset + sizeof(TapeBlockHeader) <= file_.size()) {
+    TapeBlockHeader block;
+    std::memcpy(&block, base + offset, sizeof(block));
+    const std::uint8_t *p = base + offset + sizeof(block);
+    const std::uint8_t *blockEnd = p + block.bytes;
+    if (blockEnd > end || block.rows > TAPE_BLOCK_EVENTS) {
+      throw std::runtime_error("Truncated tape " + path_);
+    }
+    offset = static_cast<std::size_t>(blockEnd - base);
+    if (static_cast<TapeEventType>(block.type) != type || block.rows == 0) {
+      continue;
+    }
+    const std::size_t nColumns =
+        type == TapeEventType::TRADE ? TRADE_COLUMNS : TOP_COLUMNS;
+    for (std::size_t c = 0; c < nColumns; ++c) {
+      std::int64_t previous = 0;
+      for (std::uint32_t row = 0; row < block.rows; ++row) {
+        const std::uint64_t raw = GetVarint(p, blockEnd);
+        if (IsDeltaColumn(type, c)) {
+          previous += UnZigZag(raw);
+          values_[c][row] = previous;
+        } else {
+          values_[c][row] = static_cast<std::int64_t>(raw);
+        }
+      }
+    }
+    if (type == TapeEventType::TRADE) {
+      trades_.clear();
+      for (std::uint32_t row = 0; row < block.rows; ++row) {
+        trades_.push_back(TapeTrade{
+            static_cast<std::uint64_t>(values_[0][row]),
+            values_[1][row] / 100.0, static_cast<Quantity>(values_[2][row]),
+            values_[3][row] == 0 ? Side::Buy : Side::Sell,
+            static_cast<ClientRef>(values_[4][row]),
+            static_cast<ClientRef>(values_[5][row])});
+      }
+    } else {
+      tops_.clear();
+      for (std::uint32_t row = 0; row < block.rows; ++row) {
+        tops_.push_back(TapeTop{static_cast<std::uint64_t>(values_[0][row]),
+                                values_[1][row] / 100.0,
+                                values_[2][row] / 100.0,
+                                static_cast<Quantity>(values_[3][row]),
+                                static_cast<Quantity>(values_[4][row])});
+      }
+    }
+    return block.rows;
+  }
+  return 0;
+}
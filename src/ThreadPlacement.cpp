@@ -0,0 +1,343 @@
+#include "ThreadPlacement.h"
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <filesystem>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr const char *ROLE_KEYS[N_PIPELINE_ROLES] = {
+    "engine", "outgoing", "incoming", "demux", "workers", "io",
+};
+
+constexpr const char *ROLE_NAMES[N_PIPELINE_ROLES] = {
+    "Matching engine", "Agent outgoing", "Agent incoming",
+    "Trade demux",     "Agent worker",   "IO",
+};
+
+struct ThreadRecord {
+  PipelineRole role;
+  std::size_t index;
+  int core;
+  int runningOn;
+  bool honored;
+};
+
+struct MemoryRecord {
+  std::string name;
+  std::map<int, std::size_t> pagesPerNode;
+};
+
+// Written once before the pipeline starts, only read afterwards
+ThreadPlacement placement;
+
+std::mutex recordMutex;
+std::vector<ThreadRecord> threadRecords;
+std::vector<MemoryRecord> memoryRecords;
+
+// Parses a kernel style cpu list, "2", "10-13" or "2,4-5"
+bool ParseCpuList(std::string_view list, std::vector<int> &cpus) {
+  while (!list.empty()) {
+    const std::size_t comma = list.find(',');
+    const std::string_view range = list.substr(0, comma);
+    list = comma == std::string_view::npos ? std::string_view{}
+                                           : list.substr(comma + 1);
+    const std::size_t dash = range.find('-');
+    const std::string_view first = range.substr(0, dash);
+    const std::string_view last =
+        dash == std::string_view::npos ? first : range.substr(dash + 1);
+    int begin = 0;
+    int end = 0;
+    if (std::from_chars(first.data(), first.data() + first.size(), begin).ec !=
+            std::errc{} ||
+        std::from_chars(last.data(), last.data() + last.size(), end).ec !=
+            std::errc{} ||
+        begin < 0 || end < begin) {
+      return false;
+    }
+    for (int cpu = begin; cpu <= end; ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+  return true;
+}
+
+#if defined(__linux__)
+
+bool SetAffinity(const std::vector<int> &cpus) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (const int cpu : cpus) {
+    if (cpu >= CPU_SETSIZE) {
+      return false;
+    }
+    CPU_SET(cpu, &set);
+  }
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+std::vector<int> GetAffinity() {
+  std::vector<int> cpus;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &set)) {
+        cpus.push_back(cpu);
+      }
+    }
+  }
+  return cpus;
+}
+
+int CurrentCpu() { return sched_getcpu(); }
+
+int CoreNode(int cpu) {
+  std::error_code error;
+  const std::filesystem::path dir =
+      "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+  for (const auto &entry :
+       std::filesystem::directory_iterator(dir, error)) {
+    const std::string name = entry.path().filename().string();
+    int node = 0;
+    if (name.starts_with("node") &&
+        std::from_chars(name.data() + 4, name.data() + name.size(), node)
+                .ec == std::errc{}) {
+      return node;
+    }
+  }
+  return -1;
+}
+
+// move_pages without target nodes only reports where each page is, without
+// needing libnuma and without faulting in pages that were never touched
+std::map<int, std::size_t> PageNodes(const void *address, std::size_t bytes) {
+  std::map<int, std::size_t> pagesPerNode;
+  const std::uintptr_t pageSize =
+      static_cast<std::uintptr_t>(::sysconf(_SC_PAGESIZE));
+  const std::uintptr_t begin = reinterpret_cast<std::uintptr_t>(address);
+  const std::uintptr_t first = begin & ~(pageSize - 1);
+  const std::uintptr_t last =
+      (begin + std::max<std::size_t>(bytes, 1) - 1) & ~(pageSize - 1);
+  const std::size_t nPages = (last - first) / pageSize + 1;
+  const std::size_t nSamples = std::min(nPages, MEMORY_PLACEMENT_SAMPLES);
+  std::vector<void *> pages(nSamples);
+  for (std::size_t i = 0; i < nSamples; ++i) {
+    pages[i] = reinterpret_cast<void *>(first + i * nPages / nSamples *
+                                                    pageSize);
+  }
+  std::vector<int> status(nSamples, -1);
+  if (::syscall(SYS_move_pages, 0, nSamples, pages.data(), nullptr,
+                status.data(), 0) != 0) {
+    return pagesPerNode;
+  }
+  for (const int node : status) {
+    if (node >= 0) {
+      ++pagesPerNode[node];
+    }
+  }
+  return pagesPerNode;
+}
+
+std::vector<int> IsolatedCpus() {
+  std::ifstream file("/sys/devices/system/cpu/isolated");
+  std::string list;
+  std::getline(file, list);
+  std::vector<int> cpus;
+  if (!ParseCpuList(list, cpus)) {
+    cpus.clear();
+  }
+  return cpus;
+}
+
+#else
+
+bool SetAffinity(const std::vector<int> &) { return false; }
+std::vector<int> GetAffinity() { return {}; }
+int CurrentCpu() { return -1; }
+int CoreNode(int) { return -1; }
+std::map<int, std::size_t> PageNodes(const void *, std::size_t) {
+  return {};
+}
+std::vector<int> IsolatedCpus() { return {}; }
+
+#endif
+
+std::string NodeName(int node) {
+  return node < 0 ? "?" : std::to_string(node);
+}
+
+} // namespace
+
+bool ThreadPlacement::empty() const {
+  return std::all_of(cores.begin(), cores.end(),
+                     [](const auto &roleCores) { return roleCores.empty(); });
+}
+
+std::optional<ThreadPlacement> ParseThreadPlacement(std::string_view spec) {
+  ThreadPlacement parsed;
+  if (spec == "-") {
+    return parsed;
+  }
+  std::size_t role = N_PIPELINE_ROLES;
+  while (!spec.empty()) {
+    const std::size_t comma = spec.find(',');
+    std::string_view item = spec.substr(0, comma);
+    spec = comma == std::string_view::npos ? std::string_view{}
+                                           : spec.substr(comma + 1);
+    // Core lists use commas too, so an item without a role extends the
+    // previous role's list
+    const std::size_t colon = item.find(':');
+    if (colon != std::string_view::npos) {
+      const std::string_view key = item.substr(0, colon);
+      role = static_cast<std::size_t>(
+          std::find(ROLE_KEYS, ROLE_KEYS + N_PIPELINE_ROLES, key) - ROLE_KEYS);
+      item = item.substr(colon + 1);
+    }
+    if (role == N_PIPELINE_ROLES || item.empty() ||
+        !ParseCpuList(item, parsed.cores[role])) {
+      return std::nullopt;
+    }
+  }
+  return parsed;
+}
+
+void SetThreadPlacement(const ThreadPlacement &newPlacement) {
+  placement = newPlacement;
+}
+
+void PinThread(PipelineRole role, std::size_t index) {
+  const std::vector<int> &cores = placement.Get(role);
+  if (cores.empty()) {
+    return;
+  }
+  const int core = cores[index % cores.size()];
+  const bool pinned = SetAffinity({core});
+  const int runningOn = CurrentCpu();
+  const std::vector<int> affinity = GetAffinity();
+  const bool honored = pinned && runningOn == core && affinity.size() == 1 &&
+                       affinity.front() == core;
+  std::lock_guard<std::mutex> lock(recordMutex);
+  threadRecords.push_back(ThreadRecord{role, index, core, runningOn, honored});
+}
+
+FirstTouchPlacement::FirstTouchPlacement(PipelineRole role) {
+  const std::vector<int> &cores = placement.Get(role);
+  if (cores.empty()) {
+    return;
+  }
+  previous_ = GetAffinity();
+  pinned_ = SetAffinity({cores.front()});
+}
+
+FirstTouchPlacement::~FirstTouchPlacement() { Restore(); }
+
+void FirstTouchPlacement::Restore() {
+  if (pinned_ && !previous_.empty()) {
+    SetAffinity(previous_);
+  }
+  pinned_ = false;
+}
+
+void RecordMemoryPlacement(std::string_view name, const void *address,
+                           std::size_t bytes) {
+  if (placement.empty()) {
+    return;
+  }
+  std::map<int, std::size_t> pagesPerNode = PageNodes(address, bytes);
+  std::lock_guard<std::mutex> lock(recordMutex);
+  memoryRecords.push_back(
+      MemoryRecord{std::string(name), std::move(pagesPerNode)});
+}
+
+void PrintPlacementReport() {
+  if (placement.empty()) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(recordMutex);
+  const std::vector<int> isolated = IsolatedCpus();
+  const std::vector<int> &engineCores = placement.Get(PipelineRole::ENGINE);
+  const int engineNode =
+      engineCores.empty() ? -1 : CoreNode(engineCores.front());
+
+  std::cout << "+----------------------------------------------------------+\n";
+  std::cout << "| Thread Placement                                         |\n";
+  std::cout << "+----------------------------------------------------------+\n";
+  std::cout << std::left << std::setw(20) << "Thread" << std::right
+            << std::setw(7) << "Core" << std::setw(9) << "Running"
+            << std::setw(6) << "Node" << std::setw(10) << "Isolated"
+            << std::setw(9) << "Honored" << '\n';
+  std::map<int, std::size_t> threadsPerCore;
+  for (const ThreadRecord &record : threadRecords) {
+    std::ostringstream name;
+    name << ROLE_NAMES[static_cast<std::size_t>(record.role)];
+    if (record.role == PipelineRole::DEMUX ||
+        record.role == PipelineRole::WORKERS) {
+      name << ' ' << record.index;
+    }
+    const bool isIsolated =
+        std::find(isolated.begin(), isolated.end(), record.core) !=
+        isolated.end();
+    std::cout << std::left << std::setw(20) << name.str() << std::right
+              << std::setw(7) << record.core << std::setw(9)
+              << record.runningOn << std::setw(6)
+              << NodeName(CoreNode(record.core)) << std::setw(10)
+              << (isIsolated ? "yes" : "no") << std::setw(9)
+              << (record.honored ? "yes" : "NO") << '\n';
+    ++threadsPerCore[record.core];
+  }
+  // A structure split across nodes lists each of them, and is only local
+  // when every sampled page is
+  for (const MemoryRecord &record : memoryRecords) {
+    std::string nodes;
+    for (const auto &[node, pages] : record.pagesPerNode) {
+      if (!nodes.empty()) {
+        nodes += '+';
+      }
+      nodes += NodeName(node);
+    }
+    const bool known = engineNode >= 0 && !record.pagesPerNode.empty();
+    const bool local = known && record.pagesPerNode.size() == 1 &&
+                       record.pagesPerNode.begin()->first == engineNode;
+    std::cout << std::left << std::setw(20) << record.name << std::right
+              << std::setw(7) << "-" << std::setw(9) << "-" << std::setw(6)
+              << (nodes.empty() ? "?" : nodes) << std::setw(10) << "-"
+              << std::setw(9)
+              << (!known ? "?" : local ? "yes" : "NO") << '\n';
+  }
+  std::ostringstream shared;
+  for (const auto &[core, count] : threadsPerCore) {
+    if (count > 1) {
+      shared << ' ' << core;
+    }
+  }
+  if (!shared.str().empty()) {
+    std::cout << "Cores running more than one pipeline thread:"
+              << shared.str() << '\n';
+  }
+  std::cout << '\n';
+}
+
+void ResetPlacementRecords() {
+  std::lock_guard<std::mutex> lock(recordMutex);
+  threadRecords.clear();
+  memoryRecords.clear();
+}
@@ -1,22 +1,230 @@
 #include "TradeDispatcher.h"
-#include "Agent.h"
+#include "PerfCounters.h"
+#include "ThreadPlacement.h"
 #include "Trade.h"
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <utility>
 
-void TradeDispatcher::Attach(Agent *agent) {
-  clients_[agent->GetClientRef()] = agent;
+TradeDispatcher::TradeDispatcher(std::size_t nDemuxThreads)
+    : outbound_(std::make_unique<
+                BroadcastRingBuffer<TradeInfo, OUTBOUND_BUFFER_SIZE>>(
+          nDemuxThreads)),
+      partitions_(nDemuxThreads) {
+  for (auto &partition : partitions_) {
+    partition.scratch_.resize(DEMUX_BATCH_SIZE);
+    partition.returns_ =
+        std::make_unique<RingBuffer<MailboxReturn, MAILBOX_RETURN_SIZE>>();
+  }
+  // Until Start() splits the clients up the first partition owns everyone
+  partitions_[0].end_ = std::numeric_limits<ClientRef>::max();
+}
+
+TradeDispatcher::~TradeDispatcher() {
+  if (running_) {
+    Stop();
+  }
+}
+
+void TradeDispatcher::Attach(ClientRef clientRef) {
+  while (mailboxes_.size() <= clientRef) {
+    mailboxes_.emplace_back(nullptr);
+  }
+  if (clientRef >= attached_.size()) {
+    attached_.resize(clientRef + 1);
+  }
+  attached_[clientRef] = 1;
+}
+
+// Called by the partition owning the client the first time it is sent a
+// report, reusing a released mailbox if there is one
+Mailbox *TradeDispatcher::AcquireMailbox(Partition &part,
+                                         ClientRef clientRef) {
+  if (clientRef >= attached_.size() || !attached_[clientRef]) {
+    return nullptr;
+  }
+  Mailbox *mailbox = nullptr;
+  if (!part.free_.empty()) {
+    mailbox = part.free_.back();
+    part.free_.pop_back();
+  } else {
+    part.owned_.push_back(std::make_unique<Mailbox>());
+    mailbox = part.owned_.back().get();
+  }
+  mailboxes_[clientRef].store(mailbox, std::memory_order_release);
+  return mailbox;
+}
+
+TradeDispatcher::Partition &TradeDispatcher::PartitionOf(ClientRef clientRef) {
+  for (auto &part : partitions_) {
+    if (clientRef >= part.begin_ && clientRef < part.end_) {
+      return part;
+    }
+  }
+  return partitions_.back();
+}
+
+void TradeDispatcher::ReleaseMailbox(ClientRef clientRef) {
+  Mailbox *mailbox = GetMailbox(clientRef);
+  if (!mailbox || !mailbox->empty()) {
+    return;
+  }
+  Partition &part = PartitionOf(clientRef);
+  if (!queueReturns_) {
+    mailboxes_[clientRef].store(nullptr, std::memory_order_relaxed);
+    part.free_.push_back(mailbox);
+    return;
+  }
+  // Queued before the pointer is cleared, so a demultiplexer that finds the
+  // pointer cleared also finds the return. A full queue keeps the mailbox.
+  if (part.returns_->Push(MailboxReturn{clientRef, mailbox})) {
+    mailboxes_[clientRef].store(nullptr, std::memory_order_release);
+  }
+}
+
+// Demultiplexer only. A report delivered after the client found its mailbox
+// empty but before it cleared the pointer is still in the mailbox, which
+// then goes straight back to the client instead of being reused.
+void TradeDispatcher::TakeReturns(Partition &part) {
+  MailboxReturn returned;
+  while (part.returns_->Pop(returned)) {
+    std::atomic<Mailbox *> &slot = mailboxes_[returned.clientRef];
+    while (slot.load(std::memory_order_acquire) == returned.mailbox) {
+      std::this_thread::yield();
+    }
+    if (returned.mailbox->empty()) {
+      part.free_.push_back(returned.mailbox);
+    } else {
+      slot.store(returned.mailbox, std::memory_order_release);
+    }
+  }
 }
 
-void TradeDispatcher::Detach(Agent *agent) {
-  clients_.erase(agent->GetClientRef());
+std::size_t TradeDispatcher::GetNMailboxes() const {
+  std::size_t n = 0;
+  for (const auto &part : partitions_) {
+    n += part.owned_.size();
+  }
+  return n;
+}
+
+// Called from the matching thread, the only work done here is a sequential
+// copy into the outbound stream
+void TradeDispatcher::PushTradeBatch(TradeBatch &batch) {
+  std::size_t pushed = outbound_->Push(batch.data(), batch.size());
+  while (pushed < batch.size()) {
+    // Demultiplexers have fallen a full stream behind
+    std::this_thread::yield();
+    pushed += outbound_->Push(batch.data() + pushed, batch.size() - pushed);
+  }
+}
+
+void TradeDispatcher::Start() {
+  const std::size_t nPartitions = partitions_.size();
+  const ClientRef width = (mailboxes_.size() + nPartitions - 1) / nPartitions;
+  for (std::size_t i = 0; i < nPartitions; ++i) {
+    partitions_[i].begin_ = i * width;
+    partitions_[i].end_ = (i + 1 == nPartitions)
+                              ? std::numeric_limits<ClientRef>::max()
+                              : (i + 1) * width;
+  }
+
+  queueReturns_ = true;
+  running_ = true;
+  for (std::size_t i = 0; i < nPartitions; ++i) {
+    demuxThreads_.emplace_back(&TradeDispatcher::RunDemux, this, i);
+  }
 }
 
-void TradeDispatcher::PushTradeInfo(Trade &&trade) {
-  TradeInfo askTrade = trade.GetAskTrade();
-  TradeInfo bidTrade = trade.GetBidTrade();
-  if (askTrade.orderType != OrderType::CANCEL) {
-    clients_[askTrade.clientRef]->PushTrade(std::move(askTrade));
+// Waits for every demultiplexer to catch up with the stream before stopping,
+// so must be called once the matching engine has stopped
+void TradeDispatcher::Stop() {
+  while (!outbound_->empty()) {
   }
-  if (bidTrade.orderType != OrderType::CANCEL) {
-    clients_[bidTrade.clientRef]->PushTrade(std::move(bidTrade));
+  running_ = false;
+  for (auto &thread : demuxThreads_) {
+    if (thread.joinable()) {
+      thread.join();
+    }
+  }
+  demuxThreads_.clear();
+  // Returns queued while the demultiplexers were stopping. Clients may still
+  // be reading their mailboxes, so later returns keep being queued.
+  for (auto &part : partitions_) {
+    TakeReturns(part);
+  }
+}
+
+void TradeDispatcher::RunDemux(std::size_t partition) {
+  PinThread(PipelineRole::DEMUX, partition);
+  ThreadPerfCounters counters("Trade demux");
+  while (running_) {
+    Drain(partition);
+  }
+  while (Drain(partition) > 0) {
+  }
+}
+
+// Delivers up to DEMUX_BATCH_SIZE reports owned by this partition, grouped by
+// client so each agent's mailbox sees one bulk push
+std::size_t TradeDispatcher::Drain(std::size_t partition,
+                                   std::vector<ClientRef> *delivered) {
+  Partition &part = partitions_[partition];
+  TakeReturns(part);
+  auto &reports = part.scratch_;
+  const std::size_t popped =
+      outbound_->Pop(partition, reports.data(), DEMUX_BATCH_SIZE);
+
+  std::size_t n = 0;
+  for (std::size_t i = 0; i < popped; ++i) {
+    const ClientRef clientRef = reports[i].clientRef;
+    if (clientRef < part.begin_ || clientRef >= part.end_) {
+      continue;
+    }
+    // Stable insertion sort by client keeps each agent's reports in
+    // execution order
+    TradeInfo tradeInfo = std::move(reports[i]);
+    std::size_t j = n;
+    while (j > 0 && reports[j - 1].clientRef > clientRef) {
+      reports[j] = std::move(reports[j - 1]);
+      --j;
+    }
+    reports[j] = std::move(tradeInfo);
+    ++n;
+  }
+
+  std::size_t begin = 0;
+  while (begin < n) {
+    const ClientRef clientRef = reports[begin].clientRef;
+    std::size_t end = begin + 1;
+    while (end < n && reports[end].clientRef == clientRef) {
+      ++end;
+    }
+    Mailbox *mailbox = GetMailbox(clientRef);
+    if (!mailbox) {
+      // The client may have only just handed it back
+      TakeReturns(part);
+      mailbox = GetMailbox(clientRef);
+    }
+    if (!mailbox) {
+      mailbox = AcquireMailbox(part, clientRef);
+    }
+    if (mailbox) {
+      mailbox->Push(reports.data() + begin, end - begin);
+      if (delivered) {
+        delivered->push_back(clientRef);
+      }
+    }
+    begin = end;
+  }
+  return popped;
+}
+
+void TradeDispatcher::DrainAll(std::vector<ClientRef> *delivered) {
+  // Every partition reads the whole stream, it only empties once all have
+  for (std::size_t i = 0; i < partitions_.size(); ++i) {
+    while (Drain(i, delivered) > 0) {
+    }
   }
 }
@@ -1,14 +1,19 @@
 #include "Agent.h"
 #include "AgentManager.h"
 #include "AgentStrategy.h"
-#include "AgentStrategyFactory.h"
+#include "LatencyProbes.h"
 #include "OrderPool.h"
+#include "OrderJournal.h"
 #include "Orderbook.h"
+#include "PerfCounters.h"
+#include "Tape.h"
+#include "ThreadPlacement.h"
 #include "TradeDispatcher.h"
 
 #include <cstddef>
 #include <cstdint>
 #include <memory>
+#include <string>
 #include <thread>
 
 int main() {
@@ -85,50 +90,153 @@ int main() {
     }
   }
 
+  int steppingMode;
+  double timeSlice{0};
+  std::size_t nAgentThreads{1};
+  while (true) {
+    std::cout << "Enter the agent stepping mode (0: serial, 1: "
+                 "batch-synchronous, 2: lockstep): ";
+    std::cin >> steppingMode;
+    if (steppingMode == 1) {
+      std::cout << "Enter the time slice agents will be batched over (time "
+                   "units): ";
+      std::cin >> timeSlice;
+      std::cout << "Enter how many threads agents will act on: ";
+      std::cin >> nAgentThreads;
+    }
+    std::cout << '\n';
+    if (steppingMode == 0 || steppingMode == 2 ||
+        (steppingMode == 1 && timeSlice > 0 && nAgentThreads > 0)) {
+      break;
+    } else {
+      std::cout << "Stepping mode must be 0, 1 or 2. Batch parameters must be "
+                   "greater than 0"
+                << '\n';
+    }
+  }
+
+  std::uint64_t seed;
+  std::cout << "Enter the random seed for the run: ";
+  std::cin >> seed;
+  std::cout << '\n';
+
+  std::string journalPath;
+  std::cout << "Enter a file to journal the engine's orders to (- for none): ";
+  std::cin >> journalPath;
+  std::cout << '\n';
+
+  std::string tapePath;
+  std::cout << "Enter a file to write the trade and top of book tape to (- "
+               "for none): ";
+  std::cin >> tapePath;
+  std::cout << '\n';
+
+  while (true) {
+    std::string placementSpec;
+    std::cout << "Enter the cores to pin threads to, e.g. engine:2,outgoing:4,"
+                 "incoming:6,demux:8,workers:10-13,io:14 (- for none): ";
+    std::cin >> placementSpec;
+    std::cout << '\n';
+    if (auto placement = ParseThreadPlacement(placementSpec)) {
+      SetThreadPlacement(*placement);
+      break;
+    }
+    std::cout << "Thread placement must be role:cores pairs separated by "
+                 "commas"
+              << '\n';
+  }
+
+  // Built on the engine's core so the pool, book and engine ring are placed
+  // on its NUMA node
+  FirstTouchPlacement firstTouch(PipelineRole::ENGINE);
   TradeDispatcher tradeDispatcher;
   OrderPool orderPool;
   Orderbook orderbook(&orderPool, tradeDispatcher);
   MatchingEngine matchingEngine(orderbook, &orderPool);
-
-  AgentManager agentManager_(maxTime);
-
-  for (size_t i = 0; i < nRandom; ++i) {
-    agentManager_.AddAgent(std::make_unique<Agent>(
-        tradeDispatcher, matchingEngine, MakeStrategyRandom(&orderbook, &orderPool, sigma), i, randomRate));
+  firstTouch.Restore();
+  RecordMemoryPlacement("Order pool orders", orderPool.get_order(0),
+                        orderPool.capacity() * sizeof(Order));
+  RecordMemoryPlacement("Order pool infos", orderPool.get_info(0),
+                        orderPool.capacity() * sizeof(OrderInfo));
+  RecordMemoryPlacement("Orderbook memory", &orderbook, sizeof(orderbook));
+  RecordMemoryPlacement("Engine memory", &matchingEngine,
+                        sizeof(matchingEngine));
+  std::unique_ptr<OrderJournal> journal;
+  if (journalPath != "-") {
+    journal = std::make_unique<OrderJournal>(journalPath);
+    matchingEngine.AttachJournal(journal.get());
   }
-
-  for (size_t i = 0; i < nMarketMaker; ++i) {
-    agentManager_.AddAgent(
-        std::make_unique<Agent>(tradeDispatcher, matchingEngine, MakeStrategyMarketMaker(&orderbook, &orderPool, 0.02),
-                                i + nRandom, marketMakerRate));
+  std::unique_ptr<TapeWriter> tape;
+  if (tapePath != "-") {
+    tape = std::make_unique<TapeWriter>(tapePath);
+    orderbook.AttachTape(tape.get());
   }
 
-  for (size_t i = 0; i < nMomentumTrader; ++i) {
-    agentManager_.AddAgent(std::make_unique<Agent>(
-        tradeDispatcher, matchingEngine, MakeStrategyMomentumTrader(&orderbook, &orderPool, 0.005),
-        i + (nRandom + nMarketMaker), momentumTraderRate));
-  }
+  AgentManager agentManager_(maxTime, orderbook);
+
+  AgentPopulation population;
+  population.nRandom = nRandom;
+  population.randomRate = randomRate;
+  population.sigma = sigma;
+  population.nMarketMaker = nMarketMaker;
+  population.marketMakerRate = marketMakerRate;
+  population.nMomentumTrader = nMomentumTrader;
+  population.momentumTraderRate = momentumTraderRate;
+  agentManager_.Populate(population, tradeDispatcher, matchingEngine,
+                         &orderPool, seed);
 
   agentManager_.WarmUp();
   agentManager_.SetRunning(true);
 
-  std::thread t1(&MatchingEngine::Start, &matchingEngine);
-  std::thread t2(&AgentManager::RunIncomingLoop, &agentManager_);
-  agentManager_.RunOutgoingLoop();
-  agentManager_.SetRunning(false);
-  matchingEngine.Stop();
+  std::thread t1;
+  std::thread t2;
+  if (steppingMode == 2) {
+    agentManager_.RunLockstepLoop(matchingEngine, tradeDispatcher);
+  } else {
+    tradeDispatcher.Start();
+    t1 = std::thread(&MatchingEngine::Start, &matchingEngine);
+    t2 = std::thread(&AgentManager::RunIncomingLoop, &agentManager_);
+    if (steppingMode == 1) {
+      agentManager_.RunBatchedOutgoingLoop(timeSlice, nAgentThreads);
+    } else {
+      agentManager_.RunOutgoingLoop();
+    }
+    matchingEngine.Stop();
+
+    if (t1.joinable()) {
+      t1.join();
+    }
 
-  if (t1.joinable()) {
-    t1.join();
+    tradeDispatcher.Stop();
+  }
+  if (journal) {
+    journal->Close();
+    std::cout << "Journaled " << journal->size() << " orders to "
+              << journalPath << (journal->full() ? " (journal full)" : "")
+              << "\n\n";
   }
+  if (tape) {
+    tape->Close();
+    std::cout << "Taped " << tape->GetNTrades() << " trades and "
+              << tape->GetNTops() << " top of book changes to " << tapePath
+              << (tape->failed() ? " (write failed, tape incomplete)" : "")
+              << "\n\n";
+  }
+  agentManager_.SetRunning(false);
 
   if (t2.joinable()) {
     t2.join();
   }
 
   orderbook.PrintBook();
+  std::cout << "Orders rejected by the ledger: "
+            << matchingEngine.GetRejectedOrders() << "\n\n";
   // agentManager_.PrintStates();
   agentManager_.PrintSummary();
+  agentManager_.PrintRoundTripReport();
+  PrintLatencyReport();
+  PrintThreadPerfReport();
+  PrintPlacementReport();
   return 0;
 }
 
@@ -0,0 +1,118 @@
+#include "CounterRng.h"
+#include "FeedFile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Writes a feed file for benchmark_feedreplay. Prices are normal around the
+// middle of the book, quantities normal around 10, and each message is a
+// cancel, replace or execute with the given probabilities, otherwise an add.
+// Cancels and replaces pick a random order the generator has added, which
+// may already have been filled by the time the engine sees it.
+
+namespace {
+
+struct LiveOrder {
+  std::uint64_t id;
+  char side;
+  std::uint32_t price;
+};
+
+constexpr double MEAN_PRICE = 110.0;
+constexpr double MIN_PRICE = 100.0; // Matches the book's price range
+constexpr double MAX_PRICE = 120.0;
+
+template <typename Message>
+void Write(std::ofstream &out, Message &message, FeedMessageType type) {
+  message.header = FeedMessageHeader{sizeof(Message), type};
+  out.write(reinterpret_cast<const char *>(&message), sizeof(Message));
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    std::cerr << "Usage: feedgen <out> [messages] [seed] [price sigma] "
+                 "[cancel prob] [replace prob] [execute prob]"
+              << std::endl;
+    return 2;
+  }
+  const std::string path = argv[1];
+  const std::uint64_t nMessages = argc > 2 ? std::stoull(argv[2]) : 5'000'000;
+  const std::uint64_t seed = argc > 3 ? std::stoull(argv[3]) : 1;
+  const double sigma = argc > 4 ? std::stod(argv[4]) : 5.0;
+  const double pCancel = argc > 5 ? std::stod(argv[5]) : 0.25;
+  const double pReplace = argc > 6 ? std::stod(argv[6]) : 0.10;
+  const double pExecute = argc > 7 ? std::stod(argv[7]) : 0.10;
+
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out) {
+    std::cerr << "Could not open " << path << std::endl;
+    return 2;
+  }
+  FeedFileHeader header{FEED_MAGIC, FEED_VERSION, 0, nMessages};
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+  CounterRng rng(seed, 0, 0);
+  auto drawPrice = [&] {
+    const double price =
+        std::clamp(MEAN_PRICE + sigma * rng.Normal(), MIN_PRICE, MAX_PRICE);
+    return static_cast<std::uint32_t>(std::lround(price * 100.0));
+  };
+  auto drawQuantity = [&] {
+    return static_cast<std::uint32_t>(
+        std::max(1L, std::lround(10.0 + 5.0 * rng.Normal())));
+  };
+  auto drawSide = [&] { return rng.Bernoulli(0.5) ? 'B' : 'S'; };
+
+  std::vector<LiveOrder> live;
+  std::uint64_t nextId = 1;
+  std::uint64_t counts[4] = {};
+  for (std::uint64_t i = 0; i < nMessages; ++i) {
+    const double u = rng.Uniform();
+    if (u < pCancel + pReplace && !live.empty()) {
+      LiveOrder &order = live[rng.Next() % live.size()];
+      if (u < pCancel) {
+        FeedCancel message{{}, order.id, order.side, order.price};
+        Write(out, message, FEED_CANCEL);
+        order = live.back();
+        live.pop_back();
+        ++counts[1];
+      } else {
+        FeedReplace message{{},          order.id,    nextId,
+                            order.side,  order.price, drawQuantity(),
+                            drawPrice()};
+        Write(out, message, FEED_REPLACE);
+        order.id = nextId++;
+        order.price = message.newPrice;
+        ++counts[2];
+      }
+    } else if (u < pCancel + pReplace + pExecute) {
+      FeedExecute message{{}, nextId++, drawSide(), drawQuantity(),
+                          drawPrice()};
+      Write(out, message, FEED_EXECUTE);
+      ++counts[3];
+    } else {
+      FeedAdd message{{}, nextId, drawSide(), drawQuantity(), drawPrice()};
+      Write(out, message, FEED_ADD);
+      live.push_back(LiveOrder{nextId++, message.side, message.price});
+      ++counts[0];
+    }
+  }
+  if (!out.flush()) {
+    std::cerr << "Could not write " << path << std::endl;
+    return 2;
+  }
+
+  std::cout << "Wrote " << nMessages << " messages to " << path << " ("
+            << counts[0] << " adds, " << counts[1] << " cancels, "
+            << counts[2] << " replaces, " << counts[3] << " executes)"
+            << std::endl;
+  return 0;
+}
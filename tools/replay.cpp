@@ -0,0 +1,91 @@
+#include "LatencyProbes.h"
+#include "MatchingEngine.h"
+#include "Order.h"
+#include "OrderJournal.h"
+#include "OrderPool.h"
+#include "Orderbook.h"
+#include "TradeDispatcher.h"
+
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+// Feeds a journal back through the matching engine as fast as it will go and
+// checks it produces exactly the execution reports of the recorded run
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    std::cerr << "Usage: replay <journal>" << std::endl;
+    return 2;
+  }
+
+  try {
+    JournalReader journal(argv[1]);
+    const JournalHeader &header = journal.GetHeader();
+
+    TradeDispatcher tradeDispatcher;
+    OrderPool orderPool;
+    Orderbook orderbook(&orderPool, tradeDispatcher);
+    MatchingEngine matchingEngine(orderbook, &orderPool);
+    TradeDigest tradeDigest;
+    matchingEngine.AttachTradeDigest(&tradeDigest);
+    // Every recorded client started with a fresh account, so orders the
+    // run rejected are rejected again
+    for (const JournalRecord &record : journal.GetRecords()) {
+      if (!matchingEngine.GetLedger().IsOpen(record.clientRef)) {
+        matchingEngine.GetLedger().Open(record.clientRef, INITIAL_CASH,
+                                        INITIAL_UNITS);
+      }
+    }
+
+    tradeDispatcher.Start();
+    auto loop_start = std::chrono::steady_clock::now();
+    for (const JournalRecord &record : journal.GetRecords()) {
+      PoolIndex slot = orderPool.allocate();
+      Order *order = orderPool.get_order(slot);
+      order->SetOrderId(record.id);
+      order->SetOrderType(static_cast<OrderType>(record.type));
+      order->SetSide(static_cast<Side>(record.side));
+      order->SetPriceFilter(static_cast<PriceFilter>(record.filter));
+      order->SetPrice(record.price);
+      order->SetRemainingQuantity(record.quantity);
+      order->SetIndex(slot);
+      *orderPool.get_info(slot) =
+          OrderInfo{record.clientRef, record.quantity, 0};
+      matchingEngine.ProcessOrder(order);
+    }
+    auto loop_end = std::chrono::steady_clock::now();
+    tradeDispatcher.Stop();
+
+    double duration_ms =
+        std::chrono::duration<double, std::milli>(loop_end - loop_start)
+            .count();
+    double throughput_ops_per_sec =
+        (static_cast<double>(header.nRecords) / duration_ms) * 1000.0;
+    const bool identical = tradeDigest.GetNReports() == header.nReports &&
+                           tradeDigest.GetDigest() == header.tradeDigest;
+
+    std::cout << "+---------------------------------------+" << std::endl;
+    std::cout << "| Orders replayed: " << std::setw(12) << header.nRecords
+              << std::endl;
+    std::cout << "| Duration: " << std::setw(12) << std::fixed
+              << std::setprecision(2) << duration_ms << " ms" << std::endl;
+    std::cout << "| Throughput: " << std::setw(10) << std::fixed
+              << std::setprecision(0) << throughput_ops_per_sec << " ops/sec"
+              << std::endl;
+    std::cout << "| Reports recorded: " << std::setw(11) << header.nReports
+              << std::endl;
+    std::cout << "| Reports replayed: " << std::setw(11)
+              << tradeDigest.GetNReports() << std::endl;
+    std::cout << "| Trades: "
+              << (identical ? "identical" : "MISMATCH") << std::endl;
+    std::cout << "+---------------------------------------+" << std::endl;
+    PrintLatencyReport();
+    return identical ? 0 : 1;
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return 2;
+  }
+}
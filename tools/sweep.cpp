@@ -0,0 +1,458 @@
+#include "Agent.h"
+#include "AgentManager.h"
+#include "AgentStrategy.h"
+#include "MatchingEngine.h"
+#include "OrderPool.h"
+#include "Orderbook.h"
+#include "PerfCounters.h"
+#include "ThreadPlacement.h"
+#include "TradeDispatcher.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Runs every combination of the values listed in a scenario file as an
+// independent lockstep simulation, several at a time, and writes one CSV row
+// per run. A scenario file holds "key = value, value, ..." lines, integer
+// values can also be given as a range "first..last". Each run builds its own
+// engine, book and pool sized to pool_capacity, runs share nothing.
+//
+//   random = 20, 50
+//   random_sigma = 1
+//   seed = 1..100
+//   duration = 1000
+//   jobs = 8       # runs at a time, defaults to one per core
+//   cores = 0-7    # pins the n-th job to the n-th core
+//
+// Keys left out take the defaults below.
+
+namespace {
+
+enum Parameter : std::size_t {
+  RANDOM,
+  RANDOM_SIGMA,
+  RANDOM_RATE,
+  MARKET_MAKERS,
+  MARKET_MAKER_SPREAD,
+  MARKET_MAKER_RATE,
+  MOMENTUM_TRADERS,
+  MOMENTUM_THRESHOLD,
+  MOMENTUM_TRADER_RATE,
+  DURATION,
+  POOL_CAPACITY,
+  SEED,
+  N_PARAMETERS
+};
+
+struct ParameterInfo {
+  const char *key;
+  double defaultValue;
+};
+
+constexpr ParameterInfo PARAMETERS[N_PARAMETERS] = {
+    {"random", 20},
+    {"random_sigma", 1},
+    {"random_rate", 1},
+    {"market_makers", 5},
+    {"market_maker_spread", 0.02},
+    {"market_maker_rate", 1},
+    {"momentum_traders", 5},
+    {"momentum_threshold", 0.005},
+    {"momentum_trader_rate", 1},
+    {"duration", 1000},
+    {"pool_capacity", 1'000'000},
+    {"seed", 1},
+};
+
+constexpr std::uint64_t MAX_DURATION = 1'000'000'000;
+
+using RunConfig = std::array<double, N_PARAMETERS>;
+
+struct Scenario {
+  std::array<std::vector<double>, N_PARAMETERS> axes;
+  std::size_t jobs{std::max(1u, std::thread::hardware_concurrency())};
+  std::string cores;
+};
+
+struct RunResult {
+  std::uint64_t actions{0};
+  std::uint64_t orders{0};
+  std::uint64_t rejected{0};
+  double wallMs{0};
+  std::optional<Price> bestBid;
+  std::optional<Price> bestAsk;
+  std::vector<StrategySummary> summaries;
+  std::string error;
+};
+
+std::string Trim(std::string_view text) {
+  const std::size_t begin = text.find_first_not_of(" \t\r");
+  if (begin == std::string_view::npos) {
+    return {};
+  }
+  const std::size_t end = text.find_last_not_of(" \t\r");
+  return std::string(text.substr(begin, end - begin + 1));
+}
+
+bool ParseValues(const std::string &text, std::vector<double> &values) {
+  std::istringstream items(text);
+  std::string item;
+  while (std::getline(items, item, ',')) {
+    item = Trim(item);
+    const std::size_t range = item.find("..");
+    try {
+      std::size_t used = 0;
+      if (range != std::string::npos) {
+        const long long first = std::stoll(item.substr(0, range), &used);
+        const long long last = std::stoll(item.substr(range + 2));
+        if (used != range || last < first) {
+          return false;
+        }
+        for (long long value = first; value <= last; ++value) {
+          values.push_back(static_cast<double>(value));
+        }
+      } else {
+        values.push_back(std::stod(item, &used));
+        if (used != item.size()) {
+          return false;
+        }
+      }
+    } catch (const std::exception &) {
+      return false;
+    }
+  }
+  return !values.empty();
+}
+
+std::optional<Scenario> ReadScenario(const char *path) {
+  std::ifstream in(path);
+  if (!in) {
+    std::cerr << "Failed to open " << path << '\n';
+    return std::nullopt;
+  }
+  Scenario scenario;
+  std::string line;
+  std::size_t lineNumber = 0;
+  while (std::getline(in, line)) {
+    ++lineNumber;
+    line = Trim(line.substr(0, line.find('#')));
+    if (line.empty()) {
+      continue;
+    }
+    const std::size_t equals = line.find('=');
+    if (equals == std::string::npos) {
+      std::cerr << path << ':' << lineNumber << ": expected key = value\n";
+      return std::nullopt;
+    }
+    const std::string key = Trim(line.substr(0, equals));
+    const std::string value = Trim(line.substr(equals + 1));
+    if (key == "cores") {
+      scenario.cores = value;
+      continue;
+    }
+    std::vector<double> values;
+    if (!ParseValues(value, values)) {
+      std::cerr << path << ':' << lineNumber << ": bad value for " << key
+                << '\n';
+      return std::nullopt;
+    }
+    if (key == "jobs") {
+      if (values.size() != 1 || values[0] < 1) {
+        std::cerr << path << ':' << lineNumber << ": jobs must be one "
+                  << "number of at least 1\n";
+        return std::nullopt;
+      }
+      scenario.jobs = static_cast<std::size_t>(values[0]);
+      continue;
+    }
+    const auto *parameter =
+        std::find_if(std::begin(PARAMETERS), std::end(PARAMETERS),
+                     [&](const ParameterInfo &p) { return key == p.key; });
+    if (parameter == std::end(PARAMETERS)) {
+      std::cerr << path << ':' << lineNumber << ": unknown key " << key
+                << '\n';
+      return std::nullopt;
+    }
+    scenario.axes[parameter - PARAMETERS] = std::move(values);
+  }
+  for (std::size_t i = 0; i < N_PARAMETERS; ++i) {
+    if (scenario.axes[i].empty()) {
+      scenario.axes[i].push_back(PARAMETERS[i].defaultValue);
+    }
+  }
+  return scenario;
+}
+
+// Every combination of the axes, the last parameter (the seed) varying
+// fastest
+std::vector<RunConfig> ExpandGrid(const Scenario &scenario) {
+  std::vector<RunConfig> runs(1);
+  for (std::size_t i = 0; i < N_PARAMETERS; ++i) {
+    std::vector<RunConfig> expanded;
+    expanded.reserve(runs.size() * scenario.axes[i].size());
+    for (const RunConfig &run : runs) {
+      for (const double value : scenario.axes[i]) {
+        expanded.push_back(run);
+        expanded.back()[i] = value;
+      }
+    }
+    runs = std::move(expanded);
+  }
+  return runs;
+}
+
+std::string CheckRun(const RunConfig &run) {
+  for (const Parameter count : {RANDOM, MARKET_MAKERS, MOMENTUM_TRADERS}) {
+    if (run[count] < 0) {
+      return std::string("negative ") + PARAMETERS[count].key;
+    }
+  }
+  for (const Parameter positive :
+       {RANDOM_SIGMA, RANDOM_RATE, MARKET_MAKER_RATE, MOMENTUM_TRADER_RATE,
+        POOL_CAPACITY}) {
+    if (run[positive] <= 0) {
+      return std::string(PARAMETERS[positive].key) + " must be above 0";
+    }
+  }
+  if (run[DURATION] < 0 || run[DURATION] > MAX_DURATION) {
+    return "duration out of range";
+  }
+  // Pool indices are 32 bits
+  if (run[POOL_CAPACITY] > INT32_MAX) {
+    return "pool_capacity above " + std::to_string(INT32_MAX);
+  }
+  return {};
+}
+
+RunResult RunSimulation(const RunConfig &run) {
+  RunResult result;
+  result.error = CheckRun(run);
+  if (!result.error.empty()) {
+    return result;
+  }
+  const auto poolCapacity = static_cast<std::size_t>(run[POOL_CAPACITY]);
+  const auto seed = static_cast<std::uint64_t>(run[SEED]);
+  const auto nRandom = static_cast<std::size_t>(run[RANDOM]);
+  const auto nMarketMaker = static_cast<std::size_t>(run[MARKET_MAKERS]);
+  const auto nMomentumTrader =
+      static_cast<std::size_t>(run[MOMENTUM_TRADERS]);
+  try {
+    TradeDispatcher tradeDispatcher;
+    auto orderPool = std::make_unique<OrderPool>(poolCapacity);
+    // The book can't rest more orders than the pool holds, twice that many
+    // slots keeps its index at most half full
+    auto orderbook = std::make_unique<Orderbook>(
+        orderPool.get(), tradeDispatcher,
+        std::bit_ceil(std::max<std::size_t>(poolCapacity, 2) * 2));
+    MatchingEngine matchingEngine(*orderbook, orderPool.get());
+    auto agentManager = std::make_unique<AgentManager>(
+        static_cast<std::uint64_t>(run[DURATION]), *orderbook);
+
+    AgentPopulation population;
+    population.nRandom = nRandom;
+    population.randomRate = run[RANDOM_RATE];
+    population.sigma = run[RANDOM_SIGMA];
+    population.nMarketMaker = nMarketMaker;
+    population.marketMakerRate = run[MARKET_MAKER_RATE];
+    population.spread = run[MARKET_MAKER_SPREAD];
+    population.nMomentumTrader = nMomentumTrader;
+    population.momentumTraderRate = run[MOMENTUM_TRADER_RATE];
+    population.threshold = run[MOMENTUM_THRESHOLD];
+    agentManager->Populate(population, tradeDispatcher, matchingEngine,
+                           orderPool.get(), seed);
+
+    agentManager->WarmUp();
+    agentManager->SetRunning(true);
+    const auto start = std::chrono::steady_clock::now();
+    agentManager->RunLockstepLoop(matchingEngine, tradeDispatcher);
+    const auto end = std::chrono::steady_clock::now();
+    // The lockstep thread files its counters on every run and the sweep
+    // never reports them, so they would only fill the table
+    ResetThreadPerfReports();
+    agentManager->SetRunning(false);
+
+    result.actions = agentManager->GetNAgentActions();
+    result.orders = matchingEngine.GetProcessedOrders();
+    result.rejected = matchingEngine.GetRejectedOrders();
+    result.wallMs =
+        std::chrono::duration<double, std::milli>(end - start).count();
+    if (auto bid = orderbook->GetBestBid()) {
+      result.bestBid = orderbook->IndexToPrice(*bid);
+    }
+    if (auto ask = orderbook->GetBestAsk()) {
+      result.bestAsk = orderbook->IndexToPrice(*ask);
+    }
+    result.summaries = agentManager->GetSummary();
+  } catch (const std::exception &e) {
+    result.error = e.what();
+  }
+  return result;
+}
+
+// Lower case with underscores, "Market Maker Agents" -> "market_maker"
+std::string ColumnPrefix(std::string_view name) {
+  if (name.ends_with(" Agents")) {
+    name.remove_suffix(7);
+  }
+  std::string prefix;
+  for (const char c : name) {
+    prefix += c == ' ' ? '_' : static_cast<char>(std::tolower(c));
+  }
+  return prefix;
+}
+
+void WriteHeader(std::ostream &out, const std::vector<std::string> &prefixes) {
+  out << "run";
+  for (const ParameterInfo &parameter : PARAMETERS) {
+    out << ',' << parameter.key;
+  }
+  out << ",actions,orders,rejected,wall_ms,best_bid,best_ask";
+  for (const std::string &prefix : prefixes) {
+    out << ',' << prefix << "_mean_profit," << prefix << "_profit_sd,"
+        << prefix << "_mean_cash," << prefix << "_mean_units";
+  }
+  out << ",error\n";
+}
+
+void WriteRow(std::ostream &out, std::size_t index, const RunConfig &run,
+              const RunResult &result, std::size_t nStrategies) {
+  out << index;
+  for (const double value : run) {
+    // Counts, capacities and seeds as written, not as 1e+06
+    if (value == std::trunc(value) && std::fabs(value) < 0x1p53) {
+      out << ',' << static_cast<std::int64_t>(value);
+    } else {
+      out << ',' << value;
+    }
+  }
+  out << ',' << result.actions << ',' << result.orders << ','
+      << result.rejected << ',' << std::fixed << std::setprecision(3)
+      << result.wallMs << ',' << std::setprecision(2);
+  if (result.bestBid) {
+    out << *result.bestBid;
+  }
+  out << ',';
+  if (result.bestAsk) {
+    out << *result.bestAsk;
+  }
+  out << std::setprecision(3);
+  for (std::size_t i = 0; i < nStrategies; ++i) {
+    if (i < result.summaries.size()) {
+      const StrategySummary &summary = result.summaries[i];
+      out << ',' << summary.meanProfit << ',' << summary.profitStdDev << ','
+          << summary.meanCash << ',' << summary.meanUnits;
+    } else {
+      out << ",,,,";
+    }
+  }
+  out.unsetf(std::ios::floatfield);
+  out << std::setprecision(6) << ',';
+  // Errors are free text, quoted so commas can't split the row
+  if (!result.error.empty()) {
+    out << '"';
+    for (const char c : result.error) {
+      out << (c == '"' ? '\'' : c);
+    }
+    out << '"';
+  }
+  out << '\n';
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    std::cerr << "Usage: " << argv[0] << " <scenario> [summary.csv]\n";
+    return 1;
+  }
+  const std::optional<Scenario> scenario = ReadScenario(argv[1]);
+  if (!scenario) {
+    return 1;
+  }
+  if (!scenario->cores.empty()) {
+    const auto placement =
+        ParseThreadPlacement("workers:" + scenario->cores);
+    if (!placement) {
+      std::cerr << "Bad cores list: " << scenario->cores << '\n';
+      return 1;
+    }
+    SetThreadPlacement(*placement);
+  }
+
+  const std::vector<RunConfig> runs = ExpandGrid(*scenario);
+  std::vector<RunResult> results(runs.size());
+  const std::size_t nJobs = std::min(scenario->jobs, runs.size());
+  std::cerr << "Running " << runs.size() << " simulations on " << nJobs
+            << " jobs\n";
+
+  std::atomic<std::size_t> next{0};
+  std::atomic<std::size_t> done{0};
+  std::mutex progressMutex;
+  auto job = [&](std::size_t index) {
+    // Pinned before anything is built so each run's memory is local to it
+    PinThread(PipelineRole::WORKERS, index);
+    for (std::size_t i = next.fetch_add(1); i < runs.size();
+         i = next.fetch_add(1)) {
+      results[i] = RunSimulation(runs[i]);
+      const std::size_t finished = done.fetch_add(1) + 1;
+      std::lock_guard<std::mutex> lock(progressMutex);
+      std::cerr << "\r" << finished << '/' << runs.size() << std::flush;
+    }
+  };
+  std::vector<std::thread> jobs;
+  for (std::size_t i = 0; i < nJobs; ++i) {
+    jobs.emplace_back(job, i);
+  }
+  for (auto &thread : jobs) {
+    thread.join();
+  }
+  std::cerr << '\n';
+
+  std::vector<std::string> prefixes;
+  AgentPools{}.ForEach([&](auto &pool) {
+    using Strategy = typename std::decay_t<decltype(pool)>::StrategyType;
+    prefixes.push_back(ColumnPrefix(Strategy::Name));
+  });
+
+  std::ofstream file;
+  if (argc > 2) {
+    file.open(argv[2]);
+    if (!file) {
+      std::cerr << "Failed to open " << argv[2] << '\n';
+      return 1;
+    }
+  }
+  std::ostream &out = argc > 2 ? static_cast<std::ostream &>(file) : std::cout;
+  WriteHeader(out, prefixes);
+  std::size_t failed = 0;
+  for (std::size_t i = 0; i < runs.size(); ++i) {
+    WriteRow(out, i, runs[i], results[i], prefixes.size());
+    failed += results[i].error.empty() ? 0 : 1;
+  }
+  if (failed > 0) {
+    std::cerr << failed << " runs failed\n";
+  }
+  if (argc > 2) {
+    PrintPlacementReport();
+  }
+  return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,50 @@
+#include "Order.h"
+#include "Tape.h"
+
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+// Exports a tape written by the simulation as one CSV per tape, streaming
+// each tape out a block at a time
+
+int main(int argc, char **argv) {
+  if (argc != 4) {
+    std::cerr << "Usage: tape2csv <tape> <trades.csv> <top.csv>" << std::endl;
+    return 2;
+  }
+
+  try {
+    TapeReader tape(argv[1]);
+
+    std::ofstream trades(argv[2]);
+    trades << "seq,price,quantity,side,buyer,seller\n";
+    const std::uint64_t nTrades =
+        tape.ForEachTrade([&](const TapeTrade &trade) {
+          trades << trade.seq << ',' << trade.price << ',' << trade.quantity
+                 << ',' << (trade.side == Side::Buy ? 'B' : 'S') << ','
+                 << trade.buyer << ',' << trade.seller << '\n';
+        });
+
+    std::ofstream tops(argv[3]);
+    tops << "seq,bid,ask,bid_size,ask_size\n";
+    const std::uint64_t nTops = tape.ForEachTop([&](const TapeTop &top) {
+      tops << top.seq << ',' << top.bid << ',' << top.ask << ','
+           << top.bidSize << ',' << top.askSize << '\n';
+    });
+
+    trades.close();
+    tops.close();
+    if (!trades || !tops) {
+      std::cerr << "Could not write the CSV files" << std::endl;
+      return 2;
+    }
+    std::cout << "Exported " << nTrades << " trades and " << nTops
+              << " top of book changes" << std::endl;
+    return 0;
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return 2;
+  }
+}